@@ -24,7 +24,7 @@ meta:
 common:
 	# dependencies with other addons, a list of them separated by spaces 
 	# or use += in several lines
-	ADDON_DEPENDENCIES = ofxAccelerometer ofxJSON ofxZipPass ofxPoco ofxLua
+	ADDON_DEPENDENCIES = ofxAccelerometer ofxZipPass ofxPoco ofxLua
 
 #ifeq ($(LINUX_ARM),1)
 #WARNING : for RaspberryPI you have to manually uncomment the following line:
@@ -43,6 +43,10 @@ common:
 	# addon
 	ADDON_CFLAGS = -DHAVE_UNISTD_H
 	ADDON_CFLAGS += -DPD
+	# LuaJIT : to run poflua on LuaJIT (with FFI views of the poflua buffers), build ofxLua
+	# against LuaJIT instead of its bundled Lua, then uncomment the following lines:
+	#ADDON_CFLAGS += -DPOF_LUAJIT
+	#ADDON_PKG_CONFIG_LIBRARIES += luajit
 	
 
 	# any special flag that should be passed to the linker when using this
@@ -52,6 +56,8 @@ common:
 	# linux only, any library that should be included in the project using
 	# pkg-config
 	# ADDON_PKG_CONFIG_LIBRARIES =
+	# libcurl : used by pofutil and the pofimage http cache
+	ADDON_PKG_CONFIG_LIBRARIES += libcurl
 	
 	# osx/iOS only, any framework that should be included in the project
 	# ADDON_FRAMEWORKS =
@@ -0,0 +1,191 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+// pofxml backends benchmark: Poco::XML (former ofxXmlPoco backend) vs pugixml (see README.md).
+
+#include "pofXMLPath.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef XMLBENCH_POCO
+#include <Poco/AutoPtr.h>
+#include <Poco/DOM/DOMParser.h>
+#include <Poco/DOM/DOMWriter.h>
+#include <Poco/DOM/Document.h>
+#include <Poco/DOM/Element.h>
+#include <Poco/DOM/Node.h>
+#include <Poco/XML/XMLWriter.h>
+#endif
+
+using namespace std;
+
+static const int REPEAT = 20; // the paths are resolved REPEAT times
+
+static double now()
+{
+	return chrono::duration<double, milli>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// A show file: cues with their fades and light channels.
+static void generateShow(const char *path, int cues, int channels)
+{
+	ofstream f(path);
+	f << "<?xml version=\"1.0\"?>\n<show name=\"bench\">\n";
+	for(int c = 0; c < cues; c++) {
+		f << "\t<cue id=\"c" << c << "\" group=\"" << c % 10 << "\">\n";
+		f << "\t\t<name>Cue number " << c << "</name>\n";
+		f << "\t\t<fade time=\"" << (c % 7) * 0.5 << "\" curve=\"linear\"/>\n";
+		for(int l = 0; l < channels; l++)
+			f << "\t\t<light channel=\"" << l << "\" level=\"" << (c * 7 + l) % 100 / 100.0 << "\">"
+				<< (c + l) % 256 << "</light>\n";
+		f << "\t\t<comment>Some text for the operator, describing what happens during this cue.</comment>\n";
+		f << "\t</cue>\n";
+	}
+	f << "</show>\n";
+}
+
+static vector<string> showPaths(int cues, int channels)
+{
+	vector<string> paths;
+	for(int i = 0; i < 50; i++) {
+		int c = (i * 397) % cues, l = (i * 5) % channels;
+		ostringstream s;
+		s << "cue[" << c << "]/name"; paths.push_back(s.str()); s.str("");
+		s << "cue[" << c << "]/light[" << l << "]"; paths.push_back(s.str()); s.str("");
+		s << "cue[" << c << "]/light[" << l << "][@level]"; paths.push_back(s.str()); s.str("");
+		s << "cue[@id=c" << c << "]/fade[@time]"; paths.push_back(s.str()); s.str("");
+	}
+	paths.push_back("//comment");
+	paths.push_back("cue[@group=9]/name");
+	return paths;
+}
+
+struct Times {
+	double load, get, set, save;
+	size_t found;
+};
+
+static void report(const char *name, const Times &t, size_t queries)
+{
+	printf("%-8s load %9.2f ms   get %9.2f ms (%6.2f us/path, %zu found)   set %9.2f ms   save %9.2f ms\n",
+		name, t.load, t.get, t.get * 1000 / queries, t.found, t.set, t.save);
+}
+
+static Times benchPugi(const char *file, const vector<string> &paths, const string &saved)
+{
+	Times t;
+	double t0 = now();
+	pugi::xml_document doc;
+	if(!doc.load_file(file)) {
+		fprintf(stderr, "pugixml: can't load %s\n", file);
+		exit(1);
+	}
+	pugi::xml_node base = doc.document_element();
+	t.load = now() - t0;
+
+	t0 = now();
+	t.found = 0;
+	size_t len = 0;
+	for(int r = 0; r < REPEAT; r++) for(size_t i = 0; i < paths.size(); i++) {
+		pugi::xpath_node n = pofXMLFindPath(base, paths[i].c_str());
+		if(!n) continue;
+		len += n.attribute() ? strlen(n.attribute().value()) : strlen(n.node().child_value());
+		if(!r) t.found++;
+	}
+	t.get = now() - t0;
+
+	t0 = now();
+	for(size_t i = 0; i < paths.size(); i++) {
+		pugi::xpath_node n = pofXMLFindPath(base, paths[i].c_str());
+		if(n.attribute()) n.attribute().set_value("1");
+		else if(n.node()) n.node().text().set("1");
+	}
+	t.set = now() - t0;
+
+	t0 = now();
+	doc.save_file(saved.c_str());
+	t.save = now() - t0;
+	if(!len) printf(" "); // keep the reads
+	return t;
+}
+
+#ifdef XMLBENCH_POCO
+static Times benchPoco(const char *file, const vector<string> &paths, const string &saved)
+{
+	Times t;
+	double t0 = now();
+	// as ofxXmlPoco::load(): the whole text, parsed without the whitespace nodes
+	ifstream in(file, ios::binary);
+	string text((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	Poco::XML::DOMParser parser;
+	parser.setFeature(Poco::XML::DOMParser::FEATURE_FILTER_WHITESPACE, true);
+	Poco::AutoPtr<Poco::XML::Document> doc = parser.parseString(text);
+	Poco::XML::Element *base = doc->documentElement();
+	t.load = now() - t0;
+
+	t0 = now();
+	t.found = 0;
+	size_t len = 0;
+	for(int r = 0; r < REPEAT; r++) for(size_t i = 0; i < paths.size(); i++) {
+		Poco::XML::Node *n = base->getNodeByPath(paths[i]);
+		if(!n) continue;
+		len += n->innerText().size();
+		if(!r) t.found++;
+	}
+	t.get = now() - t0;
+
+	t0 = now();
+	for(size_t i = 0; i < paths.size(); i++) {
+		Poco::XML::Node *n = base->getNodeByPath(paths[i]);
+		if(!n) continue;
+		if(n->nodeType() == Poco::XML::Node::ATTRIBUTE_NODE) n->setNodeValue("1");
+		else if(n->firstChild()) n->firstChild()->setNodeValue("1");
+	}
+	t.set = now() - t0;
+
+	t0 = now();
+	ofstream out(saved.c_str());
+	Poco::XML::DOMWriter writer;
+	writer.setOptions(Poco::XML::XMLWriter::PRETTY_PRINT | Poco::XML::XMLWriter::WRITE_XML_DECLARATION);
+	writer.writeNode(out, doc);
+	out.close();
+	t.save = now() - t0;
+	if(!len) printf(" ");
+	return t;
+}
+#endif
+
+int main(int argc, char **argv)
+{
+	const char *file = "show.xml";
+	vector<string> paths;
+
+	if(argc > 1) {
+		file = argv[1];
+		for(int i = 2; i < argc; i++) paths.push_back(argv[i]);
+		if(paths.empty()) {
+			fprintf(stderr, "usage: %s [FILE PATH...]\n", argv[0]);
+			return 1;
+		}
+	} else {
+		generateShow(file, 2000, 16);
+		paths = showPaths(2000, 16);
+	}
+
+	ifstream in(file, ios::binary | ios::ate);
+	printf("%s: %.1f kB, %zu paths resolved %d times\n", file, in.tellg() / 1024.0, paths.size(), REPEAT);
+
+	report("pugixml", benchPugi(file, paths, "show-pugixml.saved.xml"), paths.size() * REPEAT);
+#ifdef XMLBENCH_POCO
+	report("Poco", benchPoco(file, paths, "show-poco.saved.xml"), paths.size() * REPEAT);
+#endif
+	return 0;
+}
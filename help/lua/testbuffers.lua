@@ -0,0 +1,36 @@
+-- poflua buffers : pixels and meshes filled in place, then drawn in one call.
+-- With LuaJIT, M:pixels() and M:mesh() return FFI pointers (indexed from 0);
+-- with standard Lua they return nil, and M:setbuffer() must be used instead.
+-- Pixels written through the pointer are uploaded again after M:pixelschanged().
+
+local N = 2000
+local W, H = 64, 64
+local t = 0
+
+function M:draw()
+	t = t + 0.02
+
+	local v = M:mesh("curve", N)
+	if v then
+		for i = 0, N - 1 do
+			local a = i / N * 2 * math.pi
+			v[3 * i] = 150 * math.cos(3 * a + t)
+			v[3 * i + 1] = 150 * math.sin(2 * a)
+			v[3 * i + 2] = 0
+		end
+	else
+		for i = 0, N - 1 do
+			local a = i / N * 2 * math.pi
+			M:setbuffer("curve", "vertices", 3 * i, 150 * math.cos(3 * a + t), 150 * math.sin(2 * a), 0)
+		end
+	end
+	M:drawbuffer("curve", "linestrip")
+
+	local p = M:pixels("noise", W, H, 1)
+	if p then
+		for i = 0, W * H - 1 do p[i] = math.random(0, 255) end
+		M:pixelschanged("noise")
+		M:drawbuffer("noise", -200, -200, 128, 128)
+	end
+	drawconfig(M.pdself, "do")
+end
@@ -0,0 +1,15 @@
+-- poflua lists : send a whole Lua array to Pd as one message.
+
+function M:ramp(n)
+	local t = {}
+	for i = 1, n do t[i] = (i - 1) / n end
+	M:outlist(t)            -- one list from the right outlet
+	M:sendlist("ramp_rcv", t) -- one list to a receiver
+end
+
+function M:sine(n)
+	local t = {}
+	for i = 1, n do t[i] = math.sin(2 * math.pi * (i - 1) / n) end
+	M:toarray("sine_array", t)    -- the array is resized to n points
+	M:toarray("sine_array", {1, 1}, 0) -- write at onset 0, keep the size
+end
@@ -304,6 +304,15 @@ error:
 	return 0;
 }
 
+int ofx_sth_add_font_from_owned_memory(struct ofx_sth_stash* stash, unsigned char* buffer)
+{
+	int idx = ofx_sth_add_font_from_memory(stash, buffer);
+	// Modify type of the loaded font, so that the data is freed with it.
+	if (idx)
+		stash->fonts->type = TTFONT_FILE;
+	return idx;
+}
+
 int ofx_sth_add_bitmap_font(struct ofx_sth_stash* stash, int ascent, int descent, int line_gap)
 {
 	int i, fh;
@@ -400,6 +409,45 @@ void ofx_sth_add_glyph(struct ofx_sth_stash* stash,
 	fnt->lut[h] = fnt->nglyphs-1;
 }
 
+void ofx_sth_set_sdf(struct ofx_sth_stash* stash, float refSize, int spread)
+{
+	stash->sdfSize = (short)(refSize*10.0f);
+	stash->sdfSpread = spread > 0 ? spread : 1;
+}
+
+// Signed distance (in pixels, clamped to spread) of each pixel to the edge of the coverage bitmap,
+// mapped to 128 +- 127.
+static void make_sdf(const unsigned char* cov, unsigned char* sdf, int w, int h, int spread)
+{
+	int x, y, dx, dy, xx, yy, inside, other, d2, best;
+	float d;
+	for (y = 0; y < h; ++y)
+	{
+		for (x = 0; x < w; ++x)
+		{
+			inside = cov[y*w + x] >= 128;
+			best = (spread+1)*(spread+1);
+			for (dy = -spread; dy <= spread; ++dy)
+			{
+				yy = y + dy;
+				for (dx = -spread; dx <= spread; ++dx)
+				{
+					d2 = dx*dx + dy*dy;
+					if (d2 >= best) continue;
+					xx = x + dx;
+					other = (xx < 0 || yy < 0 || xx >= w || yy >= h) ? 0 : cov[yy*w + xx] >= 128;
+					if (other != inside) best = d2;
+				}
+			}
+			d = sqrtf((float)best) - 0.5f;
+			if (d > spread) d = (float)spread;
+			if (!inside) d = -d;
+			d = 128.0f + d * 127.0f / spread;
+			sdf[y*w + x] = d < 0.0f ? 0 : d > 255.0f ? 255 : (unsigned char)d;
+		}
+	}
+}
+
 static struct ofx_sth_glyph* get_glyph(struct ofx_sth_stash* stash, struct ofx_sth_font* fnt, unsigned int codepoint, short isize)
 {
 	int i,g,advance,lsb,x0,y0,x1,y1,gw,gh;
@@ -411,6 +459,15 @@ static struct ofx_sth_glyph* get_glyph(struct ofx_sth_stash* stash, struct ofx_s
 	float size = isize/10.0f;
 	int rh;
 	struct ofx_sth_row* br = NULL;
+	int spread = 0;
+
+	// Distance field glyphs only exist at the reference size.
+	if (stash->sdfSize && fnt->type != BMFONT)
+	{
+		isize = stash->sdfSize;
+		size = isize/10.0f;
+		spread = stash->sdfSpread;
+	}
 
 	// Find code point and size.
 	h = hashint(codepoint) & (HASH_LUT_SIZE-1);
@@ -433,8 +490,8 @@ static struct ofx_sth_glyph* get_glyph(struct ofx_sth_stash* stash, struct ofx_s
 	ofx_stbtt_GetGlyphHMetrics(&fnt->font, g, &advance, &lsb);
 	ofx_stbtt_GetGlyphBitmapBox(&fnt->font, g, scale,scale, &x0,&y0,&x1,&y1);
 
-	gw = x1-x0 + stash->padding;
-	gh = y1-y0 + stash->padding;
+	gw = x1-x0 + stash->padding + 2*spread;
+	gh = y1-y0 + stash->padding + 2*spread;
 	
 	// Check if glyph is larger than maximum texture size
 	if (gw >= stash->tw || gh >= stash->th)
@@ -519,8 +576,8 @@ static struct ofx_sth_glyph* get_glyph(struct ofx_sth_stash* stash, struct ofx_s
 	glyph->x1 = glyph->x0+gw;
 	glyph->y1 = glyph->y0+gh;
 	glyph->xadv = scale * advance;
-	glyph->xoff = (float)x0;
-	glyph->yoff = (float)y0;
+	glyph->xoff = (float)(x0 - spread);
+	glyph->yoff = (float)(y0 - spread);
 	glyph->next = 0;
 
 	// Advance row location.
@@ -532,9 +589,23 @@ static struct ofx_sth_glyph* get_glyph(struct ofx_sth_stash* stash, struct ofx_s
 
 	// Rasterize
 	bmp = (unsigned char*)malloc(gw*gh);
-	if (bmp)
+	if (bmp && spread)
+	{
+		unsigned char* cov = (unsigned char*)calloc(gw*gh, 1);
+		if (cov)
+		{
+			ofx_stbtt_MakeGlyphBitmap(&fnt->font, cov + spread*gw + spread, gw - 2*spread, gh - 2*spread, gw, scale,scale, g);
+			make_sdf(cov, bmp, gw, gh, spread);
+			free(cov);
+		}
+		else memset(bmp, 0, gw*gh);
+	}
+	else if (bmp)
 	{
 		ofx_stbtt_MakeGlyphBitmap(&fnt->font, bmp, gw,gh,gw, scale,scale, g);
+	}
+	if (bmp)
+	{
 		// Update texture
 		glBindTexture(GL_TEXTURE_2D, texture->id);
 		glPixelStorei(GL_UNPACK_ALIGNMENT,1);
@@ -570,6 +641,21 @@ static int get_quad(struct ofx_sth_stash* stash, struct ofx_sth_font* fnt, struc
 	float scale = 1.0f ;
 
 	if (fnt->type == BMFONT) scale = isize/(glyph->size*10.0f);
+	else if (stash->sdfSize)
+	{
+		// scaled, and not snapped to pixels:
+		scale = isize/(float)stash->sdfSize;
+		q->x0 = *x + scale * glyph->xoff;
+		q->y0 = *y + scale * glyph->yoff;
+		q->x1 = q->x0 + scale * (glyph->x1 - glyph->x0);
+		q->y1 = q->y0 + scale * (glyph->y1 - glyph->y0);
+		q->s0 = (glyph->x0) * stash->itw;
+		q->t0 = (glyph->y0) * stash->ith;
+		q->s1 = (glyph->x1) * stash->itw;
+		q->t1 = (glyph->y1) * stash->ith;
+		*x += scale * glyph->xadv;
+		return 1;
+	}
 
 	rx = floorf(*x + scale * glyph->xoff);
 	//ry = floorf(*y - scale * glyph->yoff); //oriol flipped vertically to better match openFrameworks
@@ -757,6 +843,102 @@ void ofx_sth_draw_text(struct ofx_sth_stash* stash,
 	if (dx) *dx = x / dpiScale;
 }
 
+int ofx_sth_get_quads(struct ofx_sth_stash* stash,
+				   int idx, float size,
+				   float x, float y,
+				   const char* s, float* dx,
+				   struct ofx_sth_glyph_quad* quads, int maxquads)
+{
+	unsigned int codepoint;
+	struct ofx_sth_glyph* glyph = NULL;
+	unsigned int state = 0;
+	struct ofx_sth_quad q;
+	short isize = (short)(size*10.0f);
+	struct ofx_sth_font* fnt = NULL;
+	struct ofx_sth_glyph_quad* gq;
+	int n = 0;
+
+	if (stash == NULL) return 0;
+
+	fnt = stash->fonts;
+	while(fnt != NULL && fnt->idx != idx) fnt = fnt->next;
+	if (fnt == NULL) return 0;
+	if (fnt->type != BMFONT && !fnt->data) return 0;
+
+	int len = strlen(s);
+	float scale = ofx_stbtt_ScaleForPixelHeight(&fnt->font, size);
+	int c = 0;
+	float spacing = stash->charSpacing;
+	int doKerning = stash->doKerning;
+	int p = stash->padding;
+	float dpiScale = stash->dpiScale;
+	float tw = stash->padding / (float)stash->tw;
+
+	for (; *s && n < maxquads; ++s)
+	{
+		if (decutf8(&state, &codepoint, *(unsigned char*)s)) continue;
+		glyph = get_glyph(stash, fnt, codepoint, isize);
+		if (!glyph) continue;
+		if (!get_quad(stash, fnt, glyph, isize, &x, &y, &q)) continue;
+
+		int diff = 0;
+		if (c < len && doKerning > 0){
+			diff = ofx_stbtt_GetCodepointKernAdvance(&fnt->font, *(s), *(s+1));
+			x += diff * scale;
+		}
+		x += dpiScale * spacing;
+
+		gq = &quads[n++];
+		gq->texture = glyph->texture->id;
+		gq->x0 = q.x0 / dpiScale;
+		gq->y0 = q.y0 / dpiScale;
+		gq->x1 = (q.x1 - p) / dpiScale;
+		gq->y1 = (q.y1 - p) / dpiScale;
+		gq->s0 = q.s0;
+		gq->t0 = q.t0;
+		gq->s1 = q.s1 - tw;
+		gq->t1 = q.t1 - tw;
+		c++;
+	}
+
+	if (dx) *dx = x / dpiScale;
+	return n;
+}
+
+void ofx_sth_draw_verts(GLuint texture, const float* verts, int nverts)
+{
+	if (nverts <= 0) return;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glEnable(GL_TEXTURE_2D);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glVertexPointer(2, GL_FLOAT, VERT_STRIDE, verts);
+	glTexCoordPointer(2, GL_FLOAT, VERT_STRIDE, verts+2);
+	glDrawArrays(GL_TRIANGLES, 0, nverts);
+	glDisable(GL_TEXTURE_2D);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+}
+
+void ofx_sth_draw_colored_verts(GLuint texture, const float* verts, int nverts)
+{
+	const int stride = sizeof(float)*9;
+	if (nverts <= 0) return;
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glEnable(GL_TEXTURE_2D);
+	glEnableClientState(GL_VERTEX_ARRAY);
+	glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+	glEnableClientState(GL_COLOR_ARRAY);
+	glVertexPointer(3, GL_FLOAT, stride, verts);
+	glTexCoordPointer(2, GL_FLOAT, stride, verts+3);
+	glColorPointer(4, GL_FLOAT, stride, verts+5);
+	glDrawArrays(GL_TRIANGLES, 0, nverts);
+	glDisable(GL_TEXTURE_2D);
+	glDisableClientState(GL_VERTEX_ARRAY);
+	glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	glDisableClientState(GL_COLOR_ARRAY);
+}
+
 void ofx_sth_dim_text(struct ofx_sth_stash* stash,
 				  int idx, float size,
 				  const char* s,
@@ -799,6 +981,12 @@ void ofx_sth_dim_text(struct ofx_sth_stash* stash,
 		}
 		x += spacing;
 
+		if (stash->sdfSize && fnt->type != BMFONT)
+		{
+			// don't count the margins of the distance field
+			float m = stash->sdfSpread * isize / (float)stash->sdfSize;
+			q.x0 += m; q.y0 += m; q.x1 -= m; q.y1 -= m;
+		}
 		if (q.x0 < *minx) *minx = q.x0;
 		if (q.x1 > *maxx) *maxx = q.x1;
 		if (q.y1 > *miny) *miny = q.y1;		//oriol changed "<" direction bc its flipped to fit OF
@@ -37,13 +37,30 @@ struct ofx_sth_stash
 	int doKerning; //calc kerning on the fly and offset letters when drawing and / calcing box sizes
 	float charSpacing;
 	float dpiScale;
+	short sdfSize; // size (x10) of the distance field glyphs, drawn at any size; 0: one glyph per size
+	int sdfSpread; // distance (in pixels at sdfSize) represented around the edges of the distance field glyphs
+};
+
+
+// a laid out glyph: position (divided by dpiScale) and texture coordinates in its atlas.
+struct ofx_sth_glyph_quad
+{
+	GLuint texture;
+	float x0,y0,s0,t0;
+	float x1,y1,s1,t1;
 };
 
 
 struct ofx_sth_stash* ofx_sth_create(int cachew, int cacheh, int createMipmaps, int charPadding, float dpiScale);
 
+// glyphs are rasterised once at refSize into signed distance fields (128 at the edge, inside above),
+// to be drawn at any size with a shader; to be called before any glyph is created.
+void ofx_sth_set_sdf(struct ofx_sth_stash* stash, float refSize, int spread);
+
 int ofx_sth_add_font(struct ofx_sth_stash* stash, const char* path);
 int ofx_sth_add_font_from_memory(struct ofx_sth_stash* stash, unsigned char* buffer);
+// same, but the stash takes the ownership of the (malloc'ed) buffer
+int ofx_sth_add_font_from_owned_memory(struct ofx_sth_stash* stash, unsigned char* buffer);
 
 int  ofx_sth_add_bitmap_font(struct ofx_sth_stash* stash, int ascent, int descent, int line_gap);
 void ofx_sth_add_glyph(struct ofx_sth_stash* stash, int idx, GLuint id, const char* s,  /* @rlyeh: function does not return int */
@@ -57,6 +74,18 @@ void ofx_sth_draw_text(struct ofx_sth_stash* stash,
 				   int idx, float size,
 				   float x, float y, const char* string, float* dx);
 
+// lays out a string like ofx_sth_draw_text(), without drawing: returns the number of quads written.
+int ofx_sth_get_quads(struct ofx_sth_stash* stash,
+				   int idx, float size,
+				   float x, float y, const char* string, float* dx,
+				   struct ofx_sth_glyph_quad* quads, int maxquads);
+
+// draws triangles of (x, y, s, t) vertices with an atlas texture.
+void ofx_sth_draw_verts(GLuint texture, const float* verts, int nverts);
+
+// draws triangles of (x, y, z, s, t, r, g, b, a) vertices with an atlas texture.
+void ofx_sth_draw_colored_verts(GLuint texture, const float* verts, int nverts);
+
 void ofx_sth_dim_text(struct ofx_sth_stash* stash, int idx, float size, const char* string,
 				  float* minx, float* miny, float* maxx, float* maxy);
 
@@ -100,6 +100,63 @@ bool ofxFontStash::setup(string firstFontFile, float lineHeightPercent , int _te
 	return false;
 }
 
+unsigned char* ofxFontStash::loadFontFile(const string &fontFile){
+	string fontPath = ofToDataPath(fontFile);
+	FILE *fp = fopen(fontPath.c_str(), "rb");
+	if (!fp) return NULL;
+	fseek(fp, 0, SEEK_END);
+	long datasize = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	unsigned char *data = datasize > 0 ? (unsigned char*)malloc(datasize) : NULL;
+	if (data && fread(data, 1, datasize, fp) != (size_t)datasize){
+		free(data);
+		data = NULL;
+	}
+	fclose(fp);
+
+	ofx_stbtt_fontinfo info;
+	if (data && !ofx_stbtt_InitFont(&info, data, 0)){
+		free(data);
+		data = NULL;
+	}
+	return data;
+}
+
+bool ofxFontStash::setupFromMemory(unsigned char *fontData, float lineHeightPercent, int _texDimension){
+	if (stash != NULL){
+		ofLogError("ofxFontStash") << "Don't call setup() more than once!";
+		free(fontData);
+		return false;
+	}
+	dpiScale = 1.0f;
+	extraPadding = 0;
+	lineHeight = lineHeightPercent;
+	texDimension = ofNextPow2(_texDimension);
+	stash = ofx_sth_create(texDimension, texDimension, false, extraPadding, dpiScale);
+	if (stash == NULL){
+		ofLogError("ofxFontStash") << "Could not create stash for font data";
+		free(fontData);
+		return false;
+	}
+	stash->doKerning = 0; //kerning disabled by default
+	stash->charSpacing = 0.0; //spacing neutral by default
+	int fontId = ofx_sth_add_font_from_owned_memory(stash, fontData);
+	if (fontId <= 0){
+		ofLogError("ofxFontStash") << "Can't load font data!";
+		free(fontData);
+		return false;
+	}
+	fontIds.push_back(fontId);
+	return true;
+}
+
+void ofxFontStash::prewarm(const string &chars, float size){
+	if (stash == NULL || fontIds.empty() || chars.empty()) return;
+	// laying the glyphs out rasterises the missing ones:
+	vector<ofx_sth_glyph_quad> quads(chars.size());
+	ofx_sth_get_quads(stash, fontIds[0], size, 0, 0, chars.c_str(), NULL, &quads[0], quads.size());
+}
+
 void ofxFontStash::addFont(const std::string &fontFile)
 {
 	if (stash == NULL) {
@@ -574,6 +631,37 @@ ofRectangle ofxFontStash::drawMultiLines( vector<string> &splitLines, float size
 	return totalArea;
 }
 
+void ofxFontStash::layoutMultiLines( vector<string> &splitLines, float size, float maxW, int maxLines,
+									bool centered, int firstLine, vector<ofx_sth_glyph_quad> &quads,
+									vector<ofRectangle> &lineRects){
+	quads.clear();
+	lineRects.clear();
+	if (stash == NULL || fontIds.empty()) return;
+
+	int linesToDraw = MAX((int)splitLines.size() - firstLine, 0);
+	if (maxLines > 0 ){
+		linesToDraw = MIN(linesToDraw, maxLines);
+	}
+
+	for(int i = 0; i < linesToDraw; i++){
+		const string &line = splitLines[i + firstLine];
+		float yy = lineHeight * OFX_FONT_STASH_LINE_HEIGHT_MULT * size * i;
+		int lineWidth = getBBox(line, size, 0, 0).width;
+		float xOff = centered ? (maxW - lineWidth) / 2.0f : 0;
+		if(line != " ") lineRects.push_back(ofRectangle(xOff, yy, lineWidth, 0));
+
+		// a glyph takes at least one byte:
+		int first = quads.size();
+		quads.resize(first + line.size());
+		int n = ofx_sth_get_quads(stash, fontIds[0], size, 0, 0, line.c_str(), NULL, &quads[first], line.size());
+		quads.resize(first + n);
+		for(int q = first; q < first + n; q++){
+			quads[q].x0 += xOff; quads[q].x1 += xOff;
+			quads[q].y0 += yy; quads[q].y1 += yy;
+		}
+	}
+}
+
 
 ofVec2f ofxFontStash::drawMultiColumnFormatted(const string &_text, float size, float columnWidth, bool topLeftAlign, bool dryrun){
 
@@ -67,6 +67,16 @@ class ofxFontStash{
 				   );
 
 
+		//reads and checks a font file, without any GL call: can be called from any thread.
+		//returns a malloc'ed buffer to give to setupFromMemory(), or NULL.
+		static unsigned char* loadFontFile(const string &fontFile);
+
+		//like setup(), with the data returned by loadFontFile(), which is then owned by the stash
+		bool setupFromMemory(unsigned char *fontData, float lineHeightPercent = 1.0f, int textureDimension = 512);
+
+		//rasterises the glyphs of chars (utf8) at this size into the atlas, before they are drawn
+		void prewarm(const string &chars, float size);
+
 		//for multi-font; to use with drawMultiColumnFormatted  (wip)
 		void addFont(const std::string& fontFile);
 
@@ -137,6 +147,12 @@ class ofxFontStash{
 			return drawMultiLines(splitLines, size, x, y, maxW, numlines, dontDraw, maxLines, centered, firstLine, underHeight, underWidth, underY); 
 		}
 		
+		// lays out the lines as drawMultiLines() would draw them, into glyph quads to be drawn
+		// later with ofx_sth_draw_verts(); lineRects gets the (x, y, width) of each line to underline.
+		void layoutMultiLines( vector<string> &splitLines, float size, float maxW, int maxLines,
+											bool centered, int firstLine, vector<ofx_sth_glyph_quad> &quads,
+											vector<ofRectangle> &lineRects);
+
 		ofVec2f drawMultiColumnFormatted(const string &text, float size, float columnWidth, bool topLeftAlign = false, bool dryrun = false);
 
 
@@ -173,6 +189,11 @@ class ofxFontStash{
 
 		float getCharacterSpacing(){return stash->charSpacing;}
 		void setCharacterSpacing(float spacing){stash->charSpacing = spacing;}
+
+		//signed distance field glyphs, rasterised once at refSize (see ofx_sth_set_sdf()); call before drawing anything
+		void setSdf(float refSize, int spread){if(stash) ofx_sth_set_sdf(stash, refSize, spread);}
+		bool isSdf(){return stash && stash->sdfSize;}
+		int getSdfSpread(){return stash ? stash->sdfSpread : 0;}
     
         float stringWidth(const string& s);
         float stringHeight(const string& s);
@@ -23,6 +23,9 @@ EventDispatcher pofBase::dispatcher;
 bool pofBase::needBuild = false;
 ofEvent<ofEventArgs> pofBase::reloadTexturesEvent, pofBase::unloadTexturesEvent;
 ofEvent<ofEventArgs> pofBase::initFrameEvent;
+ofEvent<ofEventArgs> pofBase::flushBatchesEvent;
+ofEvent<ofEventArgs> pofBase::dequeueToPdEvent;
+bool pofBase::batchesPending = false;
 ofEvent<ofEventArgs> pofBase::rebuildEvent;
 deque<t_binbuf*> pofBase::toPdQueue;
 deque<std::vector<Any> > pofBase::toPdQueueVec;
@@ -97,6 +100,7 @@ void pofBase::tree_draw()
 	  binbuf_free(bb);
 	}
 	
+	if(!keepsBatches()) flushBatches();
 	draw();
 	
 	std::list<pofBase*>::iterator it = children.begin();
@@ -106,9 +110,18 @@ void pofBase::tree_draw()
 		it++;
 	}
 	
+	if(!keepsBatches()) flushBatches();
 	postdraw();
 }
 
+void pofBase::flushBatches()
+{
+	if(!batchesPending) return;
+	batchesPending = false;
+	ofEventArgs voidEventArgs;
+	ofNotifyEvent(flushBatchesEvent, voidEventArgs);
+}
+
 bool pofBase::tree_touchMoved(int x, int y, int id)
 {
 	std::list<pofBase*>::iterator it = touchChildren.end();
@@ -385,6 +398,7 @@ void pofBase::drawAll() {
 			pofBlend::currentSrcFactor = GL_SRC_ALPHA;
 			pofBlend::currentDestFactor = GL_ONE_MINUS_SRC_ALPHA;
 			if(pofWin::win) pofWin::win->tree_draw();
+			flushBatches();
 		}
 		treeMutex.unlockR();
 	}
@@ -462,6 +476,8 @@ void dequeueToPdtick(void* nul)
 	if(pofBase::pdProcessesTouchEvents) pofBase::dispatcher.popEvents();
 	while(pofBase::dequeueToPd());
 	while(pofBase::dequeueToPdVec());
+	ofEventArgs voidEventArgs;
+	ofNotifyEvent(pofBase::dequeueToPdEvent, voidEventArgs);
 
 #ifdef BUILD_BY_PD
 	if(pofBase::needBuild) {
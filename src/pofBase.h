@@ -39,6 +39,8 @@ class pofBase {
 		virtual int isBlockingDraw() {return -1;} // -1=never 0=no 1=yes
 		virtual void postdraw() {} // called after objects bellow have been drawn
 		virtual void message(int argc, t_atom *argv) {} // process incoming message from Pd side
+		virtual bool getMesh(ofMesh &m) {return false;} // geometry drawn by draw(), for instancing (pofinstances)
+		virtual bool keepsBatches() {return false;} // draw() and postdraw() only change the matrix or the color (or batch): don't flush the batches
 		
 		virtual bool computeTouch(int &x, int &y) {return false;}
 		virtual bool isTouchable() {return false;}
@@ -96,6 +98,9 @@ class pofBase {
 		static ofEvent<ofEventArgs> reloadTexturesEvent, unloadTexturesEvent;
 		static ofEvent<ofEventArgs> initFrameEvent;
 		static ofEvent<ofEventArgs> rebuildEvent;
+		static ofEvent<ofEventArgs> flushBatchesEvent;
+		static ofEvent<ofEventArgs> dequeueToPdEvent; // notified by the Pd thread after the toPd queues are drained
+		static bool batchesPending;
 		static deque<t_binbuf*> toPdQueue;
 		static deque<std::vector<Any> > toPdQueueVec;
 		static t_clock *queueClock;
@@ -112,6 +117,7 @@ class pofBase {
 		static void buildAll();
 		static void updateAll();
 		static void drawAll();
+		static void flushBatches(); // draw what has been batched so far (see pofTexts)
 
 		static RWmutex treeMutex;
 		static EventDispatcher dispatcher;
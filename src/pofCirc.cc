@@ -44,3 +44,13 @@ void pofCirc::draw()
     if(height == 0) ofEllipse(0, 0, width, width);
 	else ofEllipse(0, 0, width, height);
 }
+
+bool pofCirc::getMesh(ofMesh &m)
+{
+	ofPath path;
+
+	path.setCircleResolution(resolution ? resolution : ofGetStyle().circleResolution);
+	path.ellipse(0, 0, width, (height == 0) ? width : height);
+	m = path.getTessellation();
+	return true;
+}
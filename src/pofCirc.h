@@ -15,6 +15,7 @@ class pofCirc: public pofBase {
 			pofBase(Class),width(w), height(h), resolution(res) {}
 
 		virtual void draw();
+		virtual bool getMesh(ofMesh &m);
 		static void setup(void);
 		
 		float width, height;
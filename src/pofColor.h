@@ -16,6 +16,7 @@ class pofColor: public pofBase {
 
 		virtual void draw();
 		virtual void postdraw();
+		virtual bool keepsBatches() {return true;}
 		static void setup(void);
 		
 		float r, g, b, a;
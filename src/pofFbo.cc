@@ -214,7 +214,10 @@ void pofFbo::postdraw()
 void pofFbo::tree_draw()
 {
 	if(update) pofBase::tree_draw();
-	else sfbo->draw(width, height);
+	else {
+		flushBatches();
+		sfbo->draw(width, height);
+	}
 }
 
 bool pofFbo::tree_touchDown(int x, int y, int id)
@@ -8,6 +8,7 @@
 t_class *poffont_class;
 
 std::map<t_symbol*,pofFont*> pofFont::fonts;
+int pofFont::generations = 0;
 
 void *poffont_new(t_symbol *font, t_symbol *fontfile, t_float size)
 {
@@ -44,8 +45,132 @@ void pofFont::update()
 		if(!file) return;
 		offont.loadFont(file->s_name,size, true, true);
 		//offont.setEncoding(OF_ENCODING_UTF8);
+		metrics.clear();
+		baseMetrics.reset();
+		kerning.reset();
+		kerningTable.reset();
+		kerningRow = 0;
+		generation = ++generations;
+		if(offont.isLoaded()) startKerning();
 	}
 	need_reload = false;
+	if(kerningRow) measureKerning();
+}
+
+static string latin1ToUTF8(unsigned int c)
+{
+	string s;
+	if(c < 0x80) s.push_back(c);
+	else {
+		s.push_back(0xC0 | (c >> 6));
+		s.push_back(0x80 | (c & 0x3F));
+	}
+	return s;
+}
+
+static float rightOf(const ofRectangle &r) { return r.x + r.width; }
+
+pofFontMetrics *pofFont::measure(float spaceSize, float letterSpacing)
+{
+	pofFontMetrics *m = new pofFontMetrics();
+	m->spaceSize = spaceSize;
+	m->letterSpacing = letterSpacing;
+	offont.setSpaceSize(spaceSize);
+	offont.setLetterSpacing(letterSpacing);
+
+	// the advance of c is measured as the shift it gives to a following '|':
+	float refRight = rightOf(offont.getStringBoundingBox("|", 0, 0));
+	for(unsigned int c = 0; c < 256; c++) {
+		m->advance[c] = m->left[c] = m->right[c] = 0;
+		if(c < 32 || (c >= 127 && c < 160)) continue; // control characters
+		string s = latin1ToUTF8(c);
+		ofRectangle bound = offont.getStringBoundingBox(s, 0, 0);
+		m->left[c] = bound.x;
+		m->right[c] = rightOf(bound);
+		m->advance[c] = rightOf(offont.getStringBoundingBox(s + "|", 0, 0)) - refRight;
+	}
+	return m;
+}
+
+// The extents of a glyph don't depend on the spacings, and the advances of all the glyphs but
+// the space are scaled by the letter spacing: a few probes check it, then only the space is measured.
+pofFontMetrics *pofFont::derive(float spaceSize, float letterSpacing)
+{
+	offont.setSpaceSize(spaceSize);
+	offont.setLetterSpacing(letterSpacing);
+	float refRight = rightOf(offont.getStringBoundingBox("|", 0, 0));
+	const char *probes = "MiW0.";
+	for(const char *p = probes; *p; p++) {
+		unsigned char c = *p;
+		float advance = rightOf(offont.getStringBoundingBox(string(1, c) + "|", 0, 0)) - refRight;
+		if(fabs(advance - baseMetrics->advance[c] * letterSpacing) > 0.01) return NULL;
+	}
+
+	pofFontMetrics *m = new pofFontMetrics(*baseMetrics);
+	m->spaceSize = spaceSize;
+	m->letterSpacing = letterSpacing;
+	for(unsigned int c = 0; c < 256; c++) m->advance[c] *= letterSpacing;
+	ofRectangle bound = offont.getStringBoundingBox(" ", 0, 0);
+	m->left[' '] = bound.x;
+	m->right[' '] = rightOf(bound);
+	m->advance[' '] = rightOf(offont.getStringBoundingBox(" |", 0, 0)) - refRight;
+	return m;
+}
+
+pofFontMetricsPtr pofFont::getMetrics(float spaceSize, float letterSpacing)
+{
+	for(std::list<pofFontMetricsPtr>::iterator it = metrics.begin(); it != metrics.end(); it++) {
+		if((*it)->spaceSize != spaceSize || (*it)->letterSpacing != letterSpacing) continue;
+		if(it != metrics.begin()) metrics.splice(metrics.begin(), metrics, it);
+		return metrics.front();
+	}
+
+	if(!baseMetrics) baseMetrics = pofFontMetricsPtr(measure(1, 1));
+	pofFontMetrics *m = derive(spaceSize, letterSpacing);
+	if(!m) m = measure(spaceSize, letterSpacing);
+	m->kerning = kerning;
+	metrics.push_front(pofFontMetricsPtr(m));
+	if(metrics.size() > METRICS_CACHE) metrics.pop_back();
+	return metrics.front();
+}
+
+// kerning between ASCII letters and punctuation, if the font has some; it doesn't depend on the spacings.
+void pofFont::startKerning()
+{
+	const char *probes[] = {"AV", "To", "Ty", "Wa", "LT", "P."};
+	if(!baseMetrics) baseMetrics = pofFontMetricsPtr(measure(1, 1));
+	offont.setSpaceSize(1);
+	offont.setLetterSpacing(1);
+	for(unsigned int i = 0; i < sizeof(probes) / sizeof(probes[0]); i++) {
+		unsigned char a = probes[i][0], b = probes[i][1];
+		float k = rightOf(offont.getStringBoundingBox(probes[i], 0, 0)) - baseMetrics->advance[a] - baseMetrics->right[b];
+		if(fabs(k) > 0.01) {
+			kerningTable.reset(new std::map<unsigned int, float>());
+			kerningRow = 33;
+			return;
+		}
+	}
+}
+
+void pofFont::measureKerning()
+{
+	unsigned int end = MIN(kerningRow + KERNING_ROWS, 127);
+	offont.setSpaceSize(1);
+	offont.setLetterSpacing(1);
+	for(unsigned int a = kerningRow; a < end; a++) for(unsigned int b = 33; b < 127; b++) {
+		char pair[3] = {(char)a, (char)b, 0};
+		float k = rightOf(offont.getStringBoundingBox(pair, 0, 0)) - baseMetrics->advance[a] - baseMetrics->right[b];
+		if(fabs(k) > 0.01) (*kerningTable)[a << 8 | b] = k;
+	}
+	kerningRow = end;
+	if(kerningRow < 127) return;
+
+	// done: the texts are laid out again with the kerning.
+	kerning = kerningTable;
+	kerningTable.reset();
+	kerningRow = 0;
+	metrics.clear();
+	generation = ++generations;
 }
 
 
@@ -61,6 +186,15 @@ void pofFont::setup(void)
 
 }
 
+pofFont* pofFont::getPofFont(t_symbol* font)
+{
+	std::map<t_symbol*,pofFont*>::iterator it;
+	
+	it = fonts.find(font);
+	if( (it != fonts.end()) && (it->second->offont.isLoaded()) ) return it->second;
+	else return NULL;
+}
+
 ofTrueTypeFont* pofFont::getFont(t_symbol* font)
 {
 	std::map<t_symbol*,pofFont*>::iterator it;
@@ -9,10 +9,28 @@
 
 class pofFont;
 
+// (first << 8 | second) -> kerning, between ASCII letters and punctuation ; only the non-null ones
+typedef std::shared_ptr<const std::map<unsigned int, float> > pofFontKerningPtr;
+
+// Advances and ink extents (from the pen position) of the Latin-1 glyphs of a font, measured
+// with given spacings on the GL thread; used to lay texts out from any thread.
+struct pofFontMetrics {
+	float spaceSize, letterSpacing;
+	float advance[256], left[256], right[256];
+	pofFontKerningPtr kerning; // null: none (or not measured yet)
+
+	float getKerning(unsigned int first, unsigned int second) const {
+		if(!kerning) return 0;
+		std::map<unsigned int, float>::const_iterator it = kerning->find(first << 8 | second);
+		return it == kerning->end() ? 0 : it->second;
+	}
+};
+typedef std::shared_ptr<const pofFontMetrics> pofFontMetricsPtr;
+
 class pofFont: public pofBase {
 	public:
 		pofFont(t_class *Class, t_symbol *_font, t_symbol *_fontfile, float _size):
-		 pofBase(Class),font(_font),fontfile(_fontfile),size(_size),need_reload(true)
+		 pofBase(Class),font(_font),fontfile(_fontfile),size(_size),need_reload(true),generation(0),kerningRow(0)
 		{
 			fonts[font]=this;
 		}
@@ -30,9 +48,26 @@ class pofFont: public pofBase {
 		float size;
 		bool need_reload;
 		t_canvas *pdcanvas;
+		int generation; // changes each time the font is loaded
+
+		enum { METRICS_CACHE = 4, KERNING_ROWS = 8 }; // metrics kept ; kerning rows measured per frame
+
+		// GL thread:
+		pofFontMetricsPtr getMetrics(float spaceSize, float letterSpacing);
+		std::list<pofFontMetricsPtr> metrics; // the last ones used, most recent first
+		pofFontMetricsPtr baseMetrics; // with the default spacings (1, 1)
+		pofFontMetrics *measure(float spaceSize, float letterSpacing);
+		pofFontMetrics *derive(float spaceSize, float letterSpacing); // from baseMetrics (NULL if not possible)
+		pofFontKerningPtr kerning;
+		std::shared_ptr<std::map<unsigned int, float> > kerningTable; // being measured
+		unsigned int kerningRow; // next row of kerningTable (0: none)
+		void startKerning();
+		void measureKerning(); // a few rows per frame
 		
 	static std::map<t_symbol*,pofFont*> fonts;
+	static int generations;
 	static ofTrueTypeFont* getFont(t_symbol* font);
+	static pofFont* getPofFont(t_symbol* font);
 };
 
 
@@ -9,6 +9,116 @@ t_class *poffonts_class;
 
 std::map<t_symbol*, pofFonts*> pofFonts::fonts;
 std::list<ofxFontStash*> pofFonts::offontsToDelete;
+int pofFonts::generations = 0;
+ofShader pofFonts::sdfShader;
+int pofFonts::sdfShaderState = 0;
+
+static const char *sdfVertexShader =
+	"#version 120\n"
+	"void main()\n"
+	"{\n"
+	"	gl_TexCoord[0] = gl_MultiTexCoord0;\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+	"	gl_FrontColor = gl_Color;\n"
+	"}\n";
+
+// The atlas holds the distance to the glyph edges (in pixels at the reference size, 128 at the edge);
+// the glyph, its outline and its glow are composited from the inside out.
+static const char *sdfFragmentShader =
+	"#version 120\n"
+	"uniform sampler2D atlas;\n"
+	"uniform float spread, outlineWidth, glowWidth;\n"
+	"uniform vec4 outlineColor, glowColor;\n"
+	"vec4 over(vec4 top, vec4 bottom)\n"
+	"{\n"
+	"	float a = top.a + bottom.a * (1.0 - top.a);\n"
+	"	return vec4((top.rgb * top.a + bottom.rgb * bottom.a * (1.0 - top.a)) / max(a, 0.0001), a);\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	float d = (texture2D(atlas, gl_TexCoord[0].xy).a * 255.0 - 128.0) / 127.0 * spread;\n"
+	"	float w = max(fwidth(d), 0.0001);\n"
+	"	float fill = clamp(d / w + 0.5, 0.0, 1.0);\n"
+	"	float outline = clamp((d + outlineWidth) / w + 0.5, 0.0, 1.0) - fill;\n"
+	"	float glow = glowWidth > 0.0 ? clamp(1.0 + d / glowWidth, 0.0, 1.0) : 0.0;\n"
+	"	vec4 c = vec4(glowColor.rgb, glowColor.a * glow * glow);\n"
+	"	c = over(vec4(outlineColor.rgb, outlineColor.a * outline), c);\n"
+	"	c = over(vec4(gl_Color.rgb, fill), c);\n"
+	"	c.a *= gl_Color.a;\n"
+	"	if(c.a <= 0.0) discard;\n"
+	"	gl_FragColor = c;\n"
+	"}\n";
+
+// A font file to be read by the loader thread.
+struct pofFontFile {
+	string path;
+	unsigned char *data; // given to the ofxFontStash when loaded (NULL if the file couldn't be read)
+	bool loaded;
+	bool abandoned; // the poffonts has gone, or wants another file: the loader deletes it
+
+	pofFontFile(const string &p) : path(p), data(NULL), loaded(false), abandoned(false) {}
+};
+
+class pofFontsLoader: public ofThread {
+	public :
+	deque<pofFontFile*> filesToLoad;
+
+	void threadedFunction() {
+		while(isThreadRunning()) {
+			pofFontFile *file = NULL;
+			lock();
+			if(filesToLoad.size()) {
+				file = filesToLoad.front();
+				filesToLoad.pop_front();
+				if(file->abandoned) {
+					delete file;
+					file = NULL;
+				}
+			}
+			unlock();
+			if(!file) {
+				ofSleepMillis(5);
+				continue;
+			}
+			unsigned char *data = ofxFontStash::loadFontFile(file->path);
+			lock();
+			if(file->abandoned) {
+				if(data) free(data);
+				delete file;
+			} else {
+				file->data = data;
+				file->loaded = true;
+			}
+			unlock();
+		}
+	}
+
+	pofFontFile *load(const string &path) {
+		pofFontFile *file = new pofFontFile(path);
+		lock();
+		filesToLoad.push_back(file);
+		unlock();
+		return file;
+	}
+
+	bool isLoaded(pofFontFile *file) {
+		lock();
+		bool loaded = file->loaded;
+		unlock();
+		return loaded;
+	}
+} *fontsLoader = NULL;
+
+void pofFonts::abandon(pofFontFile *file)
+{
+	fontsLoader->lock();
+	if(file->loaded) {
+		if(file->data) free(file->data);
+		delete file;
+	}
+	else file->abandoned = true;
+	fontsLoader->unlock();
+}
 
 void *poffonts_new(t_symbol *font, t_symbol *fontfile, float scale)
 {
@@ -46,6 +156,62 @@ void poffonts_scale(void *x, t_float scale)
 	px->scale = scale;
 }
 
+void poffonts_prewarm(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofFonts* px= (pofFonts*)(((PdObject*)x)->parent);
+	vector<float> sizes;
+	std::ostringstream chars;
+	
+	while(argc && argv->a_type == A_FLOAT) {
+		if(atom_getfloat(argv) >= 1) sizes.push_back(atom_getfloat(argv));
+		argc--; argv++;
+	}
+	while(argc) {
+		if(argv->a_type == A_SYMBOL) chars << atom_getsymbol(argv)->s_name;
+		else if(argv->a_type == A_FLOAT) chars << atom_getfloat(argv);
+		argc--; argv++;
+	}
+	if(chars.str().empty()) for(char c = ' '; c <= '~'; c++) chars << c;
+	
+	px->prewarmMutex.lock();
+	for(unsigned int i = 0; i < sizes.size(); i++) {
+		pofFonts::Prewarm p;
+		p.chars = chars.str();
+		p.size = sizes[i];
+		px->prewarms.push_back(p);
+	}
+	px->prewarmMutex.unlock();
+}
+
+void poffonts_sdf(void *x, t_float size, t_float spread)
+{
+	pofFonts* px= (pofFonts*)(((PdObject*)x)->parent);
+	
+	if(size < 0) size = 0;
+	if(spread <= 0) spread = size / 8 + 1;
+	px->sdfSize = size;
+	px->sdfSpread = spread;
+	px->need_reload = true;
+}
+
+void poffonts_outline(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofFonts* px= (pofFonts*)(((PdObject*)x)->parent);
+	ofFloatColor color(0, 0, 0, 1);
+	
+	if(argc > 1) color.r = atom_getfloat(&argv[1]);
+	if(argc > 2) color.g = atom_getfloat(&argv[2]);
+	if(argc > 3) color.b = atom_getfloat(&argv[3]);
+	if(argc > 4) color.a = atom_getfloat(&argv[4]);
+	if(s == gensym("glow")) {
+		px->glowWidth = argc ? atom_getfloat(argv) : 0;
+		px->glowColor = color;
+	} else {
+		px->outlineWidth = argc ? atom_getfloat(argv) : 0;
+		px->outlineColor = color;
+	}
+}
+
 void pofFonts::update()
 {
 	if(need_reload) {
@@ -62,15 +228,42 @@ void pofFonts::update()
 				  2.0f					//dpi scaleup, render textures @2x the reso
 				  );					//lower res mipmaps wil bleed into each other*/
 
+		if(loading) abandon(loading);
+		loading = fontsLoader->load(file->s_name);
+		need_reload = false;
+	}
 
-		//offont.clear();
-		if(offont) delete offont;
-		offont = new ofxFontStash();
-		offont->setup(file->s_name, //font file, ttf only
-				  1.0					//lineheight percent
-				  );					//lower res mipmaps wil bleed into each other*/
+	if(loading && fontsLoader->isLoaded(loading)) {
+		unsigned char *data = loading->data;
+		string path = loading->path;
+		delete loading;
+		loading = NULL;
+
+		ofxFontStash *newfont = new ofxFontStash();
+		if(data && newfont->setupFromMemory(data, 1.0 /*lineheight percent*/)) {
+			if(sdfSize > 0) newfont->setSdf(sdfSize, sdfSpread);
+			//offont.clear();
+			if(offont) delete offont;
+			offont = newfont;
+			generation = ++generations;
+			prewarmDone = 0;
+		} else {
+			ofLogError("poffonts") << "can't load font " << path;
+			delete newfont;
+		}
+	}
+
+	if(offont) {
+		Prewarm p;
+		bool doPrewarm = false;
+		prewarmMutex.lock();
+		if(prewarmDone < prewarms.size()) {
+			p = prewarms[prewarmDone++];
+			doPrewarm = true;
+		}
+		prewarmMutex.unlock();
+		if(doPrewarm) offont->prewarm(p.chars, p.size * scale);
 	}
-	need_reload = false;
 }
 
 void pofFonts::reloadTexture(ofEventArgs & args){
@@ -81,6 +274,43 @@ void pofFonts::unloadTexture(ofEventArgs & args){
 	//offont.clear();
 	if(offont) delete offont;
 	offont = NULL;
+	generation = ++generations;
+}
+
+bool pofFonts::beginSdf()
+{
+#ifndef TARGET_OPENGLES
+	if(sdfShaderState == 0) {
+		sdfShaderState = -1;
+		if(!ofIsGLProgrammableRenderer()
+			&& sdfShader.setupShaderFromSource(GL_VERTEX_SHADER, sdfVertexShader)
+			&& sdfShader.setupShaderFromSource(GL_FRAGMENT_SHADER, sdfFragmentShader)
+			&& sdfShader.linkProgram()) sdfShaderState = 1;
+	}
+#else
+	sdfShaderState = -1;
+#endif
+	if(sdfShaderState > 0) {
+		sdfShader.begin();
+		sdfShader.setUniform1i("atlas", 0);
+		sdfShader.setUniform1f("spread", offont->getSdfSpread());
+		sdfShader.setUniform1f("outlineWidth", MIN(outlineWidth, offont->getSdfSpread()));
+		sdfShader.setUniform4f("outlineColor", outlineColor.r, outlineColor.g, outlineColor.b, outlineColor.a);
+		sdfShader.setUniform1f("glowWidth", MIN(glowWidth, offont->getSdfSpread()));
+		sdfShader.setUniform4f("glowColor", glowColor.r, glowColor.g, glowColor.b, glowColor.a);
+		return true;
+	}
+	// no outline nor glow, and aliased edges. The test applies to the final alpha:
+	// the caller lowers the threshold for the texts which aren't opaque.
+	glEnable(GL_ALPHA_TEST);
+	glAlphaFunc(GL_GEQUAL, 0.5);
+	return false;
+}
+
+void pofFonts::endSdf()
+{
+	if(sdfShaderState > 0) sdfShader.end();
+	else glDisable(GL_ALPHA_TEST);
 }
 
 //--------- static : ------------
@@ -93,7 +323,14 @@ void pofFonts::setup(void)
 	POF_SETUP(poffonts_class);
 	class_addmethod(poffonts_class, (t_method)poffonts_set, gensym("set"), A_SYMBOL, A_NULL);
 	class_addmethod(poffonts_class, (t_method)poffonts_scale, gensym("scale"), A_FLOAT, A_NULL);
+	class_addmethod(poffonts_class, (t_method)poffonts_prewarm, gensym("prewarm"), A_GIMME, A_NULL);
+	class_addmethod(poffonts_class, (t_method)poffonts_sdf, gensym("sdf"), A_DEFFLOAT, A_DEFFLOAT, A_NULL);
+	class_addmethod(poffonts_class, (t_method)poffonts_outline, gensym("outline"), A_GIMME, A_NULL);
+	class_addmethod(poffonts_class, (t_method)poffonts_outline, gensym("glow"), A_GIMME, A_NULL);
 	ofAddListener(pofBase::initFrameEvent, &pofFonts::initFrame);
+
+	fontsLoader = new pofFontsLoader;
+	fontsLoader->startThread(true);
 }
 
 pofFonts* pofFonts::getFont(t_symbol* font)
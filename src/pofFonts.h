@@ -7,23 +7,29 @@
 
 #include "pofBase.h"
 #include "ofxFontStash.h"
+#include "RWmutex.h"
 
 class pofFonts;
+struct pofFontFile;
 
 class pofFonts: public pofBase {
 	public:
 		pofFonts(t_class *Class, t_symbol *_font, t_symbol *_fontfile):
-		 pofBase(Class),offont(NULL),font(_font),fontfile(_fontfile),need_reload(true), scale(1.0)
+		 pofBase(Class),offont(NULL),font(_font),fontfile(_fontfile),need_reload(true), scale(1.0), generation(0),
+		 loading(NULL), prewarmDone(0), sdfSize(0), sdfSpread(0), outlineWidth(0), glowWidth(0)
 		{
 			fonts[font]=this;
 			ofAddListener(pofBase::reloadTexturesEvent, this, &pofFonts::reloadTexture);
 			ofAddListener(pofBase::unloadTexturesEvent, this, &pofFonts::unloadTexture);
 		}
 		~pofFonts() { 
+			treeMutex.lockW();
 			fonts.erase(font);
 			if(offont) {
 				offontsToDelete.push_back(offont);
 			}
+			if(loading) abandon(loading);
+			treeMutex.unlockW();
 			ofRemoveListener(pofBase::reloadTexturesEvent, this, &pofFonts::reloadTexture);
 			ofRemoveListener(pofBase::unloadTexturesEvent, this, &pofFonts::unloadTexture);
 		}
@@ -40,6 +46,32 @@ class pofFonts: public pofBase {
 		bool need_reload;
 		t_canvas *pdcanvas;
 		float scale;
+		int generation; // changes each time offont is (re)created or deleted
+
+		// the font file is read by a loader thread; the current offont is kept until the new one is ready.
+		pofFontFile *loading;
+		static void abandon(pofFontFile *file);
+
+		// glyphs to rasterise before they are drawn, one size per frame;
+		// they are kept to be rasterised again when the font is reloaded.
+		struct Prewarm {
+			string chars;
+			float size;
+		};
+		vector<Prewarm> prewarms;
+		unsigned int prewarmDone; // in the current offont
+		ofMutex prewarmMutex;
+
+		// signed distance field mode: the glyphs are rasterised once at sdfSize, and drawn at any
+		// size by a shader, with an optional outline and glow (widths in pixels at sdfSize).
+		float sdfSize; // 0: normal glyphs
+		int sdfSpread;
+		float outlineWidth, glowWidth;
+		ofFloatColor outlineColor, glowColor;
+		bool beginSdf(); // GL thread: to draw glyphs of this font; false: drawn with the alpha test (no shader)
+		void endSdf();
+		static ofShader sdfShader;
+		static int sdfShaderState; // 0: not loaded, 1: ready, -1: unavailable (alpha test instead)
 
 		static void setup(void);
 		static pofFonts* getFont(t_symbol* font);
@@ -52,6 +84,7 @@ class pofFonts: public pofBase {
 
 		static std::map<t_symbol*, pofFonts*> fonts;
 		static std::list<ofxFontStash*> offontsToDelete;
+		static int generations;
 
 };
 
@@ -5,12 +5,23 @@
  */
 #include "pofImage.h"
 #include "pofFbo.h"
+#include <curl/curl.h>
+#include <Poco/SHA1Engine.h>
+#include "FreeImage.h"
+#include <atomic>
+
+#define HTTP_LOADERS 4 // number of concurrent connections for online images
 
 class pofIm;
 
+std::list<ofImage*> imsToDelete;
+
 class pofImLoader: public ofThread {
 	public :
     deque<pofIm*> imagesToLoad;
+    pofImLoader *source; // the loader owning the queue this thread takes its images from
+
+	pofImLoader(pofImLoader *src = NULL) : source(src ? src : this) {}
 
 	void threadedFunction();
     
@@ -20,6 +31,17 @@ class pofImLoader: public ofThread {
     	unlock();
     }
     
+    pofIm *deQueue() {
+    	pofIm *im = NULL;
+    	lock();
+    	if(imagesToLoad.size()) {
+    		im = imagesToLoad.front();
+    		imagesToLoad.pop_front();
+    	}
+    	unlock();
+    	return im;
+    }
+    
     unsigned int getLen() {
     	int l;
     	lock();
@@ -29,39 +51,309 @@ class pofImLoader: public ofThread {
     }
     	
 } *imLoader = NULL, *imLoaderHTTP = NULL; // two loader tasks : one for online resources, one for on disk ones.
-    
+std::vector<pofImLoader*> imLoaderHTTPHelpers; // additional threads sharing imLoaderHTTP's queue
 
-std::list<ofImage*> imsToDelete;
+//------------------------------------------//
+// On-disk cache for online images.
+// Downloaded files are stored once by content hash ("<sha1>.data"); each URL has a small
+// "<sha1(url)>.meta" file holding its HTTP validators (ETag, Last-Modified) and content hash,
+// so the next request is a conditional one. If the network fails, the cached copy is used.
+
+class pofImHTTPCache {
+	static string dir;  // empty = cache disabled
+	static std::atomic<bool> offline; // never hit the network when a cached copy exists
+	static std::atomic<int> tmpCount;
+	static ofMutex mutex;
+
+	struct Meta {
+		string etag, lastModified, hash;
+	};
+
+	static string sha1(const char *data, size_t len) {
+		Poco::SHA1Engine engine;
+		engine.update(data, len);
+		return Poco::DigestEngine::digestToHex(engine.digest());
+	}
+
+	static string dataPath(const string &cacheDir, const string &hash) {
+		return ofFilePath::join(cacheDir, hash + ".data");
+	}
+
+	static bool readMeta(const string &cacheDir, const string &path, Meta &meta) {
+		if(!ofFile(path).exists()) return false;
+		ofBuffer buf = ofBufferFromFile(path);
+		vector<string> lines = ofSplitString(buf.getText(), "\n");
+		if(lines.size() < 3) return false;
+		meta.etag = lines[0];
+		meta.lastModified = lines[1];
+		meta.hash = lines[2];
+		return meta.hash.size() && ofFile(dataPath(cacheDir, meta.hash)).exists();
+	}
+
+	// unique, as several loader threads may write the same file at once:
+	static string tmpPath(const string &path) {
+		return path + "." + ofToString(ofGetSystemTimeMicros()) + "-" + ofToString(tmpCount++) + ".tmp";
+	}
+
+	static void writeMeta(const string &path, const Meta &meta) {
+		ofBuffer buf;
+		string tmp = tmpPath(path);
+		buf.set(meta.etag + "\n" + meta.lastModified + "\n" + meta.hash + "\n");
+		ofBufferToFile(tmp, buf);
+		ofFile::moveFromTo(tmp, path, false, true);
+	}
+
+	static size_t body_cb(void *buffer, size_t size, size_t nmemb, void *userdata) {
+		((ofBuffer*)userdata)->append((const char*)buffer, size * nmemb);
+		return size * nmemb;
+	}
+
+	static size_t header_cb(char *buffer, size_t size, size_t nitems, void *userdata) {
+		Meta *meta = (Meta*)userdata;
+		string line(buffer, size * nitems);
+		size_t colon = line.find(':');
+		if(colon != string::npos) {
+			string key = ofToLower(line.substr(0, colon));
+			string value = line.substr(colon + 1);
+			size_t first = value.find_first_not_of(" \t\r\n");
+			size_t last = value.find_last_not_of(" \t\r\n");
+			value = (first == string::npos) ? "" : value.substr(first, last - first + 1);
+			if(key == "etag") meta->etag = value;
+			else if(key == "last-modified") meta->lastModified = value;
+		}
+		return size * nitems;
+	}
+
+	public:
+
+	static void setDir(const string &d) {
+		mutex.lock();
+		dir = d;
+		if(dir.size()) ofDirectory::createDirectory(dir, false, true);
+		mutex.unlock();
+	}
+
+	static void setOffline(bool o) {
+		offline = o;
+	}
+
+	static bool enabled() {
+		bool e;
+		mutex.lock();
+		e = (dir.size() != 0);
+		mutex.unlock();
+		return e;
+	}
+
+	// Returns the path of a local copy of url, downloading or revalidating it if needed;
+	// returns an empty string if the cache is disabled or if no copy could be obtained.
+	static string fetch(const string &url) {
+		string cacheDir;
+		mutex.lock();
+		cacheDir = dir;
+		mutex.unlock();
+		if(cacheDir.empty()) return "";
+
+		string metaPath = ofFilePath::join(cacheDir, sha1(url.c_str(), url.size()) + ".meta");
+		Meta cached, received;
+		bool hasCached = readMeta(cacheDir, metaPath, cached);
+
+		if(hasCached && offline) return dataPath(cacheDir, cached.hash);
+
+		CURL *curl = curl_easy_init();
+		if(!curl) return hasCached ? dataPath(cacheDir, cached.hash) : "";
+
+		struct curl_slist *headers = NULL;
+		if(hasCached) {
+			if(cached.etag.size()) headers = curl_slist_append(headers, ("If-None-Match: " + cached.etag).c_str());
+			if(cached.lastModified.size()) headers = curl_slist_append(headers, ("If-Modified-Since: " + cached.lastModified).c_str());
+		}
+
+		ofBuffer body;
+		curl_easy_setopt(curl, CURLOPT_URL, url.c_str());
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYPEER, 0);
+		curl_easy_setopt(curl, CURLOPT_SSL_VERIFYHOST, 0);
+		curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+		curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+		curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT, 10L);
+		// give up on a server stalling mid-transfer, instead of holding a loader thread forever:
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_LIMIT, 1L);
+		curl_easy_setopt(curl, CURLOPT_LOW_SPEED_TIME, 30L);
+		curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+		curl_easy_setopt(curl, CURLOPT_WRITEDATA, &body);
+		curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, body_cb);
+		curl_easy_setopt(curl, CURLOPT_HEADERDATA, &received);
+		curl_easy_setopt(curl, CURLOPT_HEADERFUNCTION, header_cb);
+
+		CURLcode err = curl_easy_perform(curl);
+		long status = 0;
+		if(err == CURLE_OK) curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &status);
+		curl_slist_free_all(headers);
+		curl_easy_cleanup(curl);
+
+		if(status == 304 && hasCached) return dataPath(cacheDir, cached.hash);
+
+		if(status == 200 && body.size()) {
+			received.hash = sha1(body.getData(), body.size());
+			string path = dataPath(cacheDir, received.hash);
+			if(!ofFile(path).exists()) {
+				string tmp = tmpPath(path);
+				ofBufferToFile(tmp, body, true);
+				ofFile::moveFromTo(tmp, path, false, true);
+			}
+			writeMeta(metaPath, received);
+			return path;
+		}
+
+		// network down or server error: serve the cached copy if any.
+		if(hasCached) return dataPath(cacheDir, cached.hash);
+		return "";
+	}
+};
+
+string pofImHTTPCache::dir;
+std::atomic<bool> pofImHTTPCache::offline(false);
+std::atomic<int> pofImHTTPCache::tmpCount(0);
+ofMutex pofImHTTPCache::mutex;
+
+//------------------------------------------//
+// Decoding at a reduced size, for thumbnails.
+
+class pofImDecode {
+	public:
+
+	// Let libjpeg scale the image in the DCT domain (1/2, 1/4 or 1/8), to the smallest
+	// scale that is still at least (w x h). Returns false if the file is not a local JPEG.
+	static bool loadScaledJPEG(const string &path, int w, int h, ofPixels &pixels) {
+		if(FreeImage_GetFileType(path.c_str(), 0) != FIF_JPEG) return false;
+
+		FIBITMAP *header = FreeImage_Load(FIF_JPEG, path.c_str(), FIF_LOAD_NOPIXELS);
+		if(!header) return false;
+		int srcWidth = FreeImage_GetWidth(header);
+		int srcHeight = FreeImage_GetHeight(header);
+		FreeImage_Unload(header);
+
+		float scale = 1;
+		if(w > 0) scale = (float)srcWidth / w;
+		if(h > 0 && (w <= 0 || (float)srcHeight / h < scale)) scale = (float)srcHeight / h;
+		int requested = 0; // 0 = full size
+		if(scale > 1) requested = ceil(MAX(srcWidth, srcHeight) / scale);
+
+		FIBITMAP *bmp = FreeImage_Load(FIF_JPEG, path.c_str(), JPEG_ACCURATE | (requested << 16));
+		if(!bmp) return false;
+		FIBITMAP *bmp24 = FreeImage_ConvertTo24Bits(bmp);
+		FreeImage_Unload(bmp);
+		if(!bmp24) return false;
+
+		int width = FreeImage_GetWidth(bmp24);
+		int height = FreeImage_GetHeight(bmp24);
+		pixels.allocate(width, height, OF_PIXELS_RGB);
+		unsigned char *out = pixels.getData();
+		for(int y = 0; y < height; y++) {
+			BYTE *line = FreeImage_GetScanLine(bmp24, height - 1 - y); // FreeImage is bottom-up
+			for(int x = 0; x < width; x++) {
+				*out++ = line[3 * x + FI_RGBA_RED];
+				*out++ = line[3 * x + FI_RGBA_GREEN];
+				*out++ = line[3 * x + FI_RGBA_BLUE];
+			}
+		}
+		FreeImage_Unload(bmp24);
+		return true;
+	}
+
+	// Area-averaging downscale; dst is allocated with src's pixel format.
+	static void boxDownscale(ofPixels &src, ofPixels &dst, int w, int h) {
+		int sw = src.getWidth(), sh = src.getHeight(), c = src.getNumChannels();
+		const unsigned char *in = src.getData();
+		dst.allocate(w, h, src.getPixelFormat());
+		unsigned char *out = dst.getData();
+		vector<unsigned int> acc(c);
+
+		for(int y = 0; y < h; y++) {
+			int y0 = y * sh / h, y1 = MAX(y0 + 1, (y + 1) * sh / h);
+			for(int x = 0; x < w; x++) {
+				int x0 = x * sw / w, x1 = MAX(x0 + 1, (x + 1) * sw / w);
+				std::fill(acc.begin(), acc.end(), 0);
+				for(int yy = y0; yy < y1; yy++) {
+					const unsigned char *p = in + (yy * sw + x0) * c;
+					for(int xx = x0; xx < x1; xx++)
+						for(int k = 0; k < c; k++) acc[k] += *p++;
+				}
+				unsigned int n = (y1 - y0) * (x1 - x0);
+				for(int k = 0; k < c; k++) *out++ = acc[k] / n;
+			}
+		}
+	}
+
+	// Load path so that the image is not bigger than needed to fill (w x h);
+	// w or h = 0 means "keep the ratio".
+	static bool load(const string &path, int w, int h, ofImage *im) {
+		ofPixels pixels;
+		if(!loadScaledJPEG(path, w, h, pixels) && !ofLoadImage(pixels, path)) return false;
+
+		int srcWidth = pixels.getWidth(), srcHeight = pixels.getHeight();
+		if(w <= 0) w = (float)srcWidth * h / srcHeight;
+		if(h <= 0) h = (float)srcHeight * w / srcWidth;
+		if(w > 0 && h > 0 && w < srcWidth && h < srcHeight) {
+			ofPixels small;
+			boxDownscale(pixels, small, w, h);
+			im->setFromPixels(small);
+		}
+		else im->setFromPixels(pixels);
+		return true;
+	}
+};
+
+//------------------------------------------//
 
 class pofIm{
 
-	t_symbol *file;
+	t_symbol *key, *file;
+	int decodeWidth, decodeHeight; // 0 = full size
 	int refCount;
+	bool pinned;
+	bool cached; // unreferenced but kept warm in the LRU list
+	std::list<pofIm*>::iterator lruIt;
 	
 	static std::map<t_symbol*,pofIm*> images;
+	static std::list<pofIm*> lru; // unreferenced images, least recently used first
 	static ofMutex mutex;
 
 	public:
 	ofImage *im;
-	bool loaded, preloaded, needUpdate;
+	bool loaded, preloaded, needUpdate, mipmapped;
+	
+	static size_t cacheBudget; // bytes; 0 = free unreferenced images immediately
+	static unsigned int hits, misses, evictions;
 	
-	pofIm(t_symbol *f):file(f),refCount(1), loaded(false), preloaded(false), needUpdate(false) {
+	pofIm(t_symbol *k, t_symbol *f, int dw, int dh):key(k), file(f), decodeWidth(dw), decodeHeight(dh),
+		refCount(1), pinned(false), cached(false), loaded(false), preloaded(false), needUpdate(false), mipmapped(false) {
 		im = new ofImage();
-		images[file] = this;
+		images[key] = this;
 		im->setAnchorPercent(0.5,0.5);
 		im->setUseTexture(false);
 	}
 	
 	~pofIm() {
-		images.erase(file);
+		images.erase(key);
+		if(cached) lru.erase(lruIt);
 		//delete im;
 		imsToDelete.push_back(im);
 	}
 	
 	void doLoad(void) {
 		if(loaded) return;
-		if( (!strncmp(file->s_name, "http", strlen("http"))) || ofFile(file->s_name).exists())
-            im->load(file->s_name);
+		string path;
+		if(!strncmp(file->s_name, "http", strlen("http"))) {
+			path = pofImHTTPCache::fetch(file->s_name);
+			if(path.empty() && !pofImHTTPCache::enabled()) path = file->s_name;
+		}
+		else if(ofFile(file->s_name).exists()) path = file->s_name;
+
+		if(path.size()) {
+			if(decodeWidth > 0 || decodeHeight > 0) pofImDecode::load(path, decodeWidth, decodeHeight, im);
+			else im->load(path);
+		}
 		loaded = true;
 	}
 	
@@ -98,22 +390,44 @@ class pofIm{
         if(needUpdate) {
         	im->update();
         	needUpdate = false;
+        	mipmapped = false;
         }
 		return true;
 	}
 
+	void setFilter(int quality) { // 0: nearest, 1: linear, 2: linear with mipmaps
+		if(quality == 0) im->getTexture().setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+		else if(quality == 1) im->getTexture().setTextureMinMagFilter(GL_LINEAR, GL_LINEAR);
+		else {
+			if(!mipmapped) {
+				ofTexture &tex = im->getTexture();
+				if(tex.getTextureData().textureTarget != GL_TEXTURE_2D) { // no mipmaps for rectangle textures
+					tex.allocate(im->getPixels(), false);
+					tex.loadData(im->getPixels());
+				}
+				tex.generateMipmap();
+				mipmapped = true;
+			}
+			im->getTexture().setTextureMinMagFilter(GL_LINEAR_MIPMAP_LINEAR, GL_LINEAR);
+		}
+	}
+
+	size_t getBytes() { // approximate memory used by pixels (+ texture if uploaded)
+		if(!(loaded && im->isAllocated())) return 0;
+		size_t bytes = (size_t)im->getWidth() * (size_t)im->getHeight() * im->getPixels().getNumChannels();
+		if(im->isUsingTexture()) bytes *= 2;
+		return bytes;
+	}
 
-	void draw(float x, float y, float w, float h, bool quality) {
+	void draw(float x, float y, float w, float h, int quality) {
 		if(!update()) return;
-		if(!quality) im->getTexture().setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
-		else im->getTexture().setTextureMinMagFilter(GL_LINEAR, GL_LINEAR);
+		setFilter(quality);
 		im->draw(x, y, w, h);
 	}
 
-	void drawsub(float x, float y, float w, float h, float sx, float sy, float sw, float sh, bool quality) {
+	void drawsub(float x, float y, float w, float h, float sx, float sy, float sw, float sh, int quality) {
 		if(!update()) return;
-		if(!quality) im->getTexture().setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
-		else im->getTexture().setTextureMinMagFilter(GL_LINEAR, GL_LINEAR);
+		setFilter(quality);
 		im->drawSubsection(x, y, w, h, sx, sy, sw, sh);
 	}
 
@@ -129,19 +443,32 @@ class pofIm{
 		im->unbind();
 	}
 
-	static pofIm* getImage(t_symbol *file){
+	static pofIm* getImage(t_symbol *file, int decodeWidth = 0, int decodeHeight = 0){
+		t_symbol *key = file;
+		if(decodeWidth > 0 || decodeHeight > 0) { // cache thumbnails by (file, target size)
+			char size[64];
+			snprintf(size, 64, "@%dx%d", decodeWidth, decodeHeight);
+			key = gensym((string(file->s_name) + size).c_str());
+		}
 		mutex.lock();
 		std::map<t_symbol*,pofIm*>::iterator it;
-		it = images.find(file);
+		it = images.find(key);
 		if(it!=images.end()) {
-			it->second->refCount++;
+			pofIm *image = it->second;
+			if(image->cached) {
+				lru.erase(image->lruIt);
+				image->cached = false;
+			}
+			image->refCount++;
+			hits++;
 			mutex.unlock();
-			return it->second;
+			return image;
 		}
 		else {
-			new pofIm(file);
+			pofIm *image = new pofIm(key, file, decodeWidth, decodeHeight);
+			misses++;
 			mutex.unlock();
-			return images[file];
+			return image;
 		}
 	}
 		
@@ -153,16 +480,76 @@ class pofIm{
 	}	
 		
 	static int letImage(pofIm *image) {
-		bool deleted = false;
+		int count;
 		mutex.lock();
-		image->refCount--;
-		if(image->refCount == 0) {
+		count = --image->refCount;
+		if(count == 0 && !image->pinned) {
+			image->cached = true;
+			image->lruIt = lru.insert(lru.end(), image);
+			evict();
+		}
+		mutex.unlock();
+		return count;
+	}
+
+	static void pin(t_symbol *file, bool pin) {
+		pofIm *image;
+		if(pin) {
+			image = getImage(file);
+			image->load();
+			mutex.lock();
+			image->pinned = true;
+			mutex.unlock();
+			letImage(image);
+		} else {
+			mutex.lock();
+			image = findImage(file);
+			if(image && image->pinned) {
+				image->pinned = false;
+				if(image->refCount == 0) {
+					image->cached = true;
+					image->lruIt = lru.insert(lru.end(), image);
+					evict();
+				}
+			}
+			mutex.unlock();
+		}
+	}
+
+	static size_t getTotalBytes() { // to be called with mutex locked
+		size_t total = 0;
+		std::map<t_symbol*,pofIm*>::iterator it;
+		for(it = images.begin(); it != images.end(); it++) total += it->second->getBytes();
+		return total;
+	}
+
+	static void evict() { // to be called with mutex locked
+		if(lru.empty()) return;
+		size_t total = getTotalBytes();
+		while(!lru.empty() && (cacheBudget == 0 || total > cacheBudget)) {
+			pofIm *image = lru.front();
+			size_t bytes = image->getBytes();
+			total -= (bytes < total ? bytes : total);
 			delete image;
-			deleted = true;
+			evictions++;
 		}
+	}
+
+	static void setCacheBudget(size_t bytes) {
+		mutex.lock();
+		cacheBudget = bytes;
+		evict();
+		mutex.unlock();
+	}
+
+	static void getStats(unsigned int &numCached, size_t &cachedBytes, size_t &totalBytes) {
+		mutex.lock();
+		numCached = lru.size();
+		cachedBytes = 0;
+		std::list<pofIm*>::iterator it;
+		for(it = lru.begin(); it != lru.end(); it++) cachedBytes += (*it)->getBytes();
+		totalBytes = getTotalBytes();
 		mutex.unlock();
-		if(deleted) return 0;
-		else return image->refCount;
 	}
 	
 	static int getNumImages()
@@ -172,25 +559,27 @@ class pofIm{
 	
 	static void initFrame(ofEventArgs & args)
 	{
+		mutex.lock();
 		while(!imsToDelete.empty()) {
 			delete imsToDelete.front();
 			imsToDelete.pop_front();
 		}
+		mutex.unlock();
 	}
 };
 
 std::map<t_symbol*,pofIm*> pofIm::images;
+std::list<pofIm*> pofIm::lru;
 ofMutex pofIm::mutex;
+size_t pofIm::cacheBudget = 0;
+unsigned int pofIm::hits = 0, pofIm::misses = 0, pofIm::evictions = 0;
 
 //------------------------------------------//
 
 void pofImLoader::threadedFunction() {
 	while(isThreadRunning()) {
-		if(imagesToLoad.size()) {
-			lock();
-			pofIm *im = imagesToLoad.front();
-			imagesToLoad.pop_front();
-			unlock();
+		pofIm *im = source->deQueue();
+		if(im) {
 			im->doLoad();
 			pofIm::letImage(im);
 		} else ofSleepMillis(5);
@@ -203,7 +592,7 @@ void pofImLoader::threadedFunction() {
 static t_class *pofimage_class;
 static t_symbol *s_set, *s_saved, *s_size, *s_monitor, *s_color, 
   *s_save, *s_clear, *s_resize, *s_setcolor, *s_grab, *s_grabfbo,
-  *s_crop, *s_reload, *s_loadfile, *s_settype, *s_RGB, *s_RGBA, *s_GRAY;
+  *s_crop, *s_reload, *s_loadfile, *s_settype, *s_RGB, *s_RGBA, *s_GRAY, *s_cachestats;
 
 static void pofimage_set(void *x, t_symbol *f);
 
@@ -279,6 +668,57 @@ static void pofimage_unreserve(void *x, t_symbol *f)
 	else px->unreserve(f);
 }
 
+static void pofimage_pin(void *x, t_symbol *f)
+{
+	pofImage* px= (pofImage*)(((PdObject*)x)->parent);
+	t_symbol *file = makefilename(f, px->pdcanvas);
+	if(file) pofIm::pin(file, true);
+}
+
+static void pofimage_unpin(void *x, t_symbol *f)
+{
+	pofImage* px= (pofImage*)(((PdObject*)x)->parent);
+	t_symbol *file = makefilename(f, px->pdcanvas);
+	if(file) pofIm::pin(file, false);
+}
+
+static void pofimage_cachesize(void *x, t_float megabytes)
+{
+	if(megabytes < 0) megabytes = 0;
+	pofIm::setCacheBudget((size_t)(megabytes * 1024 * 1024));
+}
+
+static void pofimage_cachestats(void *x)
+{
+	pofImage* px= (pofImage*)(((PdObject*)x)->parent);
+	t_atom ap[6];
+	unsigned int numCached;
+	size_t cachedBytes, totalBytes;
+	
+	pofIm::getStats(numCached, cachedBytes, totalBytes);
+	SETFLOAT(&ap[0], pofIm::hits);
+	SETFLOAT(&ap[1], pofIm::misses);
+	SETFLOAT(&ap[2], pofIm::evictions);
+	SETFLOAT(&ap[3], numCached);
+	SETFLOAT(&ap[4], cachedBytes / (1024.0 * 1024.0));
+	SETFLOAT(&ap[5], totalBytes / (1024.0 * 1024.0));
+	outlet_anything(px->m_out2, s_cachestats, 6, ap);
+}
+
+static void pofimage_httpcache(void *x, t_symbol *dir)
+{
+	pofImage* px= (pofImage*)(((PdObject*)x)->parent);
+	string path = dir->s_name;
+	if(path.size() && !ofFilePath::isAbsolute(path))
+		path = string(canvas_getdir(px->pdcanvas)->s_name) + "/" + path;
+	pofImHTTPCache::setDir(path);
+}
+
+static void pofimage_httpoffline(void *x, t_float f)
+{
+	pofImHTTPCache::setOffline(f != 0);
+}
+
 static void pofimage_monitor(void *x, t_float f)
 {
 	pofImage* px= (pofImage*)(((PdObject*)x)->parent);
@@ -380,7 +820,14 @@ static void pofimage_sub(void *x, t_float sx, t_float sy, t_float sw, t_float sh
 static void pofimage_quality(void *x, t_float q)
 {
 	pofImage* px= (pofImage*)(((PdObject*)x)->parent);
-	px->quality = (q != 0);
+	px->quality = ofClamp(q, 0, 2);
+}
+
+static void pofimage_decodesize(void *x, t_float f)
+{
+	pofImage* px= (pofImage*)(((PdObject*)x)->parent);
+	px->decodeAtSize = (f != 0);
+	px->displayedFile = NULL; // reload at the new size
 }
 
 void pofImage::setup(void)
@@ -404,17 +851,25 @@ void pofImage::setup(void)
     s_RGB = gensym("RGB");
     s_RGBA = gensym("RGBA");
     s_GRAY = gensym("GRAY");
+	s_cachestats = gensym("cachestats");
 	pofimage_class = class_new(gensym("pofimage"), (t_newmethod)pofimage_new, (t_method)pofimage_free,
 		sizeof(PdObject), 0, A_GIMME, A_NULL);
 	POF_SETUP(pofimage_class);
 	class_addmethod(pofimage_class, (t_method)pofimage_set, s_set, A_SYMBOL, A_NULL);
 	class_addmethod(pofimage_class, (t_method)pofimage_reserve, gensym("reserve"), A_SYMBOL, A_NULL);
 	class_addmethod(pofimage_class, (t_method)pofimage_unreserve, gensym("unreserve"), A_SYMBOL, A_NULL);
+	class_addmethod(pofimage_class, (t_method)pofimage_pin, gensym("pin"), A_SYMBOL, A_NULL);
+	class_addmethod(pofimage_class, (t_method)pofimage_unpin, gensym("unpin"), A_SYMBOL, A_NULL);
+	class_addmethod(pofimage_class, (t_method)pofimage_cachesize, gensym("cachesize"), A_FLOAT, A_NULL);
+	class_addmethod(pofimage_class, (t_method)pofimage_cachestats, s_cachestats, A_NULL);
+	class_addmethod(pofimage_class, (t_method)pofimage_httpcache, gensym("httpcache"), A_DEFSYMBOL, A_NULL);
+	class_addmethod(pofimage_class, (t_method)pofimage_httpoffline, gensym("httpoffline"), A_FLOAT, A_NULL);
 	class_addmethod(pofimage_class, (t_method)pofimage_monitor, gensym("setmonitor"), A_FLOAT, A_NULL);
 	class_addmethod(pofimage_class, (t_method)pofimage_getcolor, gensym("getcolor"), A_FLOAT, A_FLOAT, A_NULL);
 	class_addmethod(pofimage_class, (t_method)pofimage_setcolors, gensym("setcolors"),	A_GIMME, A_NULL);
 	class_addmethod(pofimage_class, (t_method)pofimage_sub, gensym("sub"), A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, A_NULL);
 	class_addmethod(pofimage_class, (t_method)pofimage_quality, gensym("quality"), A_FLOAT, A_NULL);
+	class_addmethod(pofimage_class, (t_method)pofimage_decodesize, gensym("decodesize"), A_FLOAT, A_NULL);
 	
 	class_addmethod(pofimage_class, (t_method)tellGUI, s_save,    	A_GIMME, A_NULL);
 	class_addmethod(pofimage_class, (t_method)tellGUI, s_setcolor,	A_GIMME, A_NULL);
@@ -434,6 +889,10 @@ void pofImage::setup(void)
     imLoaderHTTP = new pofImLoader;
 	imLoader->startThread(true); //, false);    // blocking, non verbose
 	imLoaderHTTP->startThread(true); //, false);    // blocking, non verbose
+	for(int i = 1; i < HTTP_LOADERS; i++) {
+		imLoaderHTTPHelpers.push_back(new pofImLoader(imLoaderHTTP));
+		imLoaderHTTPHelpers.back()->startThread(true);
+	}
 	ofAddListener(pofBase::initFrameEvent, &pofIm::initFrame);
 
 }
@@ -442,6 +901,11 @@ void pofImage::release(void)
 {
 	imLoader->waitForThread(true);
 	delete imLoader;
+	for(unsigned int i = 0; i < imLoaderHTTPHelpers.size(); i++) {
+		imLoaderHTTPHelpers[i]->waitForThread(true);
+		delete imLoaderHTTPHelpers[i];
+	}
+	imLoaderHTTPHelpers.clear();
 	imLoaderHTTP->waitForThread(true);
 	delete imLoaderHTTP;
 }
@@ -476,11 +940,19 @@ void pofImage::Update()
 		}
 	}
 	
-	if(file && (file != displayedFile)) {
+	// the decoded size only changes by powers of two, so that animating the size doesn't decode
+	// the file (and fill the cache) again at each frame.
+	int decodeWidth = decodeAtSize ? decodeBucket(width) : 0;
+	int decodeHeight = decodeAtSize ? decodeBucket(height) : 0;
+	if(file && ((file != displayedFile) || 
+			(decodeAtSize && ((decodeWidth != decodedWidth) || (decodeHeight != decodedHeight))))) {
 		if(image) pofIm::letImage(image);
 		//image = pofIm::getImage(file);
-		image = pofIm::getImage(makefilename(file, pdcanvas));
+		if(decodeAtSize) image = pofIm::getImage(makefilename(file, pdcanvas), decodeWidth, decodeHeight);
+		else image = pofIm::getImage(makefilename(file, pdcanvas));
 		displayedFile = file;
+		decodedWidth = decodeWidth;
+		decodedHeight = decodeHeight;
 	}
 	if(image) {
 		image->load();
@@ -507,6 +979,15 @@ void pofImage::Update()
 	}
 }
 
+int pofImage::decodeBucket(float size)
+{
+	size = fabs(size);
+	if(size <= 0) return 0;
+	int bucket = 1;
+	while(bucket < size && bucket < (1 << 30)) bucket <<= 1;
+	return bucket;
+}
+
 void pofImage::draw()
 {
 	float w = width, h = height;
@@ -572,7 +1053,7 @@ void pofImage::unreserve(t_symbol *f)
 	t_symbol *file = makefilename(f, pdcanvas);
 	if(!file) return;
 	pofIm *im = pofIm::findImage(file);
-	if(im) {
+	if(im && (std::find(reserved.begin(), reserved.end(), im) != reserved.end())) {
 		pofIm::letImage(im);
 		reserved.remove(im);
 	}	
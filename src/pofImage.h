@@ -17,7 +17,8 @@ class pofImage: public pofBase {
 			float istext=0, t_symbol *_name=NULL):
 				pofBase(Class), file(NULL), displayedFile(NULL), name(_name), width(w), height(h),
 				xanchor(xa), yanchor(ya), subx(sx), suby(sy), subwidth(sw), subheight(sh),
-				image(NULL), reservedChanged(false), monitor(false), isTexture(istext!=0), quality(true)
+				image(NULL), reservedChanged(false), monitor(false), isTexture(istext!=0), quality(1),
+				decodeAtSize(false), decodedWidth(0), decodedHeight(0)
 		{
 				m_out2 = outlet_new(&(pdobj->x_obj), 0);
 		}
@@ -64,7 +65,10 @@ class pofImage: public pofBase {
 		unsigned int imgLen; // total number of (pre)loaded images.
 		bool monitor;
 		bool isTexture;
-		bool quality;
+		int quality; // 0: nearest, 1: linear, 2: mipmaps
+		bool decodeAtSize; // decode the file at (width x height) instead of its full size
+		int decodedWidth, decodedHeight; // the drawn size, rounded up to powers of two
+		static int decodeBucket(float size);
 };
 
 
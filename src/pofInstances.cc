@@ -0,0 +1,294 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#include "pofInstances.h"
+#include "RWmutex.h"
+
+t_class *pofinstances_class;
+
+ofShader pofInstances::shader;
+int pofInstances::shaderState = 0;
+std::list<ofBufferObject*> pofInstances::buffersToDelete;
+std::list<pofInstances::Child*> pofInstances::childrenToDelete;
+
+static const float instanceDefaults[pofInstances::NUM_FIELDS] = {0, 0, 0, 1, 1, 0, 1, 1, 1, 1};
+
+static const char *instanceVertexShader =
+	"#version 120\n"
+	"attribute vec3 instancePosition;\n"
+	"attribute vec3 instanceScaleRotation; // scale x, scale y, rotation (degrees)\n"
+	"attribute vec4 instanceColor;\n"
+	"void main()\n"
+	"{\n"
+	"	float a = radians(instanceScaleRotation.z);\n"
+	"	vec4 v = gl_Vertex;\n"
+	"	v.xyz *= instanceScaleRotation.xyx;\n"
+	"	v.xy = vec2(v.x * cos(a) - v.y * sin(a), v.x * sin(a) + v.y * cos(a));\n"
+	"	v.xyz += instancePosition;\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * v;\n"
+	"	gl_FrontColor = gl_Color * instanceColor;\n"
+	"}\n";
+
+static const char *instanceFragmentShader =
+	"#version 120\n"
+	"void main()\n"
+	"{\n"
+	"	gl_FragColor = gl_Color;\n"
+	"}\n";
+
+pofInstances::~pofInstances()
+{
+	treeMutex.lockW();
+	if(instanceBuffer) buffersToDelete.push_back(instanceBuffer);
+	for(std::map<pofBase*, Child*>::iterator it = childVbos.begin(); it != childVbos.end(); it++)
+		childrenToDelete.push_back(it->second);
+	treeMutex.unlockW();
+}
+
+void pofInstances::readArrays()
+{
+	t_word *vecs[NUM_FIELDS];
+	int sizes[NUM_FIELDS];
+	int n = count, minSize = -1;
+
+	for(int f = 0; f < NUM_FIELDS; f++) {
+		t_garray *array;
+		vecs[f] = NULL;
+		sizes[f] = 0;
+		if(!arrays[f]) continue;
+		if (!(array = (t_garray *)pd_findbyclass(arrays[f], garray_class)))
+			pd_error(pdobj, "%s: no such array", arrays[f]->s_name);
+		else if (!garray_getfloatwords(array, &sizes[f], &vecs[f]))
+			pd_error(pdobj, "%s: bad template for pofinstances", arrays[f]->s_name);
+		else if(minSize < 0 || sizes[f] < minSize) minSize = sizes[f];
+	}
+	if(n <= 0) n = (minSize > 0) ? minSize : 0;
+
+	vector<float> newData(n * NUM_FIELDS);
+	for(int f = 0; f < NUM_FIELDS; f++) {
+		int src = f;
+		if(f == SCALEY && !vecs[SCALEY]) src = SCALEX; // uniform scale
+		for(int i = 0; i < n; i++) {
+			newData[i * NUM_FIELDS + f] = (vecs[src] && i < sizes[src]) ? vecs[src][i].w_float : instanceDefaults[src];
+		}
+	}
+
+	mutex.lock();
+	if(newData != data) { // only upload changed data
+		data.swap(newData);
+		changed = true;
+	}
+	mutex.unlock();
+}
+
+/*******************************************/
+
+void *pofinstances_new(t_floatarg n)
+{
+	pofInstances* obj = new pofInstances(pofinstances_class, n);
+	return (void*) (obj->pdobj);
+}
+
+void pofinstances_free(void *x)
+{
+	delete (pofInstances*)(((PdObject*)x)->parent);
+}
+
+static void pofinstances_setarrays(pofInstances *px, int first, int num, int argc, t_atom *argv)
+{
+	for(int i = 0; i < num; i++) {
+		px->arrays[first + i] = (i < argc && argv[i].a_type == A_SYMBOL) ? atom_getsymbol(&argv[i]) : NULL;
+	}
+	px->readArrays();
+}
+
+void pofinstances_position(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofinstances_setarrays((pofInstances*)(((PdObject*)x)->parent), pofInstances::POSX, 3, argc, argv);
+}
+
+void pofinstances_scale(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofinstances_setarrays((pofInstances*)(((PdObject*)x)->parent), pofInstances::SCALEX, 2, argc, argv);
+}
+
+void pofinstances_rotation(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofinstances_setarrays((pofInstances*)(((PdObject*)x)->parent), pofInstances::ROTATION, 1, argc, argv);
+}
+
+void pofinstances_color(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofinstances_setarrays((pofInstances*)(((PdObject*)x)->parent), pofInstances::RED, 4, argc, argv);
+}
+
+void pofinstances_count(void *x, t_float n)
+{
+	pofInstances *px = (pofInstances*)(((PdObject*)x)->parent);
+	px->count = n;
+	px->readArrays();
+}
+
+void pofinstances_bang(void *x)
+{
+	pofInstances *px = (pofInstances*)(((PdObject*)x)->parent);
+	px->readArrays();
+}
+
+void pofInstances::setup(void)
+{
+	pofinstances_class = class_new(gensym("pofinstances"), (t_newmethod)pofinstances_new, (t_method)pofinstances_free,
+		sizeof(PdObject), 0, A_DEFFLOAT, A_NULL);
+	class_addmethod(pofinstances_class, (t_method)pofinstances_position, gensym("position"), A_GIMME, A_NULL);
+	class_addmethod(pofinstances_class, (t_method)pofinstances_scale, gensym("scale"), A_GIMME, A_NULL);
+	class_addmethod(pofinstances_class, (t_method)pofinstances_rotation, gensym("rotation"), A_GIMME, A_NULL);
+	class_addmethod(pofinstances_class, (t_method)pofinstances_color, gensym("color"), A_GIMME, A_NULL);
+	class_addmethod(pofinstances_class, (t_method)pofinstances_count, gensym("count"), A_FLOAT, A_NULL);
+	class_addbang(pofinstances_class, (t_method)pofinstances_bang);
+	POF_SETUP(pofinstances_class);
+	ofAddListener(pofBase::initFrameEvent, &pofInstances::initFrame);
+}
+
+void pofInstances::initFrame(ofEventArgs & args)
+{
+	while(!buffersToDelete.empty()) {
+		delete buffersToDelete.front();
+		buffersToDelete.pop_front();
+	}
+	while(!childrenToDelete.empty()) {
+		delete childrenToDelete.front();
+		childrenToDelete.pop_front();
+	}
+}
+
+// process the messages of objects whose tree_draw() isn't called.
+static void pofInstances_dequeue(pofBase *obj, bool recursive)
+{
+	t_binbuf *bb;
+	while((bb = obj->dequeueToGUI()) != NULL) {
+		if(binbuf_getnatom(bb)) obj->message(binbuf_getnatom(bb), binbuf_getvec(bb));
+		binbuf_free(bb);
+	}
+	if(!recursive) return;
+	for(std::list<pofBase*>::iterator it = obj->children.begin(); it != obj->children.end(); it++)
+		pofInstances_dequeue(*it, true);
+}
+
+bool pofInstances::drawInstanced(pofBase *child)
+{
+#ifdef TARGET_OPENGLES
+	return false;
+#else
+	if(shaderState == 0) {
+		shaderState = -1;
+		if(ofGLCheckExtension("GL_ARB_instanced_arrays") && ofGLCheckExtension("GL_ARB_draw_instanced")
+			&& shader.setupShaderFromSource(GL_VERTEX_SHADER, instanceVertexShader)
+			&& shader.setupShaderFromSource(GL_FRAGMENT_SHADER, instanceFragmentShader)
+			&& shader.linkProgram()) shaderState = 1;
+		else ofLogNotice("pofinstances") << "instanced drawing not available, drawing instances one by one.";
+	}
+
+	// textured, outlined or lit geometry is drawn by the children themselves.
+	if(shaderState < 0 || !child->children.empty() || currentTexture != NULL
+		|| !ofGetStyle().bFill || ofGetLightingEnabled()) return false;
+
+	pofInstances_dequeue(child, false); // the child's tree_draw() isn't called
+	if(!child->getMesh(tmpMesh) || tmpMesh.getVertices().empty()) return false;
+
+	if(!instanceBuffer) instanceBuffer = new ofBufferObject();
+	if(!uploaded) {
+		instanceBuffer->setData(glData.size() * sizeof(float), &glData[0], GL_DYNAMIC_DRAW);
+		uploaded = true;
+	}
+
+	Child *c;
+	bool fresh = false;
+	std::map<pofBase*, Child*>::iterator it = childVbos.find(child);
+	if(it != childVbos.end()) c = it->second;
+	else {
+		c = childVbos[child] = new Child();
+		fresh = true;
+	}
+
+	if(fresh || c->mesh.getVertices() != tmpMesh.getVertices() || c->mesh.getIndices() != tmpMesh.getIndices()) {
+		int stride = NUM_FIELDS * sizeof(float);
+		int position = shader.getAttributeLocation("instancePosition");
+		int scaleRotation = shader.getAttributeLocation("instanceScaleRotation");
+		int color = shader.getAttributeLocation("instanceColor");
+		if(position < 0 || scaleRotation < 0 || color < 0) {
+			ofLogNotice("pofinstances") << "instance attributes not found, drawing instances one by one.";
+			shaderState = -1;
+			return false;
+		}
+
+		c->mesh = tmpMesh;
+		c->vbo.setMesh(c->mesh, GL_STATIC_DRAW);
+		c->vbo.setAttributeBuffer(position, *instanceBuffer, 3, stride, POSX * sizeof(float));
+		c->vbo.setAttributeBuffer(scaleRotation, *instanceBuffer, 3, stride, SCALEX * sizeof(float));
+		c->vbo.setAttributeBuffer(color, *instanceBuffer, 4, stride, RED * sizeof(float));
+		c->vbo.setAttributeDivisor(position, 1);
+		c->vbo.setAttributeDivisor(scaleRotation, 1);
+		c->vbo.setAttributeDivisor(color, 1);
+	}
+
+	shader.begin();
+	if(c->mesh.getNumIndices())
+		c->vbo.drawElementsInstanced(ofGetGLPrimitiveMode(c->mesh.getMode()), c->mesh.getNumIndices(), glCount);
+	else c->vbo.drawInstanced(ofGetGLPrimitiveMode(c->mesh.getMode()), 0, c->mesh.getNumVertices(), glCount);
+	shader.end();
+	return true;
+#endif
+}
+
+void pofInstances::drawLoop(pofBase *child)
+{
+	ofColor styleColor = ofGetStyle().color;
+
+	for(int i = 0; i < glCount; i++) {
+		const float *d = &glData[i * NUM_FIELDS];
+		ofPushMatrix();
+		ofTranslate(d[POSX], d[POSY], d[POSZ]);
+		ofRotate(d[ROTATION], 0, 0, 1);
+		ofScale(d[SCALEX], d[SCALEY], d[SCALEX]);
+		ofSetColor(styleColor.r*d[RED], styleColor.g*d[GREEN], styleColor.b*d[BLUE], styleColor.a*d[ALPHA]);
+		child->tree_draw();
+		ofPopMatrix();
+	}
+	ofSetColor(styleColor);
+}
+
+void pofInstances::tree_draw()
+{
+	mutex.lock();
+	if(changed) {
+		glData = data;
+		changed = false;
+		uploaded = false;
+	}
+	mutex.unlock();
+	glCount = glData.size() / NUM_FIELDS;
+
+	// forget the vbos of the children that have gone
+	for(std::map<pofBase*, Child*>::iterator it = childVbos.begin(); it != childVbos.end();) {
+		if(std::find(children.begin(), children.end(), it->first) == children.end()) {
+			delete it->second;
+			childVbos.erase(it++);
+		}
+		else it++;
+	}
+
+	if(!glCount) { // nothing drawn, but the messages to the children still apply
+		for(std::list<pofBase*>::iterator it = children.begin(); it != children.end(); it++)
+			pofInstances_dequeue(*it, true);
+		return;
+	}
+
+	flushBatches();
+	std::list<pofBase*>::iterator it = children.begin();
+	while(it != children.end()) {
+		if(!drawInstanced(*it)) drawLoop(*it);
+		it++;
+	}
+}
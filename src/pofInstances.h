@@ -0,0 +1,53 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#pragma once
+
+#include "pofBase.h"
+
+// Draws its children N times, each instance being placed, scaled, rotated and colored
+// from Pd arrays. Children giving their geometry (getMesh()) are drawn in one instanced
+// draw call when the GL supports it; the others are drawn once per instance.
+class pofInstances: public pofBase {
+	public:
+		enum { POSX = 0, POSY, POSZ, SCALEX, SCALEY, ROTATION, RED, GREEN, BLUE, ALPHA, NUM_FIELDS };
+
+		pofInstances(t_class *Class, int n):
+			pofBase(Class), count(n), changed(false), glCount(0), uploaded(false), instanceBuffer(NULL) {
+			for(int i = 0; i < NUM_FIELDS; i++) arrays[i] = NULL;
+		}
+		virtual ~pofInstances();
+
+		virtual void tree_draw();
+		static void setup(void);
+
+		void readArrays(); // from Pd
+		bool drawInstanced(pofBase *child); // false if the child can't be instanced
+		void drawLoop(pofBase *child);
+
+		t_symbol *arrays[NUM_FIELDS];
+		int count; // 0 : size of the smallest array
+		vector<float> data; // NUM_FIELDS floats per instance
+		bool changed;
+		ofMutex mutex;
+
+		// GL thread:
+		vector<float> glData;
+		int glCount;
+		bool uploaded;
+		ofBufferObject *instanceBuffer;
+		struct Child {
+			ofMesh mesh;
+			ofVbo vbo;
+		};
+		std::map<pofBase*, Child*> childVbos;
+		ofMesh tmpMesh;
+
+		static ofShader shader;
+		static int shaderState; // 0: not loaded, 1: ready, -1: instancing unavailable
+		static std::list<ofBufferObject*> buffersToDelete;
+		static std::list<Child*> childrenToDelete;
+		static void initFrame(ofEventArgs & args); // collect garbage
+};
@@ -4,26 +4,388 @@
  * See https://github.com/Ant1r/ofxPof for documentation and updates.
  */
 #include "pofJSON.h"
+#ifndef TARGET_WIN32
+#include <unistd.h>
+#endif
 
 std::map<t_symbol*,pofsubJSON*> pofsubJSON::jsons;
+ofMutex pofsubJSON::jsonsMutex;
 
 t_class *pofjson_class;
-t_symbol *s_out,*s_errload,*s_loaded;
+t_symbol *s_out,*s_errload,*s_loaded,*s_saved,*s_errsave;
+t_symbol *s_true,*s_false,*s_null,*s_array,*s_object;
+
+static void syncFile(FILE *f)
+{
+	fflush(f);
+#ifndef TARGET_WIN32
+	fsync(fileno(f));
+#endif
+}
+
+//------------------------------------------//
+// Journal : every edit is appended as one JSON line to "file.journal", by a writer thread.
+// Lines are ["set", path, value] or ["remove", path]; appends are logged as a set at the
+// new index and array element removals as a set of the whole array, so replaying a line
+// twice gives the same result. When the document is saved, the journal is renamed to
+// "file.journal.old", which is removed once the save is complete.
+
+class JSONJournal: public ofThread {
+	public :
+	enum Cmd { LINE, ROTATE, DROP_OLD };
+	struct Entry {
+		Cmd cmd;
+		string text;
+	};
+	deque<Entry> entries;
+	string path;
+	FILE *f;
+
+	JSONJournal(const string &p) : path(p), f(NULL) {}
+
+	void push(Cmd cmd, const string &text = "") {
+		Entry e;
+		e.cmd = cmd;
+		e.text = text;
+		lock();
+		entries.push_back(e);
+		unlock();
+	}
+
+	void threadedFunction() {
+		while(isThreadRunning() || entries.size()) {
+			deque<Entry> todo;
+			lock();
+			todo.swap(entries);
+			unlock();
+			if(todo.empty()) {
+				ofSleepMillis(5);
+				continue;
+			}
+			bool written = false;
+			for(unsigned int i = 0; i < todo.size(); i++) {
+				Entry &e = todo[i];
+				if(e.cmd == LINE) {
+					if(!f) f = fopen(path.c_str(), "ab");
+					if(!f) continue;
+					fwrite(e.text.c_str(), 1, e.text.size(), f);
+					fputc('\n', f);
+					written = true;
+				}
+				else if(e.cmd == ROTATE) {
+					if(f) {
+						syncFile(f);
+						fclose(f);
+						f = NULL;
+						written = false;
+					}
+					// if an older journal is still waiting for its save, keep it: replaying is idempotent.
+					if(ofFile(path).exists() && !ofFile(path + ".old").exists())
+						ofFile::moveFromTo(path, path + ".old", false, false);
+				}
+				else if(e.cmd == DROP_OLD && ofFile(path + ".old").exists())
+					ofFile::removeFile(path + ".old", false);
+			}
+			if(written) syncFile(f);
+		}
+		if(f) fclose(f);
+		f = NULL;
+	}
+};
+
+static bool jsonPathFromNode(pofJSONDoc *doc, pofJSONDoc::Id n, vector<pofJSONDoc::Step> &path)
+{
+	path.clear();
+	if(n == pofJSONDoc::NONE || doc->type(n) != pofJSONDoc::ARRAY) return false;
+	for(unsigned int i = 0; i < doc->size(n); i++) {
+		pofJSONDoc::Id e = doc->child(n, i);
+		pofJSONDoc::Step step;
+		step.isIndex = (doc->type(e) == pofJSONDoc::NUMBER);
+		step.index = step.isIndex ? (unsigned int)doc->node(e).number : 0;
+		if(doc->type(e) == pofJSONDoc::STRING) step.key = doc->node(e).string;
+		else if(!step.isIndex) return false;
+		path.push_back(step);
+	}
+	return true;
+}
+
+static void replayJournal(pofJSONDoc *doc, const string &path)
+{
+	if(!ofFile(path).exists()) return;
+	ofBuffer buf = ofBufferFromFile(path);
+	vector<string> lines = ofSplitString(buf.getText(), "\n");
+	pofJSONDoc::Id s_set = doc->internString("set"), s_remove = doc->internString("remove");
+	vector<pofJSONDoc::Step> steps;
+
+	for(unsigned int i = 0; i < lines.size(); i++) {
+		const string &line = lines[i];
+		if(line.empty()) continue;
+		pofJSONDoc::Id entry = doc->parseText(line.c_str(), line.size());
+		if(entry == pofJSONDoc::NONE || doc->type(entry) != pofJSONDoc::ARRAY || doc->size(entry) < 2)
+			continue; // a crash may have truncated the last line
+		pofJSONDoc::Id op = doc->child(entry, 0);
+		if(doc->type(op) != pofJSONDoc::STRING || !jsonPathFromNode(doc, doc->child(entry, 1), steps)) continue;
+		if(doc->node(op).string == s_set && doc->size(entry) > 2)
+			doc->apply(pofJSONDoc::SET, steps, doc->child(entry, 2));
+		else if(doc->node(op).string == s_remove)
+			doc->apply(pofJSONDoc::REMOVE, steps);
+	}
+}
+
+static void jsonPathToString(pofJSONDoc *doc, const vector<pofJSONDoc::Step> &path, unsigned int len, string &out)
+{
+	out += '[';
+	for(unsigned int i = 0; i < len; i++) {
+		if(i) out += ',';
+		if(path[i].isIndex) pofJSONDoc::numberToString(path[i].index, out);
+		else pofJSONDoc::escapeString(doc->str(path[i].key), out);
+	}
+	out += ']';
+}
+
+//------------------------------------------//
+
+pofsubJSON::~pofsubJSON() {
+	jsonsMutex.lock();
+	jsons.erase(name);
+	jsonsMutex.unlock();
+	setJournal(false);
+}
+
+pofJSONSnapshot pofsubJSON::getSnapshot(const string &name) {
+	pofJSONSnapshot s;
+	std::map<t_symbol*,pofsubJSON*>::iterator it;
+	jsonsMutex.lock();
+	for(it = jsons.begin(); it != jsons.end(); it++) {
+		if(name == it->first->s_name) {
+			s = it->second->snapshot();
+			break;
+		}
+	}
+	jsonsMutex.unlock();
+	return s;
+}
+
+void pofsubJSON::setDoc(pofJSONDoc *d, t_symbol *f) {
+	// the previous version is deleted when its last snapshot is released.
+	docMutex.lock();
+	doc.reset(d);
+	docMutex.unlock();
+	pathCache.clear();
+	symbols.clear();
+	if(doc) {
+		symbols.resize(doc->numStrings(), NULL);
+		liveNodes = doc->numNodes();
+	}
+	if(doc && f && f != file) {
+		file = f;
+		if(journal) { // follow the new file
+			setJournal(false);
+			setJournal(true);
+		}
+	}
+}
+
+void pofsubJSON::setJournal(bool on) {
+	if(on && !journal) {
+		if(!file) {
+			error("pofjson %s: journal needs a loaded file", name->s_name);
+			return;
+		}
+		journal = new JSONJournal(ofToDataPath(file->s_name) + ".journal");
+		journal->startThread();
+	}
+	else if(!on && journal) {
+		journal->waitForThread(true); // stops the thread once the pending lines are written
+		delete journal;
+		journal = NULL;
+	}
+}
+
+void pofsubJSON::rotateJournal() {
+	if(journal) journal->push(JSONJournal::ROTATE);
+}
+
+void pofsubJSON::dropOldJournal() {
+	if(journal) journal->push(JSONJournal::DROP_OLD);
+}
+
+bool pofsubJSON::edit(pofJSONDoc::Op op, int argc, t_atom *argv)
+{
+	pofJSONDoc::Id value = pofJSONDoc::NONE;
+	vector<pofJSONDoc::Step> path;
+
+	if(!doc) setDoc(new pofJSONDoc());
+	if(op != pofJSONDoc::REMOVE && argc < 1) return false;
+
+	docMutex.lock(); // don't let other threads take a snapshot while the document is being changed
+	if(doc.use_count() > 1) { // a snapshot is held somewhere: it must not change, so work on a copy.
+		std::shared_ptr<pofJSONDoc> copy(new pofJSONDoc());
+		doc->compactTo(*copy);
+		doc = copy;
+		liveNodes = doc->numNodes();
+		pathCache.clear(); // node ids have changed
+	}
+
+	if(op != pofJSONDoc::REMOVE) { // the value is the last atom
+		t_atom *v = &argv[argc - 1];
+		if(v->a_type == A_FLOAT) value = doc->newNumber(atom_getfloat(v));
+		else {
+			t_symbol *sym = atom_getsymbol(v);
+			if(sym == s_true) value = doc->newBool(true);
+			else if(sym == s_false) value = doc->newBool(false);
+			else if(sym == s_null) value = doc->newNull();
+			else if(sym == s_array) value = doc->newArray();
+			else if(sym == s_object) value = doc->newObject();
+			else value = doc->newString(sym->s_name);
+		}
+		argc--;
+	}
+
+	for(int i = 0; i < argc; i++) {
+		pofJSONDoc::Step step;
+		step.isIndex = (argv[i].a_type == A_FLOAT);
+		step.index = step.isIndex ? (unsigned int)atom_getfloat(&argv[i]) : 0;
+		step.key = step.isIndex ? pofJSONDoc::NONE : doc->internString(atom_getsymbol(&argv[i])->s_name);
+		path.push_back(step);
+	}
+
+	unsigned int index = 0;
+	bool changed = doc->apply(op, path, value, &index);
+	docMutex.unlock();
+	if(!changed) return false;
+
+	pathCache.clear();
+	symbols.resize(doc->numStrings(), NULL);
+
+	if(journal) {
+		string line;
+		if(op == pofJSONDoc::APPEND) {
+			pofJSONDoc::Step step;
+			step.isIndex = true;
+			step.index = index;
+			path.push_back(step);
+		}
+		if(op == pofJSONDoc::REMOVE && !path.back().isIndex) {
+			line = "[\"remove\",";
+			jsonPathToString(doc.get(), path, path.size(), line);
+		} else {
+			// set, or removal of an array element: log the whole new value (of the parent array).
+			unsigned int len = (op == pofJSONDoc::REMOVE) ? path.size() - 1 : path.size();
+			pofJSONDoc::Id n = doc->root();
+			for(unsigned int i = 0; i < len && n != pofJSONDoc::NONE; i++)
+				n = path[i].isIndex ? doc->child(n, path[i].index) : doc->member(n, path[i].key);
+			line = "[\"set\",";
+			jsonPathToString(doc.get(), path, len, line);
+			line += ',';
+			if(n != pofJSONDoc::NONE) doc->serialize(n, line, false);
+			else line += "null";
+		}
+		line += ']';
+		journal->push(JSONJournal::LINE, line);
+	}
+
+	// every edit leaves the old copies of its path behind; get rid of them from time to time.
+	if(doc->numNodes() > 2 * liveNodes + 65536) {
+		std::shared_ptr<pofJSONDoc> compact(new pofJSONDoc());
+		doc->compactTo(*compact);
+		docMutex.lock();
+		doc = compact;
+		docMutex.unlock();
+		liveNodes = doc->numNodes();
+	}
+	return true;
+}
+
+//------------------------------------------//
+// Save : a snapshot of the document is serialized and written by a thread (the next edit will work on a copy).
+
+class JSONSaver: public ofThread {
+	public :
+	pofJSONSnapshot snapshot;
+	t_symbol *file;
+	string path;
+	pofJSON* pjson;
+
+	JSONSaver(t_symbol *f, const string &p, pofJSON *pj) : file(f), path(p), pjson(pj) {}
+
+	bool save() {
+		string out;
+		if(snapshot->root() != pofJSONDoc::NONE) snapshot->serialize(snapshot->root(), out);
+		out += '\n';
+		string tmp = path + ".tmp";
+		FILE *f = fopen(tmp.c_str(), "wb");
+		if(!f) return false;
+		bool ok = (fwrite(out.c_str(), 1, out.size(), f) == out.size());
+		syncFile(f);
+		fclose(f);
+		// replace the file only once the new one is complete:
+		return ok && ofFile::moveFromTo(tmp, path, false, true);
+	}
+
+	void threadedFunction() {
+		t_atom at[3];
+
+		bool ok = save();
+		snapshot.reset(); // let the next edits work in place again
+
+		SETSYMBOL(&at[0], s_out);
+		SETSYMBOL(&at[1], ok ? s_saved : s_errsave);
+		SETSYMBOL(&at[2], file);
+		pjson->queueToSelfPd(3, at);
+	}
+};
 
 class JSONLoader: public ofThread {
 	public :
     t_symbol *file, *fullfile;
     pofJSON* pjson;
     bool valid;
+    pofJSONDoc *doc; // parsed document, waiting to be installed by the Pd thread
     
-	JSONLoader(t_symbol *f, t_symbol *ff, pofJSON* pj) : file(f), fullfile(ff), pjson(pj), valid(true) {}
+	JSONLoader(t_symbol *f, t_symbol *ff, pofJSON* pj) : file(f), fullfile(ff), pjson(pj), valid(true), doc(NULL) {}
+	~JSONLoader() {
+		if(doc) delete doc;
+	}
+
+	pofJSONDoc *takeDoc() {
+		pofJSONDoc *d = doc;
+		doc = NULL;
+		return d;
+	}
+
+	bool load() {
+		if(!fullfile) return false;
+		pofJSONDoc *d = new pofJSONDoc();
+		bool ok;
+		if(!strncmp(fullfile->s_name, "http", strlen("http"))) {
+			ofHttpResponse response = ofLoadURL(fullfile->s_name);
+			ok = (response.status == 200) && d->parseBuffer(response.data.getData(), response.data.size());
+		}
+		else {
+			string path = ofToDataPath(fullfile->s_name);
+			ok = d->parseFile(path);
+			if(ok) { // replay the edits not saved yet
+				replayJournal(d, path + ".journal.old");
+				replayJournal(d, path + ".journal");
+			}
+		}
+
+		if(ok) doc = d;
+		else {
+			ofLogError("pofjson") << fullfile->s_name << ": " << d->getError();
+			delete d;
+		}
+		return ok;
+	}
+
 	void threadedFunction(){
 		t_atom at[3];
 		
 		SETSYMBOL(&at[0], s_out);
 		SETSYMBOL(&at[2], file);
 	
-		if(fullfile && pjson->sjson->load(fullfile)) SETSYMBOL(&at[1], s_loaded);
+		if(load()) SETSYMBOL(&at[1], s_loaded);
 		else SETSYMBOL(&at[1], s_errload);
 	
 		if(valid) pjson->queueToSelfPd(3, at);
@@ -47,6 +409,10 @@ void pofjson_free(void *x)
 		px->loader->waitForThread(true);
 		delete px->loader;
 	}
+	if(px->saver) {
+		px->saver->waitForThread(true);
+		delete px->saver;
+	}
 	delete (pofJSON*)(((PdObject*)x)->parent);
 }
 
@@ -54,8 +420,15 @@ void pofjson_out(void *x, t_symbol *s, int argc, t_atom *argv)
 {
 	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);
 
-	if((argc>1) && argv->a_type == A_SYMBOL)
-		outlet_anything(px->m_out1, atom_getsymbol(argv), argc-1, argv+1);
+	if((argc>1) && argv->a_type == A_SYMBOL) {
+		t_symbol *msg = atom_getsymbol(argv);
+		// install the document parsed by the loader, from the Pd thread:
+		if((msg == s_loaded || msg == s_errload) && px->loader)
+			px->sjson->setDoc(px->loader->takeDoc(), px->loader->fullfile);
+		else if(msg == s_saved && px->saver && px->saver->file == px->sjson->file)
+			px->sjson->dropOldJournal();
+		outlet_anything(px->m_out1, msg, argc-1, argv+1);
+	}
 }
 
 void pofjson_load(void *x, t_symbol *file)
@@ -86,33 +459,136 @@ void pofjson_cancel(void *x) // abort current loading
 void pofjson_getsize(void *x, t_symbol *s, int argc, t_atom *argv)
 {
 	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);	
-	ofxJSONElement json = px->sjson->get(argc, argv);
+	pofsubJSON *sjson = px->sjson;
+	pofJSONDoc::Id js = sjson->get(argc, argv);
 	
-	if(!json.empty()) outlet_float(px->m_out1, json.size());
+	if(js == pofJSONDoc::NONE || sjson->doc->type(js) == pofJSONDoc::NUL) return;
+	unsigned int size = sjson->doc->size(js);
+	if(size || (sjson->doc->type(js) != pofJSONDoc::ARRAY && sjson->doc->type(js) != pofJSONDoc::OBJECT))
+		outlet_float(px->m_out1, size);
 }
 
 void pofjson_getf(void *x, t_symbol *s, int argc, t_atom *argv)
 {
 	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);
-	ofxJSONElement json = px->sjson->get(argc, argv);
+	pofsubJSON *sjson = px->sjson;
+	pofJSONDoc::Id js = sjson->get(argc, argv);
 	
-	if((!json.empty()) && json.isConvertibleTo(Json::realValue))
-		outlet_float(px->m_out1, json.asFloat());
+	if(js == pofJSONDoc::NONE) return;
+	const pofJSONDoc::Node &node = sjson->doc->node(js);
+	if(node.type == pofJSONDoc::NUMBER || node.type == pofJSONDoc::BOOLEAN)
+		outlet_float(px->m_out1, node.number);
+}
+
+// convert a node to an atom: numbers to floats, strings to symbols, containers to their JSON text.
+static void pofjson_toatom(pofsubJSON *sjson, pofJSONDoc::Id js, t_atom *at)
+{
+	pofJSONDoc *doc = sjson->doc.get();
+	const pofJSONDoc::Node &node = doc->node(js);
+	string str;
+
+	switch(node.type) {
+		case pofJSONDoc::NUMBER: SETFLOAT(at, node.number); break;
+		case pofJSONDoc::STRING: SETSYMBOL(at, sjson->getSymbol(node.string)); break;
+		case pofJSONDoc::BOOLEAN: SETSYMBOL(at, gensym(node.number ? "true" : "false")); break;
+		case pofJSONDoc::NUL: SETSYMBOL(at, gensym("null")); break;
+		default:
+			doc->serialize(js, str);
+			SETSYMBOL(at, gensym(str.c_str()));
+	}
 }
 
 void pofjson_gets(void *x, t_symbol *s, int argc, t_atom *argv)
 {
 	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);
-	ofxJSONElement json = px->sjson->get(argc, argv);
+	pofsubJSON *sjson = px->sjson;
+	pofJSONDoc::Id js = sjson->get(argc, argv);
+	
+	if(js == pofJSONDoc::NONE) return;
+	pofJSONDoc::Type type = sjson->doc->type(js);
+	if(type == pofJSONDoc::NUL || ((type == pofJSONDoc::ARRAY || type == pofJSONDoc::OBJECT) && !sjson->doc->size(js)))
+		return;
+
+	if(type == pofJSONDoc::NUMBER) {
+		string str;
+		pofJSONDoc::numberToString(sjson->doc->node(js).number, str);
+		outlet_symbol(px->m_out1, gensym(str.c_str()));
+	} else {
+		t_atom at;
+		pofjson_toatom(sjson, js, &at);
+		outlet_symbol(px->m_out1, atom_getsymbol(&at));
+	}
+}
 
+// output a whole array (or the values of an object) as a single list.
+void pofjson_getall(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);
+	pofsubJSON *sjson = px->sjson;
+	pofJSONDoc::Id js = sjson->get(argc, argv);
 	
-	if(!json.empty()) {
-		if(json.isConvertibleTo(Json::stringValue))	{
-			t_symbol *s = gensym(json.asString().c_str());
-			outlet_symbol(px->m_out1, gensym(json.asString().c_str()));
+	if(js == pofJSONDoc::NONE) return;
+	pofJSONDoc::Type type = sjson->doc->type(js);
+	if(type != pofJSONDoc::ARRAY && type != pofJSONDoc::OBJECT) return;
+
+	unsigned int size = sjson->doc->size(js);
+	t_atom *list = (t_atom *)getbytes(size * sizeof(t_atom));
+	for(unsigned int i = 0; i < size; i++) pofjson_toatom(sjson, sjson->doc->child(js, i), &list[i]);
+	outlet_list(px->m_out1, &s_list, size, list);
+	freebytes(list, size * sizeof(t_atom));
+}
+
+void pofjson_set(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);
+	px->sjson->edit(pofJSONDoc::SET, argc, argv);
+}
+
+void pofjson_append(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);
+	px->sjson->edit(pofJSONDoc::APPEND, argc, argv);
+}
+
+void pofjson_remove(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);
+	px->sjson->edit(pofJSONDoc::REMOVE, argc, argv);
+}
+
+void pofjson_journal(void *x, t_float on)
+{
+	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);
+	px->sjson->setJournal(on != 0);
+}
+
+void pofjson_save(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofJSON* px= (pofJSON*)(((PdObject*)x)->parent);
+	pofsubJSON *sjson = px->sjson;
+	t_symbol *file = sjson->file;
+
+	if(argc && argv->a_type == A_SYMBOL) {
+		t_symbol *f = atom_getsymbol(argv);
+		if(ofFilePath::isAbsolute(f->s_name)) file = f;
+		else file = gensym((string(canvas_getdir(px->pdcanvas)->s_name) + "/" + f->s_name).c_str());
+	}
+	if(!file || !sjson->doc) {
+		pd_error(x, "pofjson: nothing to save");
+		return;
+	}
+
+	if(px->saver) {
+		if(px->saver->isThreadRunning()) {
+			outlet_anything(px->m_out1, gensym("error_running"), 0, NULL);
+			return;
 		}
-		else outlet_symbol(px->m_out1, gensym(json.getRawString().c_str()));
+		delete px->saver;
 	}
+	px->saver = new JSONSaver(file, ofToDataPath(file->s_name), px);
+	px->saver->snapshot = sjson->snapshot();
+	if(file == sjson->file) sjson->rotateJournal(); // edits made from now on go to a new journal
+	px->saver->startThread();
 }
 
 void pofJSON::setup(void)
@@ -122,6 +598,13 @@ void pofJSON::setup(void)
 	s_out = gensym("out");
 	s_errload = gensym("error_loading");
 	s_loaded = gensym("loaded");
+	s_saved = gensym("saved");
+	s_errsave = gensym("error_saving");
+	s_true = gensym("_true_");
+	s_false = gensym("_false_");
+	s_null = gensym("_null_");
+	s_array = gensym("_array_");
+	s_object = gensym("_object_");
 	
 	pofjson_class = class_new(gensym("pofjson"), (t_newmethod)pofjson_new, (t_method)pofjson_free,
 		sizeof(PdObject), 0, A_SYMBOL, A_NULL);
@@ -131,6 +614,12 @@ void pofJSON::setup(void)
 	class_addmethod(pofjson_class, (t_method)pofjson_getf, gensym("getf"), A_GIMME, A_NULL);
 	class_addmethod(pofjson_class, (t_method)pofjson_gets, gensym("gets"), A_GIMME, A_NULL);
 	class_addmethod(pofjson_class, (t_method)pofjson_getsize, gensym("getsize"), A_GIMME, A_NULL);
+	class_addmethod(pofjson_class, (t_method)pofjson_getall, gensym("getall"), A_GIMME, A_NULL);
+	class_addmethod(pofjson_class, (t_method)pofjson_set, gensym("set"), A_GIMME, A_NULL);
+	class_addmethod(pofjson_class, (t_method)pofjson_append, gensym("append"), A_GIMME, A_NULL);
+	class_addmethod(pofjson_class, (t_method)pofjson_remove, gensym("remove"), A_GIMME, A_NULL);
+	class_addmethod(pofjson_class, (t_method)pofjson_save, gensym("save"), A_GIMME, A_NULL);
+	class_addmethod(pofjson_class, (t_method)pofjson_journal, gensym("journal"), A_FLOAT, A_NULL);
 }
 
 
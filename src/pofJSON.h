@@ -6,7 +6,11 @@
 #pragma once
 
 #include "pofBase.h"
-#include "ofxJSON.h"
+#include "pofJSONDoc.h"
+
+#define JSON_PATH_CACHE_SIZE 4096
+
+class JSONJournal;
 
 class pofsubJSON {
 
@@ -14,55 +18,83 @@ class pofsubJSON {
 	t_symbol *name;
 	
 	static std::map<t_symbol*,pofsubJSON*> jsons;
+	static ofMutex jsonsMutex; // protects jsons against getSnapshot() from other threads
+	ofMutex docMutex; // protects the doc pointer (not the document itself)
 
-	ofMutex mutex;
+	std::map<string, pofJSONDoc::Id> pathCache; // atom path -> node
+	vector<t_symbol*> symbols; // string id -> symbol, filled on demand
+
+	unsigned int liveNodes; // number of nodes after the last load or compaction
 
 	public:
-	ofxJSONElement json;
-	bool loaded;
+	// current version of the document, modified by the Pd thread only (loaders parse into their own
+	// document). While a snapshot of it is held elsewhere, the next edit works on a copy.
+	std::shared_ptr<pofJSONDoc> doc;
+	t_symbol *file; // file the document was loaded from
+	JSONJournal *journal; // when not NULL, every edit is appended to file.journal
 	
-	pofsubJSON(t_symbol *n):refCount(1), name(n), loaded(false){
+	pofsubJSON(t_symbol *n):refCount(1), name(n), liveNodes(0), file(NULL), journal(NULL){
+		jsonsMutex.lock();
 		jsons[n] = this;
+		jsonsMutex.unlock();
 	}
 	
-	~pofsubJSON() {
-		jsons.erase(name);
-	}
+	~pofsubJSON();
 	
-	bool load(t_symbol *file) {
-		mutex.lock();
-		loaded = false;
-		mutex.unlock();
-		
-		if(json.open(file->s_name)) {
-			mutex.lock();
-			loaded = true;
-			mutex.unlock();
-			return true;
-		} else {
-			//mutex.unlock();
-			return false;
-		}
+	void setDoc(pofJSONDoc *d, t_symbol *f = NULL);
+	bool edit(pofJSONDoc::Op op, int argc, t_atom *argv); // set/append/remove from Pd atoms
+	void setJournal(bool on);
+	void rotateJournal(); // called when a snapshot of the document is being saved to file
+	void dropOldJournal(); // called when this snapshot has been saved
+
+	// get the current version of the document; can be called from any thread.
+	pofJSONSnapshot snapshot() {
+		docMutex.lock();
+		pofJSONSnapshot s = doc;
+		docMutex.unlock();
+		return s;
 	}
+	// snapshot of the document of this name (empty if there's no such pofjson); any thread.
+	static pofJSONSnapshot getSnapshot(const string &name);
 
-	ofxJSONElement get(int argc, t_atom *argv)
+	t_symbol *getSymbol(pofJSONDoc::Id s) {
+		if(!symbols[s]) symbols[s] = gensym(doc->str(s));
+		return symbols[s];
+	}
+
+	pofJSONDoc::Id get(int argc, t_atom *argv)
 	{
-		if(!loaded) return ofxJSONElement();
-		ofxJSONElement js = json;
-		
-		try {
-			while(argc>0) {
-				if(js.empty()) return ofxJSONElement();
-				if(argv->a_type == A_SYMBOL) js = js[atom_getsymbol(argv)->s_name];
-				else if(argv->a_type == A_FLOAT) {
-					if(!js.isArray()) return ofxJSONElement();
-					else js = js[(unsigned int)atom_getfloat(argv)];
-				}
-				argc--; argv++;
+		if(!doc) return pofJSONDoc::NONE;
+
+		// the key of the path cache is made of the atoms themselves (symbols are unique pointers).
+		string key;
+		for(int i = 0; i < argc; i++) {
+			if(argv[i].a_type == A_SYMBOL) {
+				t_symbol *s = atom_getsymbol(&argv[i]);
+				key += 's';
+				key.append((const char*)&s, sizeof(s));
+			} else {
+				int index = atom_getfloat(&argv[i]);
+				key += 'f';
+				key.append((const char*)&index, sizeof(index));
 			}
-			return js;	
 		}
-		catch (int e) { return ofxJSONElement(); }
+		std::map<string, pofJSONDoc::Id>::iterator it = pathCache.find(key);
+		if(it != pathCache.end()) return it->second;
+
+		pofJSONDoc::Id js = doc->root();
+		while(argc>0 && js != pofJSONDoc::NONE) {
+			if(argv->a_type == A_SYMBOL) js = doc->member(js, doc->findString(atom_getsymbol(argv)->s_name));
+			else if(argv->a_type == A_FLOAT) {
+				if(doc->type(js) != pofJSONDoc::ARRAY) js = pofJSONDoc::NONE;
+				else js = doc->child(js, (unsigned int)atom_getfloat(argv));
+			}
+			argc--; argv++;
+		}
+
+		if(pathCache.size() >= JSON_PATH_CACHE_SIZE) pathCache.clear();
+		pathCache[key] = js;
+		return js;
 	}
 		
 	static pofsubJSON* getJSON(t_symbol *name){
@@ -85,10 +117,11 @@ class pofsubJSON {
 };
 
 class JSONLoader;
+class JSONSaver;
 
 class pofJSON: public pofBase {
 	public:
-		pofJSON(t_class *Class, t_symbol *n):pofBase(Class), loader(NULL) {
+		pofJSON(t_class *Class, t_symbol *n):pofBase(Class), loader(NULL), saver(NULL) {
 				sjson = pofsubJSON::getJSON(n);
 		}
 		
@@ -100,6 +133,7 @@ class pofJSON: public pofBase {
 			
 		pofsubJSON *sjson;
 		JSONLoader *loader;
+		JSONSaver *saver;
 		t_canvas *pdcanvas;
 };
 
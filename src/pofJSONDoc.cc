@@ -0,0 +1,613 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#include "pofJSONDoc.h"
+
+#define JSON_READ_CHUNK 65536
+#define JSON_MAX_DEPTH 512
+
+// Character source: either a file read by chunks, or a memory buffer.
+class pofJSONDoc::Reader {
+	public:
+	FILE *file;
+	vector<char> buf;
+	const char *p, *end;
+	unsigned int line;
+
+	Reader(FILE *f) : file(f), p(NULL), end(NULL), line(1) { buf.resize(JSON_READ_CHUNK); }
+	Reader(const char *data, size_t len) : file(NULL), p(data), end(data + len), line(1) {}
+
+	bool fill() {
+		if(!file) return false;
+		size_t len = fread(&buf[0], 1, buf.size(), file);
+		p = &buf[0];
+		end = p + len;
+		return len > 0;
+	}
+	int peek() {
+		if(p == end && !fill()) return EOF;
+		return (unsigned char)*p;
+	}
+	int get() {
+		if(p == end && !fill()) return EOF;
+		if(*p == '\n') line++;
+		return (unsigned char)*p++;
+	}
+	void skipSpaces() {
+		int c;
+		while((c = peek()) == ' ' || c == '\t' || c == '\n' || c == '\r') get();
+	}
+};
+
+bool pofJSONDoc::parseFile(const string &path)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if(!f) return fail("can't open " + path);
+	Reader r(f);
+	bool ok = parse(r);
+	fclose(f);
+	return ok;
+}
+
+bool pofJSONDoc::parseBuffer(const char *data, size_t len)
+{
+	Reader r(data, len);
+	return parse(r);
+}
+
+bool pofJSONDoc::parse(Reader &r)
+{
+	nodes.clear();
+	links.clear();
+	stringData.clear();
+	stringOffsets.clear();
+	stringTable.clear();
+	error.clear();
+	rootId = NONE;
+
+	if(parseValue(r, 0) == NONE) return false;
+	r.skipSpaces();
+	if(r.peek() != EOF) return fail("extra characters at line " + ofToString(r.line));
+	rootId = 0;
+
+	nodes.shrink_to_fit();
+	links.shrink_to_fit();
+	stringData.shrink_to_fit();
+	stringOffsets.shrink_to_fit();
+	return true;
+}
+
+bool pofJSONDoc::fail(const string &msg)
+{
+	if(error.empty()) error = msg;
+	return false;
+}
+
+pofJSONDoc::Id pofJSONDoc::newNode(Type t)
+{
+	Node n;
+	n.type = t;
+	n.size = 0;
+	n.number = 0;
+	nodes.push_back(n);
+	return nodes.size() - 1;
+}
+
+static size_t hashString(const char *s, size_t len)
+{
+	size_t h = 2166136261u; // FNV-1a
+	for(size_t i = 0; i < len; i++) h = (h ^ (unsigned char)s[i]) * 16777619u;
+	return h;
+}
+
+bool pofJSONDoc::sameString(Id id, const char *s, size_t len) const
+{
+	const char *stored = str(id);
+	return !memcmp(stored, s, len) && stored[len] == 0;
+}
+
+void pofJSONDoc::rehashStrings(size_t tableSize)
+{
+	stringTable.assign(tableSize, (Id)NONE);
+	size_t mask = tableSize - 1;
+	for(Id id = 0; id < stringOffsets.size(); id++) {
+		size_t i = hashString(str(id), strlen(str(id))) & mask;
+		while(stringTable[i] != NONE) i = (i + 1) & mask;
+		stringTable[i] = id;
+	}
+}
+
+pofJSONDoc::Id pofJSONDoc::intern(const string &s)
+{
+	size_t len = strlen(s.c_str()); // the strings are stored 0-terminated
+	if(stringTable.empty()) rehashStrings(64);
+	size_t mask = stringTable.size() - 1;
+	size_t i = hashString(s.c_str(), len) & mask;
+	while(stringTable[i] != NONE) {
+		if(sameString(stringTable[i], s.c_str(), len)) return stringTable[i];
+		i = (i + 1) & mask;
+	}
+
+	Id id = stringOffsets.size();
+	stringOffsets.push_back(stringData.size());
+	stringData.insert(stringData.end(), s.c_str(), s.c_str() + len);
+	stringData.push_back(0);
+	stringTable[i] = id;
+	if(stringOffsets.size() * 2 > stringTable.size()) rehashStrings(stringTable.size() * 2);
+	return id;
+}
+
+pofJSONDoc::Id pofJSONDoc::findString(const char *s) const
+{
+	if(stringTable.empty()) return NONE;
+	size_t len = strlen(s), mask = stringTable.size() - 1;
+	size_t i = hashString(s, len) & mask;
+	while(stringTable[i] != NONE) {
+		if(sameString(stringTable[i], s, len)) return stringTable[i];
+		i = (i + 1) & mask;
+	}
+	return NONE;
+}
+
+static void appendUTF8(string &s, unsigned int c)
+{
+	if(c < 0x80) s += (char)c;
+	else if(c < 0x800) {
+		s += (char)(0xC0 | (c >> 6));
+		s += (char)(0x80 | (c & 0x3F));
+	} else if(c < 0x10000) {
+		s += (char)(0xE0 | (c >> 12));
+		s += (char)(0x80 | ((c >> 6) & 0x3F));
+		s += (char)(0x80 | (c & 0x3F));
+	} else {
+		s += (char)(0xF0 | (c >> 18));
+		s += (char)(0x80 | ((c >> 12) & 0x3F));
+		s += (char)(0x80 | ((c >> 6) & 0x3F));
+		s += (char)(0x80 | (c & 0x3F));
+	}
+}
+
+bool pofJSONDoc::readHex4(Reader &r, unsigned int &code)
+{
+	code = 0;
+	for(int i = 0; i < 4; i++) {
+		int h = r.get();
+		code <<= 4;
+		if(h >= '0' && h <= '9') code += h - '0';
+		else if(h >= 'a' && h <= 'f') code += h - 'a' + 10;
+		else if(h >= 'A' && h <= 'F') code += h - 'A' + 10;
+		else return fail("bad unicode escape at line " + ofToString(r.line));
+	}
+	return true;
+}
+
+bool pofJSONDoc::parseString(Reader &r, string &s)
+{
+	s.clear();
+	r.get(); // opening quote
+	while(true) {
+		int c = r.get();
+		if(c == EOF) return fail("unterminated string at line " + ofToString(r.line));
+		if(c == '"') return true;
+		if(c != '\\') {
+			s += (char)c;
+			continue;
+		}
+		c = r.get();
+		switch(c) {
+			case '"': s += '"'; break;
+			case '\\': s += '\\'; break;
+			case '/': s += '/'; break;
+			case 'b': s += '\b'; break;
+			case 'f': s += '\f'; break;
+			case 'n': s += '\n'; break;
+			case 'r': s += '\r'; break;
+			case 't': s += '\t'; break;
+			case 'u': {
+				unsigned int code, low;
+				if(!readHex4(r, code)) return false;
+				if(code >= 0xD800 && code < 0xDC00) { // surrogate pair
+					if(r.get() != '\\' || r.get() != 'u' || !readHex4(r, low))
+						return fail("bad surrogate pair at line " + ofToString(r.line));
+					code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+				}
+				appendUTF8(s, code);
+				break;
+			}
+			default: return fail("bad escape sequence at line " + ofToString(r.line));
+		}
+	}
+}
+
+pofJSONDoc::Id pofJSONDoc::parseValue(Reader &r, int depth)
+{
+	if(depth > JSON_MAX_DEPTH) {
+		fail("too deep nesting at line " + ofToString(r.line));
+		return NONE;
+	}
+	r.skipSpaces();
+	int c = r.peek();
+
+	if(c == '{' || c == '[') {
+		bool isObject = (c == '{');
+		int close = isObject ? '}' : ']';
+		Id self = newNode(isObject ? OBJECT : ARRAY);
+		vector<Id> children; // children of a container are gathered, then stored contiguously
+		string key;
+
+		r.get();
+		r.skipSpaces();
+		if(r.peek() == close) r.get();
+		else while(true) {
+			if(isObject) {
+				r.skipSpaces();
+				if(r.peek() != '"') {
+					fail("object key expected at line " + ofToString(r.line));
+					return NONE;
+				}
+				if(!parseString(r, key)) return NONE;
+				children.push_back(intern(key));
+				r.skipSpaces();
+				if(r.get() != ':') {
+					fail("':' expected at line " + ofToString(r.line));
+					return NONE;
+				}
+			}
+			Id value = parseValue(r, depth + 1);
+			if(value == NONE) return NONE;
+			children.push_back(value);
+			r.skipSpaces();
+			c = r.get();
+			if(c == close) break;
+			if(c != ',') {
+				fail("',' expected at line " + ofToString(r.line));
+				return NONE;
+			}
+		}
+		nodes[self].first = links.size();
+		nodes[self].size = isObject ? children.size() / 2 : children.size();
+		links.insert(links.end(), children.begin(), children.end());
+		return self;
+	}
+
+	if(c == '"') {
+		string s;
+		if(!parseString(r, s)) return NONE;
+		Id n = newNode(STRING);
+		nodes[n].string = intern(s);
+		return n;
+	}
+
+	if(c == 't' || c == 'f' || c == 'n') {
+		string word;
+		while((c = r.peek()) >= 'a' && c <= 'z') word += (char)r.get();
+		if(word == "true" || word == "false") {
+			Id n = newNode(BOOLEAN);
+			nodes[n].number = (word == "true");
+			return n;
+		}
+		if(word == "null") return newNode(NUL);
+		fail("unknown literal '" + word + "' at line " + ofToString(r.line));
+		return NONE;
+	}
+
+	if(c == '-' || (c >= '0' && c <= '9')) {
+		char num[64];
+		unsigned int len = 0;
+		while(((c = r.peek()) >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' || c == 'e' || c == 'E') {
+			if(len < sizeof(num) - 1) num[len++] = (char)c;
+			r.get();
+		}
+		num[len] = 0;
+		char *numEnd;
+		double d = strtod(num, &numEnd);
+		if(numEnd != num + len) {
+			fail("bad number at line " + ofToString(r.line));
+			return NONE;
+		}
+		Id n = newNode(NUMBER);
+		nodes[n].number = d;
+		return n;
+	}
+
+	if(c == EOF) fail("unexpected end of file");
+	else fail("unexpected character at line " + ofToString(r.line));
+	return NONE;
+}
+
+pofJSONDoc::Id pofJSONDoc::child(Id n, unsigned int i) const
+{
+	const Node &node = nodes[n];
+	if(i >= node.size) return NONE;
+	if(node.type == ARRAY) return links[node.first + i];
+	if(node.type == OBJECT) return links[node.first + 2 * i + 1];
+	return NONE;
+}
+
+pofJSONDoc::Id pofJSONDoc::key(Id n, unsigned int i) const
+{
+	const Node &node = nodes[n];
+	if(node.type != OBJECT || i >= node.size) return NONE;
+	return links[node.first + 2 * i];
+}
+
+pofJSONDoc::Id pofJSONDoc::member(Id n, Id key) const
+{
+	const Node &node = nodes[n];
+	if(node.type != OBJECT || key == NONE || node.size == 0) return NONE;
+	const Id *l = &links[node.first];
+	for(unsigned int i = 0; i < node.size; i++) {
+		if(l[2 * i] == key) return l[2 * i + 1];
+	}
+	return NONE;
+}
+
+//---------------- editing ----------------
+
+pofJSONDoc::Id pofJSONDoc::newString(const char *s)
+{
+	Id n = newNode(STRING);
+	nodes[n].string = intern(s);
+	return n;
+}
+
+pofJSONDoc::Id pofJSONDoc::newNumber(double d)
+{
+	Id n = newNode(NUMBER);
+	nodes[n].number = d;
+	return n;
+}
+
+pofJSONDoc::Id pofJSONDoc::newBool(bool b)
+{
+	Id n = newNode(BOOLEAN);
+	nodes[n].number = b;
+	return n;
+}
+
+pofJSONDoc::Id pofJSONDoc::newArray()
+{
+	Id n = newNode(ARRAY);
+	nodes[n].first = links.size();
+	return n;
+}
+
+pofJSONDoc::Id pofJSONDoc::newObject()
+{
+	Id n = newNode(OBJECT);
+	nodes[n].first = links.size();
+	return n;
+}
+
+pofJSONDoc::Id pofJSONDoc::parseText(const char *data, size_t len)
+{
+	Reader r(data, len);
+	error.clear();
+	Id n = parseValue(r, 0);
+	if(n == NONE) return NONE;
+	r.skipSpaces();
+	if(r.peek() != EOF) {
+		fail("extra characters");
+		return NONE;
+	}
+	return n;
+}
+
+// Copy of array n with element i set to value (the array is extended with nulls if needed).
+pofJSONDoc::Id pofJSONDoc::withChild(Id n, unsigned int i, Id value)
+{
+	Node old = nodes[n];
+	Id copy = newNode(ARRAY);
+
+	if(i >= old.size && old.first + old.size == links.size()) {
+		// n's children are at the end of links: extend them in place, n still sees its own elements.
+		Id null = (i > old.size) ? newNode(NUL) : NONE;
+		while(links.size() < old.first + i) links.push_back(null);
+		links.push_back(value);
+		nodes[copy].first = old.first;
+	} else {
+		nodes[copy].first = links.size();
+		for(unsigned int j = 0; j < old.size; j++) links.push_back(links[old.first + j]);
+		if(i < old.size) links[nodes[copy].first + i] = value;
+		else {
+			Id null = (i > old.size) ? newNode(NUL) : NONE;
+			for(unsigned int j = old.size; j < i; j++) links.push_back(null);
+			links.push_back(value);
+		}
+	}
+	nodes[copy].size = MAX(old.size, i + 1);
+	return copy;
+}
+
+// Copy of object n with member key set to value (added at the end if missing).
+pofJSONDoc::Id pofJSONDoc::withMember(Id n, Id key, Id value)
+{
+	Node old = nodes[n];
+	Id copy = newNode(OBJECT);
+	unsigned int i;
+
+	for(i = 0; i < old.size; i++) if(links[old.first + 2 * i] == key) break;
+
+	if(i == old.size && old.first + 2 * old.size == links.size()) { // extend in place
+		nodes[copy].first = old.first;
+	} else {
+		nodes[copy].first = links.size();
+		for(unsigned int j = 0; j < 2 * old.size; j++) links.push_back(links[old.first + j]);
+	}
+	if(i < old.size) links[nodes[copy].first + 2 * i + 1] = value;
+	else {
+		links.push_back(key);
+		links.push_back(value);
+	}
+	nodes[copy].size = (i < old.size) ? old.size : old.size + 1;
+	return copy;
+}
+
+// Copy of container n without its i-th child.
+pofJSONDoc::Id pofJSONDoc::without(Id n, unsigned int i)
+{
+	Node old = nodes[n];
+	unsigned int width = (old.type == OBJECT) ? 2 : 1;
+	Id copy = newNode((Type)old.type);
+
+	nodes[copy].first = links.size();
+	for(unsigned int j = 0; j < width * old.size; j++) {
+		if(j / width != i) links.push_back(links[old.first + j]);
+	}
+	nodes[copy].size = old.size - 1;
+	return copy;
+}
+
+pofJSONDoc::Id pofJSONDoc::apply(Id n, Op op, const Step *path, int len, Id value, unsigned int *index)
+{
+	if(len == 0) {
+		if(op == SET) return value;
+		if(op == APPEND) {
+			if(n == NONE || type(n) != ARRAY) n = newArray();
+			if(index) *index = nodes[n].size;
+			return withChild(n, nodes[n].size, value);
+		}
+		return n;
+	}
+
+	Id child;
+	if(path->isIndex) {
+		if(n == NONE || type(n) != ARRAY) {
+			if(op == REMOVE) return n;
+			n = newArray();
+		}
+		if(op == REMOVE && len == 1) return (path->index < nodes[n].size) ? without(n, path->index) : n;
+		child = this->child(n, path->index);
+		Id newChild = apply(child, op, path + 1, len - 1, value, index);
+		if(newChild == child) return n;
+		return withChild(n, path->index, newChild);
+	} else {
+		if(n == NONE || type(n) != OBJECT) {
+			if(op == REMOVE) return n;
+			n = newObject();
+		}
+		if(op == REMOVE && len == 1) {
+			for(unsigned int i = 0; i < nodes[n].size; i++)
+				if(key(n, i) == path->key) return without(n, i);
+			return n;
+		}
+		child = member(n, path->key);
+		Id newChild = apply(child, op, path + 1, len - 1, value, index);
+		if(newChild == child) return n;
+		return withMember(n, path->key, newChild);
+	}
+}
+
+bool pofJSONDoc::apply(Op op, const vector<Step> &path, Id value, unsigned int *index)
+{
+	if(op != REMOVE && value == NONE) return false;
+	Id newRoot = apply(rootId, op, path.empty() ? NULL : &path[0], path.size(), value, index);
+	if(newRoot == rootId) return false;
+	rootId = newRoot;
+	return true;
+}
+
+pofJSONDoc::Id pofJSONDoc::copyNode(const pofJSONDoc &src, Id n)
+{
+	Node node = src.nodes[n];
+	Id self = nodes.size();
+	nodes.push_back(node); // scalars are copied as is (string ids are kept)
+
+	if(node.type == ARRAY || node.type == OBJECT) {
+		bool isObject = (node.type == OBJECT);
+		vector<Id> children;
+		children.reserve(isObject ? 2 * node.size : node.size);
+		for(unsigned int i = 0; i < node.size; i++) {
+			if(isObject) children.push_back(src.key(n, i));
+			children.push_back(copyNode(src, src.child(n, i)));
+		}
+		nodes[self].first = links.size();
+		nodes[self].size = node.size;
+		links.insert(links.end(), children.begin(), children.end());
+	}
+	return self;
+}
+
+void pofJSONDoc::compactTo(pofJSONDoc &dst) const
+{
+	dst.nodes.clear();
+	dst.links.clear();
+	dst.stringData = stringData;
+	dst.stringOffsets = stringOffsets;
+	dst.stringTable = stringTable;
+	dst.error.clear();
+	dst.rootId = (rootId == NONE) ? NONE : dst.copyNode(*this, rootId);
+}
+
+//---------------- serialization ----------------
+
+void pofJSONDoc::escapeString(const char *s, string &out)
+{
+	out += '"';
+	for(; *s; s++) {
+		unsigned char c = *s;
+		switch(c) {
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\b': out += "\\b"; break;
+			case '\f': out += "\\f"; break;
+			case '\n': out += "\\n"; break;
+			case '\r': out += "\\r"; break;
+			case '\t': out += "\\t"; break;
+			default:
+				if(c < 0x20) {
+					char buf[8];
+					snprintf(buf, 8, "\\u%04x", c);
+					out += buf;
+				}
+				else out += (char)c;
+		}
+	}
+	out += '"';
+}
+
+void pofJSONDoc::numberToString(double d, string &out)
+{
+	char buf[32];
+	if(!std::isfinite(d)) { out += "null"; return; } // nan and inf have no JSON form
+	if(d == floor(d) && fabs(d) < 1e15) snprintf(buf, 32, "%.0f", d);
+	else snprintf(buf, 32, "%.17g", d);
+	out += buf;
+}
+
+void pofJSONDoc::serialize(Id n, string &out, bool pretty, int indent) const
+{
+	const Node &node = nodes[n];
+
+	switch(node.type) {
+		case NUL: out += "null"; break;
+		case BOOLEAN: out += node.number ? "true" : "false"; break;
+		case NUMBER: numberToString(node.number, out); break;
+		case STRING: escapeString(str(node.string), out); break;
+		case ARRAY:
+		case OBJECT: {
+			bool isObject = (node.type == OBJECT);
+			out += isObject ? '{' : '[';
+			for(unsigned int i = 0; i < node.size; i++) {
+				if(i) out += ',';
+				if(pretty) {
+					out += '\n';
+					out.append(3 * (indent + 1), ' ');
+				}
+				if(isObject) {
+					escapeString(str(key(n, i)), out);
+					out += pretty ? " : " : ":";
+				}
+				serialize(child(n, i), out, pretty, indent + 1);
+			}
+			if(pretty && node.size) {
+				out += '\n';
+				out.append(3 * indent, ' ');
+			}
+			out += isObject ? '}' : ']';
+			break;
+		}
+	}
+}
@@ -0,0 +1,116 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#pragma once
+
+#include "ofMain.h"
+#include <memory>
+
+// Compact JSON document.
+// All the values are stored in a single node array; the children of a container are
+// stored contiguously in a links array (key/value pairs for objects), and every string
+// (keys and values) is interned once. Queries return node ids: nothing is copied.
+// Nodes are never modified once created: an edit creates new copies of the containers
+// along its path (and a new root), so previous versions stay valid until compact().
+
+class pofJSONDoc {
+	public:
+	typedef unsigned int Id;
+	static const Id NONE = (Id)-1;
+
+	enum Type { NUL = 0, BOOLEAN, NUMBER, STRING, ARRAY, OBJECT };
+
+	struct Node {
+		unsigned char type;
+		unsigned int size;	// ARRAY, OBJECT: number of children
+		union {
+			double number;	// NUMBER, BOOLEAN (0/1)
+			Id string;		// STRING: interned string id
+			Id first;		// ARRAY, OBJECT: index of the first child in links
+		};
+	};
+
+	struct Step { // path element
+		bool isIndex;
+		unsigned int index;	// array index
+		Id key;				// object key (string id)
+	};
+
+	enum Op { SET, APPEND, REMOVE };
+
+	pofJSONDoc() : rootId(NONE) {}
+
+	// Parse a file, reading it by chunks (the file is never entirely in memory).
+	bool parseFile(const string &path);
+	// Parse a memory buffer (e.g. a downloaded file).
+	bool parseBuffer(const char *data, size_t len);
+
+	const string &getError() const { return error; }
+
+	Id root() const { return rootId; }
+	const Node &node(Id n) const { return nodes[n]; }
+	Type type(Id n) const { return (Type)nodes[n].type; }
+	unsigned int size(Id n) const { return (type(n) == ARRAY || type(n) == OBJECT) ? nodes[n].size : 0; }
+
+	Id child(Id n, unsigned int i) const; // ARRAY: i-th element; OBJECT: i-th value
+	Id key(Id n, unsigned int i) const;   // OBJECT: i-th key (string id)
+	Id member(Id n, Id key) const;        // OBJECT: value for key (string id)
+
+	Id findString(const char *s) const; // string id, or NONE if s doesn't appear in the document
+	const char *str(Id s) const { return &stringData[stringOffsets[s]]; }
+	unsigned int numStrings() const { return stringOffsets.size(); }
+	unsigned int numNodes() const { return nodes.size(); }
+
+	// Editing:
+	Id newString(const char *s);
+	Id newNumber(double d);
+	Id newBool(bool b);
+	Id newNull() { return newNode(NUL); }
+	Id newArray();
+	Id newObject();
+	Id internString(const char *s) { return intern(s); }
+	// Parse a JSON text, adding its nodes to this document (the root doesn't change).
+	Id parseText(const char *data, size_t len);
+	// Apply an edit at path; missing containers are created by SET and APPEND.
+	// For APPEND, *index receives the index of the new element.
+	// Returns false if nothing changed.
+	bool apply(Op op, const vector<Step> &path, Id value = NONE, unsigned int *index = NULL);
+	// Copy the reachable nodes of this document into dst (strings are kept).
+	void compactTo(pofJSONDoc &dst) const;
+
+	void serialize(Id n, string &out, bool pretty = true, int indent = 0) const;
+	static void escapeString(const char *s, string &out);
+	static void numberToString(double d, string &out);
+
+	protected:
+	class Reader;
+	bool parse(Reader &r);
+	Id parseValue(Reader &r, int depth);
+	bool parseString(Reader &r, string &s);
+	bool readHex4(Reader &r, unsigned int &code);
+	Id intern(const string &s);
+	bool sameString(Id id, const char *s, size_t len) const;
+	void rehashStrings(size_t tableSize);
+	Id newNode(Type t);
+	bool fail(const string &msg);
+	Id apply(Id n, Op op, const Step *path, int len, Id value, unsigned int *index);
+	Id withChild(Id n, unsigned int i, Id value);
+	Id withMember(Id n, Id key, Id value);
+	Id without(Id n, unsigned int i);
+	Id copyNode(const pofJSONDoc &src, Id n);
+
+	Id rootId;
+
+	vector<Node> nodes;
+	vector<Id> links;
+	vector<char> stringData;
+	vector<unsigned int> stringOffsets;
+	vector<Id> stringTable; // open addressing hash table of the string ids (the strings aren't copied)
+	string error;
+};
+
+// A published version of a document: it isn't modified anymore while it is shared, so it can be
+// read from any thread without locking; it is deleted when its last holder releases it.
+typedef std::shared_ptr<const pofJSONDoc> pofJSONSnapshot;
@@ -4,16 +4,366 @@
  * See https://github.com/Ant1r/ofxPof for documentation and updates.
  */
 #include "pofLua.h"
-#include "ofxLua.h"
 #include "pofFonts.h"
 #include "pofFbo.h"
+#include "pofVbo.h"
+#include "pofJSON.h"
+#include "pofXMLP.h"
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <unordered_map>
+#include <fstream>
+#include <sys/stat.h>
+#include <thread>
+
+#ifdef POF_LUAJIT
+#include "luajit.h"
+#endif
+
+#define LUA_WORKERS 2
 
 t_class *pofLua_class, *pofLua_receiver_class;
 
-static ofxLua lua;
-static ofMutex luaMutex;
 static t_symbol *s_function, *s_method, *s_global, *s_receive, *s_getsym;
 static std::map<string, pofLua*> pofLuas;
+static ofMutex pofLuasMutex; // pofLuas is read from the GL and worker threads
+std::map<string, pofLuaState*> pofLuaState::states;
+
+static void pofLua_initstate(ofxLua &lua);
+static void pofLua_initscript(ofxLua &lua);
+
+extern "C" {
+	int luaopen_pof(lua_State* L);
+}
+
+// ------------ Lua states -------------
+
+pofLuaState::pofLuaState(const string &g) : refCount(1), group(g)
+{
+	static int count = 0;
+	worker = (count++) % LUA_WORKERS;
+	states[group] = this;
+	pofLua_initstate(lua);
+}
+
+pofLuaState::~pofLuaState()
+{
+	states.erase(group);
+	mutex.lock(); // wait for any thread still using the state
+	lua.clear();
+	mutex.unlock();
+}
+
+pofLuaState *pofLuaState::get(const string &group)
+{
+	std::map<string, pofLuaState*>::iterator it = states.find(group);
+	if(it != states.end()) {
+		it->second->refCount++;
+		return it->second;
+	}
+	return new pofLuaState(group);
+}
+
+void pofLuaState::let(pofLuaState *state)
+{
+	if(!--state->refCount) delete state;
+}
+
+// ------------ worker threads : run the messages of the "worker" objects -------------
+
+class pofLuaWorker: public ofThread {
+	public:
+	struct Job {
+		pofLua *obj;
+		t_binbuf *bb;
+	};
+	deque<Job> jobs;
+	pofLua *running;
+	std::mutex jobsMutex;
+	std::condition_variable cond;
+	std::atomic<std::thread::id> threadId;
+
+	pofLuaWorker() : running(NULL) {}
+
+	void push(pofLua *obj, t_binbuf *bb) {
+		Job job;
+		job.obj = obj;
+		job.bb = bb;
+		jobsMutex.lock();
+		jobs.push_back(job);
+		jobsMutex.unlock();
+		cond.notify_one();
+	}
+
+	// forget the jobs of this object, and wait until it's not running anymore.
+	void cancel(pofLua *obj) {
+		std::unique_lock<std::mutex> lock(jobsMutex);
+		for(deque<Job>::iterator it = jobs.begin(); it != jobs.end();) {
+			if(it->obj == obj) {
+				binbuf_free(it->bb);
+				it = jobs.erase(it);
+			}
+			else it++;
+		}
+		while(running == obj) cond.wait(lock);
+	}
+
+	void threadedFunction() {
+		threadId = std::this_thread::get_id();
+		std::unique_lock<std::mutex> lock(jobsMutex);
+		while(isThreadRunning()) {
+			if(jobs.empty()) {
+				cond.wait_for(lock, std::chrono::milliseconds(100));
+				continue;
+			}
+			Job job = jobs.front();
+			jobs.pop_front();
+			running = job.obj;
+			lock.unlock();
+			if(binbuf_getnatom(job.bb)) job.obj->message(binbuf_getnatom(job.bb), binbuf_getvec(job.bb));
+			binbuf_free(job.bb);
+			job.obj->trigger = true;
+			lock.lock();
+			running = NULL;
+			cond.notify_all();
+		}
+	}
+};
+
+static pofLuaWorker luaWorkers[LUA_WORKERS];
+
+// the GL functions (drawing, textures) can't be called from the worker threads.
+static bool pofLua_onWorker()
+{
+	std::thread::id id = std::this_thread::get_id();
+	for(int i = 0; i < LUA_WORKERS; i++) if(luaWorkers[i].threadId.load() == id) return true;
+	return false;
+}
+
+#define POFLUA_GL_ONLY(L, func) \
+	if(pofLua_onWorker()) return luaL_error(L, func ": only available from the drawing thread, not in a worker")
+
+void pofLua::queueToLua(t_symbol *s, int argc, t_atom *argv)
+{
+	if(!worker) {
+		queueToGUI(s, argc, argv);
+		return;
+	}
+	t_binbuf *bb = binbuf_new();
+	t_atom at;
+	SETSYMBOL(&at, s);
+	binbuf_add(bb, 1, &at);
+	binbuf_add(bb, argc, argv);
+	luaWorkers[state->worker].push(this, bb);
+}
+
+// ------------ script compiler : compiles the script files in the background -------------
+
+#define LUA_WATCH_PERIOD 500 // ms between two checks of the watched script files
+
+// A compiled script file, followed by the creation arguments of the object as one chunk (so that
+// the arguments see the locals of the file). The chunk takes (M, print) as arguments, and is shared
+// by all the objects loading the same content (bytecode can be loaded by any Lua state).
+struct pofLuaChunk {
+	string source;
+	string bytecode;
+	string error; // compilation error; bytecode is empty
+};
+typedef std::shared_ptr<const pofLuaChunk> pofLuaChunkPtr;
+
+static int pofLua_dumpWriter(lua_State *L, const void *p, size_t size, void *ud)
+{
+	((string*)ud)->append((const char*)p, size);
+	return 0;
+}
+
+class pofLuaCompiler: public ofThread {
+	struct File {
+		string path, args;
+		pofLuaChunkPtr chunk;
+		unsigned int requested, compiled; // versions
+		int watchers;
+		time_t mtime;
+		File() : requested(0), compiled(0), watchers(0), mtime(0) {}
+	};
+	std::map<string, File> files; // by path and arguments
+	std::unordered_map<size_t, std::weak_ptr<const pofLuaChunk> > cache; // by content hash (compiler thread only)
+	std::mutex mutex;
+	std::condition_variable cond;
+
+	static time_t getMTime(const string &path) {
+		struct stat st;
+		if(stat(path.c_str(), &st)) return 0;
+		return st.st_mtime;
+	}
+
+	static string key(const string &path, const string &args) { return path + '\n' + args; }
+
+	File &getFile(const string &path, const string &args) {
+		File &f = files[key(path, args)];
+		if(f.path.empty()) {
+			f.path = path;
+			f.args = args;
+		}
+		return f;
+	}
+
+	pofLuaChunkPtr compile(const string &path, const string &args) {
+		std::ifstream file(path.c_str(), std::ios::binary);
+		std::stringstream ss;
+		pofLuaChunk *chunk = new pofLuaChunk();
+		if(!file) {
+			chunk->error = "can't read " + path;
+			return pofLuaChunkPtr(chunk);
+		}
+		ss << file.rdbuf();
+		// no newline: keep the line numbers of the file in the error messages.
+		chunk->source = "local M, print = ...; " + ss.str() + "\n" + args;
+
+		size_t hash = std::hash<string>()(chunk->source);
+		std::unordered_map<size_t, std::weak_ptr<const pofLuaChunk> >::iterator it = cache.find(hash);
+		if(it != cache.end()) {
+			pofLuaChunkPtr cached = it->second.lock();
+			if(cached && cached->source == chunk->source) {
+				delete chunk;
+				return cached;
+			}
+		}
+
+		lua_State *L = luaL_newstate();
+		string chunkname = "@" + path;
+		if(luaL_loadbuffer(L, chunk->source.data(), chunk->source.size(), chunkname.c_str()))
+			chunk->error = lua_tostring(L, -1);
+#if LUA_VERSION_NUM >= 503
+		else lua_dump(L, pofLua_dumpWriter, &chunk->bytecode, 0);
+#else
+		else lua_dump(L, pofLua_dumpWriter, &chunk->bytecode);
+#endif
+		lua_close(L);
+
+		for(it = cache.begin(); it != cache.end();) {
+			if(it->second.expired()) it = cache.erase(it);
+			else it++;
+		}
+		pofLuaChunkPtr ptr(chunk);
+		cache[hash] = ptr;
+		return ptr;
+	}
+
+	void checkWatched(std::unique_lock<std::mutex> &lock) {
+		vector<string> keys, paths;
+		for(std::map<string, File>::iterator it = files.begin(); it != files.end(); it++)
+			if(it->second.watchers > 0) {
+				keys.push_back(it->first);
+				paths.push_back(it->second.path);
+			}
+		lock.unlock();
+		vector<time_t> mtimes;
+		for(unsigned int i = 0; i < paths.size(); i++) mtimes.push_back(getMTime(paths[i]));
+		lock.lock();
+		for(unsigned int i = 0; i < keys.size(); i++) {
+			File &f = files[keys[i]];
+			if(mtimes[i] && f.mtime && mtimes[i] != f.mtime && f.compiled == f.requested) f.requested++;
+		}
+	}
+
+	public:
+	// ask for a (re)compilation of a file with the given arguments; returns the version to wait for.
+	unsigned int request(const string &path, const string &args) {
+		std::lock_guard<std::mutex> lock(mutex);
+		unsigned int version = ++getFile(path, args).requested;
+		cond.notify_one();
+		return version;
+	}
+
+	// recompile the file when it changes.
+	void watch(const string &path, const string &args, bool on) {
+		std::lock_guard<std::mutex> lock(mutex);
+		getFile(path, args).watchers += on ? 1 : -1;
+	}
+
+	// last compiled version of the file.
+	unsigned int get(const string &path, const string &args, pofLuaChunkPtr &chunk) {
+		std::lock_guard<std::mutex> lock(mutex);
+		std::map<string, File>::iterator it = files.find(key(path, args));
+		if(it == files.end()) return 0;
+		chunk = it->second.chunk;
+		return it->second.compiled;
+	}
+
+	void threadedFunction() {
+		std::unique_lock<std::mutex> lock(mutex);
+		uint64_t lastCheck = ofGetElapsedTimeMillis();
+		while(isThreadRunning()) {
+			std::map<string, File>::iterator it;
+			for(it = files.begin(); it != files.end(); it++)
+				if(it->second.compiled < it->second.requested) break;
+			if(it == files.end()) {
+				cond.wait_for(lock, std::chrono::milliseconds(LUA_WATCH_PERIOD));
+				if(ofGetElapsedTimeMillis() - lastCheck >= LUA_WATCH_PERIOD) {
+					checkWatched(lock);
+					lastCheck = ofGetElapsedTimeMillis();
+				}
+				continue;
+			}
+			string key = it->first, path = it->second.path, args = it->second.args;
+			unsigned int version = it->second.requested;
+			lock.unlock();
+			time_t mtime = getMTime(path);
+			pofLuaChunkPtr chunk = compile(path, args);
+			lock.lock();
+			File &f = files[key];
+			f.chunk = chunk;
+			f.compiled = version;
+			f.mtime = mtime;
+		}
+	}
+};
+
+static pofLuaCompiler luaCompiler;
+
+// ------------ shared table : values shared by all the Lua states -------------
+
+struct pofLuaSharedValue {
+	int type;
+	double number;
+	string str;
+};
+static std::map<string, pofLuaSharedValue> sharedValues;
+static ofMutex sharedMutex;
+
+static int pofLua_lua_shared_get(lua_State *L)
+{
+	if(lua_type (L, 1) != LUA_TSTRING) return 0;
+	int ret = 1;
+	sharedMutex.lock();
+	std::map<string, pofLuaSharedValue>::iterator it = sharedValues.find(lua_tostring(L, 1));
+	if(it == sharedValues.end()) ret = 0;
+	else if(it->second.type == LUA_TNUMBER) lua_pushnumber(L, it->second.number);
+	else if(it->second.type == LUA_TBOOLEAN) lua_pushboolean(L, it->second.number != 0);
+	else lua_pushstring(L, it->second.str.c_str());
+	sharedMutex.unlock();
+	return ret;
+}
+
+static int pofLua_lua_shared_set(lua_State *L)
+{
+	if(lua_type (L, 1) != LUA_TSTRING) return 0;
+	string key = lua_tostring(L, 1);
+	int type = lua_type (L, 2);
+	sharedMutex.lock();
+	if(type == LUA_TNIL) sharedValues.erase(key);
+	else if(type == LUA_TNUMBER || type == LUA_TBOOLEAN || type == LUA_TSTRING) {
+		pofLuaSharedValue &v = sharedValues[key];
+		v.type = type;
+		if(type == LUA_TNUMBER) v.number = lua_tonumber(L, 2);
+		else if(type == LUA_TBOOLEAN) v.number = lua_toboolean(L, 2);
+		else v.str = lua_tostring(L, 2);
+	}
+	sharedMutex.unlock();
+	return 0;
+}
 
 // ------------ pofLua_receiver -------------
 
@@ -46,7 +396,7 @@ void pofLua_receiver::rcv_anything(t_symbol *s, int argc, t_atom *argv)
 		binbuf_add(bb, 1, &at);
 	}
 	binbuf_add(bb, argc, argv);
-	lua->queueToGUI(s_method, binbuf_getnatom(bb), binbuf_getvec(bb));
+	lua->queueToLua(s_method, binbuf_getnatom(bb), binbuf_getvec(bb));
 	lua->trigger = true;
 	binbuf_free(bb);
 }
@@ -62,38 +412,259 @@ void pofLua_receiver::setup()
 	class_addanything(pofLua_receiver_class, pofLua_receiver_anything);
 }
 
-// ------------ global functions exported to Lua -------------
+// ------------ messages from Lua to Pd -------------
+
+#define TOPD_SYMBOLS_MAX 16384 // maximum number of interned strings
+#define TOPD_SYMLEN_MAX 64 // longer strings are copied into the messages instead of being interned
+
+#if LUA_VERSION_NUM < 502
+#define lua_rawlen lua_objlen
+#endif
+
+// Messages from the Lua states to Pd, stored as typed atoms in a buffer that any thread running
+// Lua appends to; Pd swaps it with its own buffer at each tick, so once the buffers have grown
+// nothing is allocated per message. Strings are interned once (their ids are cached in the
+// registry of each Lua state), and Pd resolves each id with gensym() only once.
+class pofLuaToPd {
+	public:
+	enum Type { MESSAGE, ARRAY, FLOAT, SYMBOL, STRING };
+	struct Atom {
+		unsigned int type;
+		union {
+			float f;		// FLOAT
+			unsigned int id;	// SYMBOL: interned string id; STRING: offset in chars
+			unsigned int n;		// MESSAGE, ARRAY: number of atoms following the header
+		};
+	};
+	vector<Atom> atoms;
+	vector<char> chars;
+	vector<string> names; // interned strings, by id
+	std::unordered_map<string, unsigned int> ids;
+	std::mutex mutex; // to be locked around all the calls below
+
+	size_t begin(Type type) {
+		Atom a;
+		a.type = type;
+		a.n = 0;
+		atoms.push_back(a);
+		return atoms.size() - 1;
+	}
+
+	void end(size_t header) {
+		atoms[header].n = atoms.size() - header - 1;
+	}
+
+	void addFloat(float f) {
+		Atom a;
+		a.type = FLOAT;
+		a.f = f;
+		atoms.push_back(a);
+	}
+
+	void addString(lua_State *L, int index) {
+		Atom a;
+		size_t len;
+		const char *s = lua_tolstring(L, index, &len);
+		if(len <= TOPD_SYMLEN_MAX) {
+			lua_getfield(L, LUA_REGISTRYINDEX, "poflua_symbols");
+			lua_pushvalue(L, index);
+			lua_rawget(L, -2);
+			if(lua_type(L, -1) == LUA_TNUMBER) {
+				a.type = SYMBOL;
+				a.id = lua_tointeger(L, -1);
+				lua_pop(L, 2);
+				atoms.push_back(a);
+				return;
+			}
+			lua_pop(L, 1);
+			string str(s, len);
+			std::unordered_map<string, unsigned int>::iterator it = ids.find(str);
+			if(it != ids.end() || names.size() < TOPD_SYMBOLS_MAX) {
+				a.type = SYMBOL;
+				if(it != ids.end()) a.id = it->second;
+				else {
+					a.id = ids[str] = names.size();
+					names.push_back(str);
+				}
+				lua_pushvalue(L, index);
+				lua_pushinteger(L, a.id);
+				lua_rawset(L, -3);
+				lua_pop(L, 1);
+				atoms.push_back(a);
+				return;
+			}
+			lua_pop(L, 1);
+		}
+		a.type = STRING;
+		a.id = chars.size();
+		chars.insert(chars.end(), s, s + len);
+		chars.push_back(0);
+		atoms.push_back(a);
+	}
 
-static std::vector<Any> pofLua_stackToVec(lua_State *L, int first)
+	// add a number, a boolean (as 0/1) or a string; other types are skipped.
+	void addValue(lua_State *L, int index) {
+		if(index < 0) index = lua_gettop(L) + index + 1;
+		int type = lua_type (L, index);
+		if(type == LUA_TNUMBER) addFloat(lua_tonumber(L, index));
+		else if(type == LUA_TBOOLEAN) addFloat(lua_toboolean(L, index) ? 1 : 0);
+		else if(type == LUA_TSTRING) addString(L, index);
+	}
+};
+
+static pofLuaToPd toPd;
+
+// topd(receiver, ...) : send a message to a Pd receiver.
+static int pofLua_lua_topd(lua_State *L)
 {
+	if(lua_type (L, 1) != LUA_TSTRING) return 0;
 	int top = lua_gettop(L);
-	std::vector<Any> vec;
-	for(int i = first; i <= top; i++)
-	{
-		int type = lua_type (L, i);
-		if(type == LUA_TNUMBER) vec.push_back((float)lua_tonumber(L, i));
-		else if(type == LUA_TBOOLEAN) vec.push_back((float)(lua_toboolean(L, i)?1.0:0.0));
-		else if(type == LUA_TSTRING) vec.push_back(string(lua_tostring(L, i)));
-		else continue;
+
+	toPd.mutex.lock();
+	size_t header = toPd.begin(pofLuaToPd::MESSAGE);
+	for(int i = 1; i <= top; i++) toPd.addValue(L, i);
+	toPd.end(header);
+	toPd.mutex.unlock();
+	return 0;
+}
+
+// topd_list(receiver, table, ...) : send a message made of the arguments following the table,
+// then of the elements of the table.
+static int pofLua_lua_topd_list(lua_State *L)
+{
+	if(lua_type (L, 1) != LUA_TSTRING) return 0;
+	if(lua_type (L, 2) != LUA_TTABLE) return 0;
+	int top = lua_gettop(L);
+	int n = lua_rawlen(L, 2);
+
+	toPd.mutex.lock();
+	size_t header = toPd.begin(pofLuaToPd::MESSAGE);
+	toPd.addValue(L, 1);
+	for(int i = 3; i <= top; i++) toPd.addValue(L, i);
+	for(int i = 1; i <= n; i++) {
+		lua_rawgeti(L, 2, i);
+		toPd.addValue(L, -1);
+		lua_pop(L, 1);
+	}
+	toPd.end(header);
+	toPd.mutex.unlock();
+	return 0;
+}
+
+// topd_array(arrayname, table, [onset]) : write the numbers of the table into a Pd array;
+// without onset the array is resized to the size of the table.
+static int pofLua_lua_topd_array(lua_State *L)
+{
+	if(lua_type (L, 1) != LUA_TSTRING) return 0;
+	if(lua_type (L, 2) != LUA_TTABLE) return 0;
+	int n = lua_rawlen(L, 2);
+	float onset = (lua_type(L, 3) == LUA_TNUMBER) ? lua_tonumber(L, 3) : -1;
+
+	toPd.mutex.lock();
+	size_t header = toPd.begin(pofLuaToPd::ARRAY);
+	toPd.addValue(L, 1);
+	toPd.addFloat(onset);
+	for(int i = 1; i <= n; i++) {
+		lua_rawgeti(L, 2, i);
+		toPd.addFloat(lua_tonumber(L, -1));
+		lua_pop(L, 1);
+	}
+	toPd.end(header);
+	toPd.mutex.unlock();
+	return 0;
+}
+
+// Pd side:
+static vector<pofLuaToPd::Atom> pdAtoms;
+static vector<char> pdChars;
+static vector<t_symbol*> pdSymbols;
+static vector<t_atom> pdArgs;
+
+static t_symbol *pofLua_toPdSymbol(const pofLuaToPd::Atom &a)
+{
+	if(a.type == pofLuaToPd::SYMBOL) return pdSymbols[a.id];
+	if(a.type == pofLuaToPd::STRING) return gensym(&pdChars[a.id]);
+	return NULL;
+}
+
+static void pofLua_toPdRecord(const pofLuaToPd::Atom *header)
+{
+	unsigned int n = header->n;
+	const pofLuaToPd::Atom *a = header + 1;
+	t_symbol *dest;
+
+	if(n < 1 || !(dest = pofLua_toPdSymbol(a[0]))) return;
+
+	if(header->type == pofLuaToPd::MESSAGE) {
+		if(!dest->s_thing) {
+			pd_error(0, "poflua: %s: no such object", dest->s_name);
+			return;
+		}
+		int argc = n - 1;
+		pdArgs.resize(argc + 1);
+		t_atom *argv = &pdArgs[0];
+		for(int i = 0; i < argc; i++) {
+			if(a[i + 1].type == pofLuaToPd::FLOAT) SETFLOAT(&argv[i], a[i + 1].f);
+			else SETSYMBOL(&argv[i], pofLua_toPdSymbol(a[i + 1]));
+		}
+		if(argc && argv->a_type == A_SYMBOL) typedmess(dest->s_thing, atom_getsymbol(argv), argc - 1, argv + 1);
+		else pd_list(dest->s_thing, &s_list, argc, argv);
+	}
+	else if(header->type == pofLuaToPd::ARRAY && n >= 2) {
+		t_garray *array;
+		int size;
+		t_word *vec;
+		int onset = a[1].f;
+		int count = n - 2;
+
+		if (!(array = (t_garray *)pd_findbyclass(dest, garray_class))) {
+			pd_error(0, "poflua: %s: no such array", dest->s_name);
+			return;
+		}
+		if(onset < 0) {
+			if(garray_npoints(array) != count) garray_resize_long(array, count);
+			onset = 0;
+		}
+		if (!garray_getfloatwords(array, &size, &vec)) {
+			pd_error(0, "poflua: %s: bad template", dest->s_name);
+			return;
+		}
+		for(int i = 0; i < count && onset + i < size; i++) vec[onset + i].w_float = a[i + 2].f;
+		garray_redraw(array);
 	}
-	return vec;
 }
 
-static void pofLua_lua_topd(lua_State *L)
+// drained right after the pofBase::sendToPd() queues, by the same Pd clock tick:
+static void pofLua_dequeueToPd(ofEventArgs & args)
 {
-	int type = lua_type (L, 1);
-	if(type != LUA_TSTRING) return;
+	if(toPd.mutex.try_lock()) {
+		pdAtoms.swap(toPd.atoms);
+		pdChars.swap(toPd.chars);
+		while(pdSymbols.size() < toPd.names.size()) pdSymbols.push_back(gensym(toPd.names[pdSymbols.size()].c_str()));
+		toPd.mutex.unlock();
+
+		for(size_t i = 0; i < pdAtoms.size(); i += pdAtoms[i].n + 1) pofLua_toPdRecord(&pdAtoms[i]);
+		pdAtoms.clear();
+		pdChars.clear();
+	}
+}
 
-	std::vector<Any> vec = pofLua_stackToVec(L, 1);
-	pofBase::sendToPd(vec);
+// ------------ global functions exported to Lua -------------
+
+static pofLua *pofLua_find(const char *objname)
+{
+	pofLuasMutex.lock();
+	std::map<string, pofLua*>::iterator it = pofLuas.find(objname);
+	pofLua *obj = (it == pofLuas.end()) ? NULL : it->second;
+	pofLuasMutex.unlock();
+	return obj;
 }
 
 static void pofLua_lua_drawconfig(lua_State *L)
 {
 	if(lua_type (L, 1) != LUA_TSTRING) return;
 	if(lua_type (L, 2) != LUA_TSTRING) return;
-	string objname = lua_tostring(L, 1);
-	pofLua *obj = pofLuas[objname];
+	pofLua *obj = pofLua_find(lua_tostring(L, 1));
 	if(!obj) return;
 
 	string command = lua_tostring(L, 2);
@@ -111,9 +682,8 @@ static int pofLua_lua_getfile(lua_State *L)
 	if(lua_type (L, 1) != LUA_TSTRING) return 0;
 	if(lua_type (L, 2) != LUA_TSTRING) return 0;
 
-	string objname = string(lua_tostring(L, 1));
 	const char* filename = lua_tostring(L, 2);
-	pofLua *obj = pofLuas[objname];
+	pofLua *obj = pofLua_find(lua_tostring(L, 1));
 	if(!obj) return 0;
 
 	int fd;
@@ -125,10 +695,179 @@ static int pofLua_lua_getfile(lua_State *L)
 		return 0;
 	}
 	string absfilename = string(namebuf) + "/" + string(namebufptr);
-	lua_pushstring(lua, absfilename.c_str());
+	lua_pushstring(L, absfilename.c_str());
 	return 1;
 }
 
+// ------------ buffers : pixels and meshes that scripts fill in place -------------
+
+static std::list<pofLuaBuffer*> luaBuffersToDelete;
+static t_symbol *addr_to_sym(string symaddr);
+
+static void pofLua_initFrame(ofEventArgs & args) // delete the GL resources from the GL thread
+{
+	while(!luaBuffersToDelete.empty()) {
+		delete luaBuffersToDelete.front();
+		luaBuffersToDelete.pop_front();
+	}
+}
+
+static pofLuaBuffer *pofLua_getbuffer(lua_State *L, bool create = false)
+{
+	if(lua_type (L, 1) != LUA_TSTRING) return NULL;
+	if(lua_type (L, 2) != LUA_TSTRING) return NULL;
+	pofLua *obj = pofLua_find(lua_tostring(L, 1));
+	if(!obj) return NULL;
+	string bufname = lua_tostring(L, 2);
+	std::map<string, pofLuaBuffer*>::iterator it = obj->buffers.find(bufname);
+	if(it != obj->buffers.end()) return it->second;
+	if(!create) return NULL;
+	return obj->buffers[bufname] = new pofLuaBuffer();
+}
+
+// buffer_pixels(pdself, name, width, height, channels) -> data pointer, size in bytes
+static int pofLua_lua_buffer_pixels(lua_State *L)
+{
+	pofLuaBuffer *buf = pofLua_getbuffer(L, true);
+	if(!buf) return 0;
+	int w = lua_tonumber(L, 3), h = lua_tonumber(L, 4), channels = lua_tonumber(L, 5);
+	if(channels < 1 || channels > 4) channels = 4;
+	if(w > 0 && h > 0 && ((int)buf->pixels.getWidth() != w || (int)buf->pixels.getHeight() != h
+			|| (int)buf->pixels.getNumChannels() != channels)) {
+		buf->pixels.allocate(w, h, channels);
+		buf->pixels.set(0);
+		buf->pixelsChanged = true;
+	}
+	if(!buf->pixels.isAllocated()) return 0;
+	lua_pushlightuserdata(L, buf->pixels.getData());
+	lua_pushnumber(L, buf->pixels.size());
+	return 2;
+}
+
+// buffer_changed(pdself, name) : the pixels were written through the data pointer, upload them again.
+static int pofLua_lua_buffer_changed(lua_State *L)
+{
+	pofLuaBuffer *buf = pofLua_getbuffer(L);
+	if(buf) buf->pixelsChanged = true;
+	return 0;
+}
+
+// buffer_mesh(pdself, name, numVertices, withColors, withTexCoords)
+// -> vertices (3 floats each), colors (4 floats), texcoords (2 floats) pointers (nil if not used)
+static int pofLua_lua_buffer_mesh(lua_State *L)
+{
+	pofLuaBuffer *buf = pofLua_getbuffer(L, true);
+	if(!buf) return 0;
+	int n = lua_tonumber(L, 3);
+	if(n < 0) n = 0;
+	buf->mesh.getVertices().resize(n);
+	buf->mesh.getColors().resize(lua_toboolean(L, 4) ? n : 0);
+	buf->mesh.getTexCoords().resize(lua_toboolean(L, 5) ? n : 0);
+	if(n == 0) return 0;
+	lua_pushlightuserdata(L, &buf->mesh.getVertices()[0]);
+	if(buf->mesh.getColors().size()) lua_pushlightuserdata(L, &buf->mesh.getColors()[0]);
+	else lua_pushnil(L);
+	if(buf->mesh.getTexCoords().size()) lua_pushlightuserdata(L, &buf->mesh.getTexCoords()[0]);
+	else lua_pushnil(L);
+	return 3;
+}
+
+// buffer_set(pdself, name, array, index, values...) : bounds-checked write, for when FFI isn't available.
+// array is "pixels", "vertices", "colors" or "texcoords"; index counts bytes (pixels) or floats.
+static int pofLua_lua_buffer_set(lua_State *L)
+{
+	pofLuaBuffer *buf = pofLua_getbuffer(L);
+	if(!buf || lua_type (L, 3) != LUA_TSTRING) return 0;
+	string array = lua_tostring(L, 3);
+	int index = lua_tonumber(L, 4);
+	int top = lua_gettop(L);
+	if(index < 0) return 0;
+
+	if(array == "pixels") {
+		unsigned char *data = buf->pixels.getData();
+		int size = buf->pixels.size();
+		for(int i = 5; i <= top && index < size; i++) data[index++] = ofClamp(lua_tonumber(L, i), 0, 255);
+		buf->pixelsChanged = true;
+		return 0;
+	}
+
+	float *data = NULL;
+	int size = 0;
+	if(array == "vertices" && buf->mesh.getVertices().size()) {
+		data = (float*)&buf->mesh.getVertices()[0];
+		size = buf->mesh.getVertices().size() * 3;
+	}
+	else if(array == "colors" && buf->mesh.getColors().size()) {
+		data = (float*)&buf->mesh.getColors()[0];
+		size = buf->mesh.getColors().size() * 4;
+	}
+	else if(array == "texcoords" && buf->mesh.getTexCoords().size()) {
+		data = (float*)&buf->mesh.getTexCoords()[0];
+		size = buf->mesh.getTexCoords().size() * 2;
+	}
+	for(int i = 5; i <= top && index < size; i++) data[index++] = lua_tonumber(L, i);
+	return 0;
+}
+
+static void pofLua_uploadpixels(pofLuaBuffer *buf)
+{
+	if(!buf->pixelsChanged || !buf->pixels.isAllocated()) return;
+	buf->texture.loadData(buf->pixels); // (re)allocates the texture if needed
+	buf->pixelsChanged = false;
+}
+
+// buffer_draw(pdself, name, [x, y, w, h]) for pixels, buffer_draw(pdself, name, [mode]) for meshes
+static int pofLua_lua_buffer_draw(lua_State *L)
+{
+	POFLUA_GL_ONLY(L, "buffer_draw");
+	pofLuaBuffer *buf = pofLua_getbuffer(L);
+	if(!buf) return 0;
+
+	if(buf->mesh.getVertices().size()) {
+		if(lua_type (L, 3) == LUA_TSTRING) {
+			ofPrimitiveMode mode;
+			if(pofsubVbo::getMode(lua_tostring(L, 3), mode)) buf->mesh.setMode(mode);
+		}
+		buf->mesh.draw();
+	}
+	else if(buf->pixels.isAllocated()) {
+		pofLua_uploadpixels(buf);
+		float w = buf->pixels.getWidth(), h = buf->pixels.getHeight();
+		if(lua_gettop(L) >= 6) { w = lua_tonumber(L, 5); h = lua_tonumber(L, 6); }
+		buf->texture.draw(lua_tonumber(L, 3), lua_tonumber(L, 4), w, h);
+	}
+	return 0;
+}
+
+// buffer_publish(pdself, name, texsymaddr) : upload the pixels and make them available as a pof texture.
+static int pofLua_lua_buffer_publish(lua_State *L)
+{
+	POFLUA_GL_ONLY(L, "buffer_publish");
+	pofLuaBuffer *buf = pofLua_getbuffer(L);
+	if(!buf || lua_type (L, 3) != LUA_TSTRING) return 0;
+	pofLua_uploadpixels(buf);
+	if(!buf->texture.isAllocated()) return 0;
+	if(buf->published) pofBase::textures.erase(buf->published);
+	buf->published = addr_to_sym(lua_tostring(L, 3));
+	pofBase::textures[buf->published] = &buf->texture;
+	return 0;
+}
+
+// buffer_readtexture(pdself, name, texsymaddr) : copy a pof texture into the pixels (GPU readback).
+static int pofLua_lua_buffer_readtexture(lua_State *L)
+{
+	POFLUA_GL_ONLY(L, "buffer_readtexture");
+	pofLuaBuffer *buf = pofLua_getbuffer(L, true);
+	if(!buf || lua_type (L, 3) != LUA_TSTRING) return 0;
+	std::map<t_symbol*,ofTexture *>::iterator it = pofBase::textures.find(addr_to_sym(lua_tostring(L, 3)));
+	if(it == pofBase::textures.end() || !it->second || !it->second->isAllocated()) return 0;
+	it->second->readToPixels(buf->pixels);
+	buf->pixelsChanged = true;
+	lua_pushlightuserdata(L, buf->pixels.getData());
+	lua_pushnumber(L, buf->pixels.size());
+	return 2;
+}
+
 static t_symbol *addr_to_sym(string symaddr)
 {
 	stringstream ss(symaddr);
@@ -153,17 +892,253 @@ ofFbo *fbo_get(string fbosymaddr) {
 	else return NULL;
 }
 
+// ------------ vbos : named vertex buffers retained on the GPU (see pofvbo) -------------
+
+static pofsubVbo *pofLua_getvbo(lua_State *L)
+{
+	if(lua_type (L, 1) != LUA_TSTRING) return NULL;
+	if(lua_type (L, 2) != LUA_TSTRING) return NULL;
+	pofLua *obj = pofLua_find(lua_tostring(L, 1));
+	if(!obj) return NULL;
+	t_symbol *name = addr_to_sym(lua_tostring(L, 2));
+	if(!name) return NULL;
+	std::map<t_symbol*, pofsubVbo*>::iterator vit = obj->vbos.find(name);
+	if(vit != obj->vbos.end()) return vit->second;
+	return obj->vbos[name] = pofsubVbo::get(name);
+}
+
+// vbo_size(pdself, vbosym, numVertices, [numIndices])
+static int pofLua_lua_vbo_size(lua_State *L)
+{
+	pofsubVbo *svbo = pofLua_getvbo(L);
+	if(!svbo) return 0;
+	svbo->setSize(lua_tonumber(L, 3), (lua_type(L, 4) == LUA_TNUMBER) ? lua_tonumber(L, 4) : -1);
+	return 0;
+}
+
+// vbo_set(pdself, vbosym, attribute, onset, table) or vbo_set(pdself, vbosym, attribute, onset, values...)
+static int pofLua_lua_vbo_set(lua_State *L)
+{
+	pofsubVbo *svbo = pofLua_getvbo(L);
+	pofsubVbo::Attribute attr;
+	if(!svbo || lua_type (L, 3) != LUA_TSTRING || !pofsubVbo::getAttribute(lua_tostring(L, 3), attr)) return 0;
+	int onset = lua_tonumber(L, 4);
+	vector<float> values;
+	if(lua_type (L, 5) == LUA_TTABLE) {
+		int n = lua_rawlen(L, 5);
+		values.resize(n);
+		for(int i = 0; i < n; i++) {
+			lua_rawgeti(L, 5, i + 1);
+			values[i] = lua_tonumber(L, -1);
+			lua_pop(L, 1);
+		}
+	}
+	else {
+		int top = lua_gettop(L);
+		for(int i = 5; i <= top; i++) values.push_back(lua_tonumber(L, i));
+	}
+	const char *error = values.empty() ? NULL : svbo->set(attr, onset, &values[0], values.size());
+	if(error) return luaL_error(L, "vbo_set %s: %s", lua_tostring(L, 3), error);
+	return 0;
+}
+
+// vbo_draw(pdself, vbosym, [mode, [first, count]]) : to be called from draw().
+static int pofLua_lua_vbo_draw(lua_State *L)
+{
+	POFLUA_GL_ONLY(L, "vbo_draw");
+	pofsubVbo *svbo = pofLua_getvbo(L);
+	ofPrimitiveMode mode = OF_PRIMITIVE_TRIANGLES;
+	if(!svbo) return 0;
+	if(lua_type (L, 3) == LUA_TSTRING) pofsubVbo::getMode(lua_tostring(L, 3), mode);
+	svbo->draw(mode, lua_tonumber(L, 4), lua_tonumber(L, 5));
+	return 0;
+}
+
+// ------------ pofjson and pofxmlp documents -------------
+// They are read from the published snapshot of the document: the Pd thread never modifies
+// a snapshot, so the scripts can query it from any thread without locking the document.
+
+static void pofLua_pushjson(lua_State *L, const pofJSONDoc &doc, pofJSONDoc::Id n)
+{
+	const pofJSONDoc::Node &node = doc.node(n);
+	luaL_checkstack(L, 3, "json document too deep");
+	switch(node.type) {
+		case pofJSONDoc::NUMBER: lua_pushnumber(L, node.number); break;
+		case pofJSONDoc::BOOLEAN: lua_pushboolean(L, node.number != 0); break;
+		case pofJSONDoc::STRING: lua_pushstring(L, doc.str(node.string)); break;
+		case pofJSONDoc::ARRAY:
+			lua_createtable(L, node.size, 0);
+			for(unsigned int i = 0; i < node.size; i++) {
+				pofLua_pushjson(L, doc, doc.child(n, i));
+				lua_rawseti(L, -2, i + 1);
+			}
+			break;
+		case pofJSONDoc::OBJECT:
+			lua_createtable(L, 0, node.size);
+			for(unsigned int i = 0; i < node.size; i++) {
+				lua_pushstring(L, doc.str(doc.key(n, i)));
+				pofLua_pushjson(L, doc, doc.child(n, i));
+				lua_rawset(L, -3);
+			}
+			break;
+		default: lua_pushnil(L);
+	}
+}
+
+// the node at the path given by the arguments from index first (keys, or 0-based array indices)
+static pofJSONDoc::Id pofLua_jsonpath(lua_State *L, const pofJSONDoc &doc, int first)
+{
+	pofJSONDoc::Id js = doc.root();
+	int top = lua_gettop(L);
+	for(int i = first; i <= top && js != pofJSONDoc::NONE; i++) {
+		if(lua_type(L, i) == LUA_TNUMBER) {
+			if(doc.type(js) != pofJSONDoc::ARRAY || lua_tonumber(L, i) < 0) js = pofJSONDoc::NONE;
+			else js = doc.child(js, lua_tonumber(L, i));
+		}
+		else if(lua_type(L, i) == LUA_TSTRING) js = doc.member(js, doc.findString(lua_tostring(L, i)));
+		else js = pofJSONDoc::NONE;
+	}
+	return js;
+}
+
+// json_get(jsonname, path...) : the value at path (containers as tables), or nil.
+static int pofLua_lua_json_get(lua_State *L)
+{
+	if(lua_type (L, 1) != LUA_TSTRING) return 0;
+	pofJSONSnapshot doc = pofsubJSON::getSnapshot(lua_tostring(L, 1));
+	if(!doc || doc->root() == pofJSONDoc::NONE) return 0;
+	pofJSONDoc::Id js = pofLua_jsonpath(L, *doc, 2);
+	if(js == pofJSONDoc::NONE) return 0;
+	pofLua_pushjson(L, *doc, js);
+	return 1;
+}
+
+// json_size(jsonname, path...) : the number of elements of the array or object at path.
+static int pofLua_lua_json_size(lua_State *L)
+{
+	if(lua_type (L, 1) != LUA_TSTRING) return 0;
+	pofJSONSnapshot doc = pofsubJSON::getSnapshot(lua_tostring(L, 1));
+	if(!doc || doc->root() == pofJSONDoc::NONE) return 0;
+	pofJSONDoc::Id js = pofLua_jsonpath(L, *doc, 2);
+	lua_pushnumber(L, (js == pofJSONDoc::NONE) ? 0 : doc->size(js));
+	return 1;
+}
+
+// the text (or the attribute attr) of the nodes matching xpath, from the document root
+static bool pofLua_xmlselect(lua_State *L, vector<string> &values, bool all)
+{
+	if(lua_type (L, 1) != LUA_TSTRING || lua_type (L, 2) != LUA_TSTRING) return false;
+	pofXMLPSnapshot doc = pofsubXMLP::getSnapshot(lua_tostring(L, 1));
+	if(!doc) return false;
+	const char *attr = (lua_type (L, 3) == LUA_TSTRING) ? lua_tostring(L, 3) : NULL;
+	try {
+		pugi::xpath_node_set nodes = doc->xml.select_nodes(lua_tostring(L, 2));
+		for(pugi::xpath_node_set::const_iterator it = nodes.begin(); it != nodes.end(); it++) {
+			pugi::xml_node node = it->node();
+			values.push_back(attr ? node.attribute(attr).as_string() : node.text().as_string());
+			if(!all) break;
+		}
+	} catch(pugi::xpath_exception & e) {
+		ofLogError("poflua") << e.what();
+		return false;
+	}
+	return true;
+}
+
+// xml_get(xmlname, xpath, [attr]) : the text (or the attribute) of the first node matching xpath, or nil.
+static int pofLua_lua_xml_get(lua_State *L)
+{
+	vector<string> values;
+	if(!pofLua_xmlselect(L, values, false) || values.empty()) return 0;
+	lua_pushstring(L, values[0].c_str());
+	return 1;
+}
+
+// xml_gets(xmlname, xpath, [attr]) : the texts (or the attributes) of all the nodes matching xpath.
+static int pofLua_lua_xml_gets(lua_State *L)
+{
+	vector<string> values;
+	if(!pofLua_xmlselect(L, values, true)) return 0;
+	lua_createtable(L, values.size(), 0);
+	for(unsigned int i = 0; i < values.size(); i++) {
+		lua_pushstring(L, values[i].c_str());
+		lua_rawseti(L, -2, i + 1);
+	}
+	return 1;
+}
+
 // ------------ module creation and script loading utilities -------------
 
-static void pofLua_initscript()
+static void pofLua_initstate(ofxLua &lua)
+{
+	lua.init();
+	luaopen_pof(lua);
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_topd);
+	lua_setglobal(lua, "topd");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_topd_list);
+	lua_setglobal(lua, "topd_list");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_topd_array);
+	lua_setglobal(lua, "topd_array");
+	lua_newtable(lua);
+	lua_setfield(lua, LUA_REGISTRYINDEX, "poflua_symbols"); // string -> id cache of the messages to Pd
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_drawconfig);
+	lua_setglobal(lua, "drawconfig");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_getfile);
+	lua_setglobal(lua, "getfile");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_shared_get);
+	lua_setglobal(lua, "shared_get");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_shared_set);
+	lua_setglobal(lua, "shared_set");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_buffer_pixels);
+	lua_setglobal(lua, "buffer_pixels");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_buffer_changed);
+	lua_setglobal(lua, "buffer_changed");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_buffer_mesh);
+	lua_setglobal(lua, "buffer_mesh");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_buffer_set);
+	lua_setglobal(lua, "buffer_set");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_buffer_draw);
+	lua_setglobal(lua, "buffer_draw");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_buffer_publish);
+	lua_setglobal(lua, "buffer_publish");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_buffer_readtexture);
+	lua_setglobal(lua, "buffer_readtexture");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_vbo_size);
+	lua_setglobal(lua, "vbo_size");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_vbo_set);
+	lua_setglobal(lua, "vbo_set");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_vbo_draw);
+	lua_setglobal(lua, "vbo_draw");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_json_get);
+	lua_setglobal(lua, "json_get");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_json_size);
+	lua_setglobal(lua, "json_size");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_xml_get);
+	lua_setglobal(lua, "xml_get");
+	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_xml_gets);
+	lua_setglobal(lua, "xml_gets");
+	lua_pushboolean(lua, false);
+	lua_setglobal(lua, "FORCE_DRAW");
+#ifdef POF_LUAJIT
+	luaJIT_setmode(lua, 0, LUAJIT_MODE_ENGINE | LUAJIT_MODE_ON);
+#endif
+	pofLua_initscript(lua);
+}
+
+static void pofLua_initscript(ofxLua &lua)
 {
 	string script =
 		"poflua = {}; "
 		"poflua.symbols = {};"
 		"poflua.functions = {};"
 
+		"function poflua.run(chunk, M) chunk(M, function(...) topd(M.pdself, 'print', ...) end) end; "
+
 		"function poflua.functions:out(...) topd(self.pdself, 'out', ...) end; "
 		"function poflua.functions:send(...) topd(self.pdself, 'send', ...) end; "
+		"function poflua.functions:outlist(t) topd_list(self.pdself, t, 'out') end; "
+		"function poflua.functions:sendlist(dest, t) topd_list(self.pdself, t, 'send', dest) end; "
+		"function poflua.functions:toarray(name, t, onset) topd_array(name, t, onset) end; "
 		"function poflua.functions:touchconfig(...) topd(self.pdself, 'touchconfig', ...) end; "
 		"function poflua.functions:drawconfig(...) drawconfig(self.pdself, ...) end; "
 		"function poflua.functions:addreceive(name) topd(self.pdself, 'receive', name) end; "
@@ -180,6 +1155,45 @@ static void pofLua_initscript()
 		"function poflua.functions:getfbo(name) return pof.fbo_get(self:getsym(name) or '_') end; "
 		"function poflua.functions:getfont(name) return pof.fonts_get(self:getsym(name) or '_') end; "
 
+		"function poflua.functions:vbosize(name, ...) "
+			"local sym = self:getsym(name); if sym then vbo_size(self.pdself, sym, ...) end end; "
+		"function poflua.functions:vboset(name, ...) "
+			"local sym = self:getsym(name); if sym then vbo_set(self.pdself, sym, ...) end end; "
+		"function poflua.functions:vbodraw(name, ...) "
+			"local sym = self:getsym(name); if sym then vbo_draw(self.pdself, sym, ...) end end; "
+
+		"function poflua.functions:jsonget(name, ...) return json_get(name, ...) end; "
+		"function poflua.functions:jsonsize(name, ...) return json_size(name, ...) end; "
+		"function poflua.functions:xmlget(name, xpath, attr) return xml_get(name, xpath, attr) end; "
+		"function poflua.functions:xmlgets(name, xpath, attr) return xml_gets(name, xpath, attr) end; "
+
+		"function poflua.functions:pixels(name, w, h, channels) "
+			"local data, size = buffer_pixels(self.pdself, name, w, h, channels); "
+			"return poflua.view('uint8_t*', data), size end; "
+		"function poflua.functions:pixelschanged(name) buffer_changed(self.pdself, name) end; "
+		"function poflua.functions:mesh(name, n, colors, texcoords) "
+			"local v, c, t = buffer_mesh(self.pdself, name, n, colors, texcoords); "
+			"return poflua.view('float*', v), poflua.view('float*', c), poflua.view('float*', t) end; "
+		"function poflua.functions:setbuffer(...) buffer_set(self.pdself, ...) end; "
+		"function poflua.functions:drawbuffer(...) buffer_draw(self.pdself, ...) end; "
+		"function poflua.functions:publishtexture(name, texname) "
+			"local sym = self:getsym(texname); if sym then buffer_publish(self.pdself, name, sym) end end; "
+		"function poflua.functions:readtexture(texname, name) "
+			"local sym = self:getsym(texname); if not sym then return end; "
+			"local data, size = buffer_readtexture(self.pdself, name, sym); "
+			"return poflua.view('uint8_t*', data), size end; "
+
+		// zero-copy views of the buffers with LuaJIT's FFI; nil with standard Lua (use setbuffer()).
+		"if jit then "
+			"local ffi = require('ffi'); "
+			"function poflua.view(ctype, ptr) if ptr then return ffi.cast(ctype, ptr) end end; "
+		"else "
+			"function poflua.view(ctype, ptr) return nil end; "
+		"end; "
+
+		"poflua.shared = setmetatable({}, {"
+			"__index = function(t, k) return shared_get(k) end, "
+			"__newindex = function(t, k, v) shared_set(k, v) end}); "
 	;
 	lua.doString(script);
 }
@@ -204,11 +1218,9 @@ static void pofLua_reload(void *x, t_symbol *s = NULL)
 	pofLua* obj = dynamic_cast<pofLua*>(((PdObject*)x)->parent);
 	int fd;
 	char namebuf[MAXPDSTRING], *namebufptr;
-	long length;
-	int readret;
-	char *buf;
 
-	obj->script = pofLua_prefix(x, s == gensym("reset"));
+	string prefix = pofLua_prefix(x, s == gensym("reset"));
+	unsigned int version = 0;
 
 	if(obj->filename) {
 		if ((fd = canvas_open(obj->pdcanvas, obj->filename->s_name, "", namebuf, &namebufptr, MAXPDSTRING, 0)) < 0)
@@ -216,32 +1228,78 @@ static void pofLua_reload(void *x, t_symbol *s = NULL)
 			pd_error(x, "pofLua_read: can't open %s", obj->filename->s_name);
 			return;
 		}
+		close (fd);
+		string path = string(namebuf) + "/" + string(namebufptr);
+		if(obj->watch && path != obj->scriptPath) {
+			if(!obj->scriptPath.empty()) luaCompiler.watch(obj->scriptPath, obj->argsScript, false);
+			luaCompiler.watch(path, obj->argsScript, true);
+		}
+		obj->scriptPath = path;
+		// the file is read and compiled with the arguments by the compiler thread
+		version = luaCompiler.request(path, obj->argsScript);
+	}
 
-		if ((length = (long)lseek(fd, 0, SEEK_END)) < 0 || lseek(fd, 0, SEEK_SET) < 0
-			|| !(buf = (char *)t_getbytes(length + 1)))
-		{
-			pd_error(x, "pofLua_read %s lseek: %s", obj->filename->s_name, strerror(errno));
-			close(fd);
-			return;
+	obj->receivers.clear();
+	// the previous version keeps running until the new one is compiled
+	obj->loadMutex.lock();
+	obj->loadRequest.prefix = prefix;
+	obj->loadRequest.path = obj->scriptPath;
+	obj->loadRequest.version = version;
+	obj->loadRequest.pending = true;
+	obj->loadMutex.unlock();
+}
+
+// run the script of the object (from the drawing thread).
+static void pofLua_load(pofLua *obj, const pofLuaChunkPtr &chunk, unsigned int version)
+{
+	ofxLua &lua = obj->state->lua;
+	bool ok;
+
+	obj->needLoad = false;
+	obj->scriptLoaded = version;
+	obj->loaded = true;
+	if(chunk && !chunk->error.empty()) {
+		pd_error(obj->pdobj, "pofLua: %s", chunk->error.c_str());
+		return;
+	}
+
+	obj->state->mutex.lock();
+	if(!(ok = lua.doString(obj->load.prefix))) pd_error(obj->pdobj, "pofLua: %s", lua.getErrorMessage().c_str());
+	obj->load.prefix = pofLua_prefix(obj->pdobj); // don't reset the module again when the file changes
+
+	if(ok && chunk) {
+		lua_getglobal(lua, "poflua");
+		lua_getfield(lua, -1, "run");
+		lua_remove(lua, -2);
+		if(luaL_loadbuffer(lua, chunk->bytecode.data(), chunk->bytecode.size(), obj->load.path.c_str())) {
+			pd_error(obj->pdobj, "pofLua: %s", lua_tostring(lua, -1));
+			lua_pop(lua, 2);
+			ok = false;
 		}
-	
-		if ((readret = (int)read(fd, buf, length)) < length)
-		{
-			pd_error(x, "pofLua_read %s read: %s", obj->filename->s_name, strerror(errno));
-			close(fd);
-			t_freebytes(buf, length);
-			return;
+		else {
+			lua_getglobal(lua, obj->name->s_name);
+			if(lua_pcall(lua, 2, 0, 0) != 0) {
+				pd_error(obj->pdobj, "pofLua: %s", lua_tostring(lua, -1));
+				lua_pop(lua, 1);
+				ok = false;
+			}
 		}
-		close (fd);
-		buf[length] = 0;
-		obj->script += string(buf);
-		t_freebytes(buf, length);
 	}
-	
-	obj->receivers.clear();
-	obj->script += obj->argsScript;
-	obj->loaded = obj->touchable = obj->drawable = false;
+
+	// without a file, the arguments are the whole script (with a file, they are compiled in its chunk).
+	if(ok && !chunk && !obj->argsScript.empty() && !lua.doString(pofLua_prefix(obj->pdobj) + obj->argsScript)) {
+		pd_error(obj->pdobj, "pofLua: %s", lua.getErrorMessage().c_str());
+	}
+
+	if(lua.pushTable(obj->name->s_name)) {
+		obj->touchable = lua.isFunction("touch");
+		obj->drawable = lua.isFunction("draw");
+		lua.popTable();
+	}
+	else pd_error(obj->pdobj, "pofLua loading pushTable %s: %s", obj->name->s_name, lua.getErrorMessage().c_str());
+	obj->state->mutex.unlock();
 	obj->trigger = true;
+	pofBase::needBuild = true; // needed to rebuild the touchtree
 }
 
 // ------------ pd class methods -------------
@@ -253,6 +1311,7 @@ static void *pofLua_new(t_symbol *s, int argc, t_atom *argv)
 
 	obj->pdcanvas = canvas_getcurrent();
 	obj->filename = NULL;
+	string group;
 	
 	if(argc && argv->a_type == A_SYMBOL && *atom_getsymbol(argv)->s_name != ';') {
 		name = atom_getsymbol(argv);
@@ -271,6 +1330,21 @@ static void *pofLua_new(t_symbol *s, int argc, t_atom *argv)
 				argv++; argc--;
 			}
 		}
+		else if(atom_getsymbol(argv) == gensym("-g")) { // Lua state shared by a named group
+			argv++; argc--;
+			if(argc) {
+				group = atom_getsymbol(argv)->s_name;
+				argv++; argc--;
+			}
+		}
+		else if(atom_getsymbol(argv) == gensym("-p")) { // private Lua state
+			group = string("_private_") + obj->s_self->s_name;
+			argv++; argc--;
+		}
+		else if(atom_getsymbol(argv) == gensym("-w")) { // run messages on a worker thread
+			obj->worker = true;
+			argv++; argc--;
+		}
 		else {argv++; argc--;}
 	}
 
@@ -288,8 +1362,11 @@ static void *pofLua_new(t_symbol *s, int argc, t_atom *argv)
 	}
 
 	obj->argsScript = ss.str();
+	obj->state = pofLuaState::get(group);
 	
+	pofLuasMutex.lock();
 	pofLuas[obj->name->s_name] = obj;
+	pofLuasMutex.unlock();
 
 	pofLua_reload(obj->pdobj);
 	return (void*) (obj->pdobj);
@@ -299,8 +1376,12 @@ static void pofLua_free(void *x)
 {
 	pofLua* obj = dynamic_cast<pofLua*>(((PdObject*)x)->parent);
 	if(obj->name != obj->s_self) pd_unbind(&obj->pdobj->x_obj.ob_pd, obj->name);
-	delete obj;
+	if(obj->worker) luaWorkers[obj->state->worker].cancel(obj);
+	if(obj->watch && !obj->scriptPath.empty()) luaCompiler.watch(obj->scriptPath, obj->argsScript, false);
+	pofLuasMutex.lock();
 	pofLuas.erase(obj->name->s_name);
+	pofLuasMutex.unlock();
+	delete obj;
 }
 
 static void pofLua_lua(void *x, t_symbol *s, int argc, t_atom *argv)
@@ -313,19 +1394,19 @@ static void pofLua_lua(void *x, t_symbol *s, int argc, t_atom *argv)
 	binbuf_gettext(bb, &buf, &bufsize);
 	binbuf_free(bb);
 	string str = "local M=" + string(obj->name->s_name) + ";" + buf;
-	luaMutex.lock();
-	if(!lua.doString(str.c_str())) {
-		pd_error(x, "pofLua: %s", lua.getErrorMessage().c_str());
+	obj->state->mutex.lock();
+	if(!obj->state->lua.doString(str.c_str())) {
+		pd_error(x, "pofLua: %s", obj->state->lua.getErrorMessage().c_str());
 		//error("pofLua: %s", lua.getErrorMessage().c_str());
 	}
-	luaMutex.unlock();
+	obj->state->mutex.unlock();
 	t_freebytes(buf, bufsize);
 }
 
 static void pofLua_lua_async(void *x, t_symbol *s, int argc, t_atom *argv)
 {
 	pofLua* px = dynamic_cast<pofLua*>(((PdObject*)x)->parent);
-	px->queueToGUI(s, argc, argv);
+	px->queueToLua(s, argc, argv);
 	px->trigger = true;
 }
 
@@ -365,7 +1446,7 @@ static void pofLua_send(void *x, t_symbol *s, int argc, t_atom *argv)
 static void pofLua_receive(void *x, t_symbol *s)
 {
 	pofLua* px = dynamic_cast<pofLua*>(((PdObject*)x)->parent);
-	px->receivers[s].initialize(px, s);
+	if(px->receivers.find(s) == px->receivers.end()) px->receivers[s].initialize(px, s);
 }
 
 static void pofLua_touchconfig(void *x, t_symbol *s, int argc, t_atom *argv)
@@ -392,6 +1473,18 @@ static void pofLua_touchconfig(void *x, t_symbol *s, int argc, t_atom *argv)
 	}
 }
 
+static void pofLua_watch(void *x, t_float w)
+{
+	pofLua *px = dynamic_cast<pofLua*>(((PdObject*)x)->parent);
+	bool watch = (w != 0);
+	if(watch == px->watch) return;
+	px->watch = watch;
+	if(!px->scriptPath.empty()) luaCompiler.watch(px->scriptPath, px->argsScript, watch);
+	px->loadMutex.lock();
+	px->loadRequest.watch = watch;
+	px->loadMutex.unlock();
+}
+
 static void pofLua_bang(void *x)
 {
 	pofLua *px = dynamic_cast<pofLua*>(((PdObject*)x)->parent);
@@ -420,14 +1513,10 @@ static void pofLua_getsym(void *x, t_symbol *name)
 	t_symbol *addr = gensym(ss.str().c_str());
 	SETSYMBOL(&at[0], name);
 	SETSYMBOL(&at[1], addr);
-	px->queueToGUI(s_getsym, 2, at);
+	px->queueToLua(s_getsym, 2, at);
 	px->trigger = true;
 }
 
-extern "C" {
-	int luaopen_pof(lua_State* L);
-}
-
 void pofLua::setup(void)
 {
 	s_function = gensym("f");
@@ -453,23 +1542,19 @@ void pofLua::setup(void)
 	class_addmethod(pofLua_class, (t_method)pofLua_receive, gensym("receive"), A_SYMBOL, A_NULL);
 	class_addmethod(pofLua_class, (t_method)pofLua_touchconfig, gensym("touchconfig"), A_GIMME, A_NULL);
 	class_addmethod(pofLua_class, (t_method)pofLua_reload, gensym("reload"), A_DEFSYM, A_NULL);
+	class_addmethod(pofLua_class, (t_method)pofLua_watch, gensym("watch"), A_DEFFLOAT, A_NULL);
 	class_addbang(pofLua_class, (t_method)pofLua_bang);
 	class_addmethod(pofLua_class, (t_method)pofLua_force, gensym("force"), A_NULL);
 	class_addmethod(pofLua_class, (t_method)pofLua_continuousForce, gensym("continuousForce"), A_DEFFLOAT, A_NULL);
 	class_addmethod(pofLua_class, (t_method)pofLua_getsym, s_getsym, A_SYMBOL, A_NULL);
 
-	// init the lua state
-	lua.init();
-	luaopen_pof(lua);
-	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_topd);
-	lua_setglobal(lua, "topd");
-	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_drawconfig);
-	lua_setglobal(lua, "drawconfig");
-	lua_pushcfunction(lua, (lua_CFunction)pofLua_lua_getfile);
-	lua_setglobal(lua, "getfile");
-	lua_pushboolean(lua, false);
-	lua_setglobal(lua, "FORCE_DRAW");
-	pofLua_initscript();
+	for(int i = 0; i < LUA_WORKERS; i++) luaWorkers[i].startThread();
+	luaCompiler.startThread();
+	ofAddListener(pofBase::initFrameEvent, &pofLua_initFrame);
+	ofAddListener(pofBase::dequeueToPdEvent, &pofLua_dequeueToPd);
+#ifdef POF_LUAJIT
+	post("poflua: using %s", LUAJIT_VERSION);
+#endif
 }
 
 
@@ -477,17 +1562,27 @@ void pofLua::setup(void)
 
 pofLua::pofLua(t_class *Class):
 	pofBase(Class), pofTouch(Class, 200, 200), pofOnce(Class, true),
-	loaded(false), touchable(false), drawable(false)
+	watch(false), needLoad(false), scriptLoaded(0),
+	loaded(false), touchable(false), drawable(false), worker(false), state(NULL)
 {
 }
 
 pofLua::~pofLua()
 {
+	treeMutex.lockW();
+	if(state) pofLuaState::let(state);
+	for(std::map<string, pofLuaBuffer*>::iterator it = buffers.begin(); it != buffers.end(); it++) {
+		if(it->second->published) pofBase::textures.erase(it->second->published);
+		luaBuffersToDelete.push_back(it->second);
+	}
+	for(std::map<t_symbol*, pofsubVbo*>::iterator it = vbos.begin(); it != vbos.end(); it++) pofsubVbo::let(it->second);
+	treeMutex.unlockW();
 }
 
 void pofLua::Send(t_symbol *s, int n, float f1, float f2, float f3)
 {
-	luaMutex.lock();
+	ofxLua &lua = state->lua;
+	state->mutex.lock();
 	
 	if(lua.pushTable(name->s_name)) {
 		if(lua.isFunction("touch")) {
@@ -505,32 +1600,37 @@ void pofLua::Send(t_symbol *s, int n, float f1, float f2, float f3)
 	}
 	else pd_error(pdobj, "pofLua::Send pushTable %s: %s", name->s_name, lua.getErrorMessage().c_str());
 	
-	luaMutex.unlock();
+	state->mutex.unlock();
 }
 
-void pofLua::draw()
+void pofLua::update()
 {
-	if(!loaded) {
-		luaMutex.lock();
-		if(!lua.doString(script)) {
-			pd_error(pdobj, "pofLua: %s", lua.getErrorMessage().c_str());
-		}
-		else {
-			if(lua.pushTable(name->s_name)) {
-				touchable = lua.isFunction("touch");
-				drawable = lua.isFunction("draw");
-				lua.popTable();
-			}
-			else pd_error(pdobj, "pofLua loading pushTable %s: %s", name->s_name, lua.getErrorMessage().c_str());
-		}
-		luaMutex.unlock();
-		pofBase::needBuild = true; // needed to rebuild the touchtree
-		loaded = true;
+	loadMutex.lock();
+	if(loadRequest.pending) {
+		load = loadRequest;
+		loadRequest.pending = false;
+		needLoad = true;
+	}
+	load.watch = loadRequest.watch;
+	loadMutex.unlock();
+
+	if(load.path.empty()) {
+		if(needLoad) pofLua_load(this, pofLuaChunkPtr(), 0);
+	}
+	else if(needLoad || load.watch) {
+		pofLuaChunkPtr chunk;
+		unsigned int version = luaCompiler.get(load.path, argsScript, chunk);
+		if(needLoad ? (version >= load.version) : (version > scriptLoaded)) pofLua_load(this, chunk, version);
 	}
+}
+
+void pofLua::draw()
+{
+	ofxLua &lua = state->lua;
 	if(!drawable) return;
 	ofPushMatrix();
 	ofPushStyle();
-	luaMutex.lock();
+	state->mutex.lock();
 	
 	lua_pushboolean(lua, FORCE_ONCE);
 	lua_setglobal(lua, "FORCE_DRAW");
@@ -544,7 +1644,7 @@ void pofLua::draw()
 		lua.popTable();
 	}
 	else pd_error(pdobj, "pofLua drawing pushTable %s: %s", name->s_name, lua.getErrorMessage().c_str());
-	luaMutex.unlock();
+	state->mutex.unlock();
 }
 
 void pofLua::postdraw()
@@ -557,11 +1657,12 @@ void pofLua::postdraw()
 
 void pofLua::message(int argc, t_atom *argv)
 {
+	ofxLua &lua = state->lua;
 	t_symbol *key = atom_getsymbol(argv); 
 	argv++; argc--;
 
 	if(!loaded) return;
-	luaMutex.lock();
+	state->mutex.lock();
 	if(key == s_function || key == s_method || key == s_global) {
 		t_symbol *func = atom_getsymbol(argv);
 		int n = 0;
@@ -603,5 +1704,5 @@ void pofLua::message(int argc, t_atom *argv)
 		lua.popTable();
 	}
 end:
-	luaMutex.unlock();
+	state->mutex.unlock();
 }
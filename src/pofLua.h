@@ -7,8 +7,45 @@
 
 #include "pofTouch.h"
 #include "pofOnce.h"
+#include "ofxLua.h"
 
 class pofLua;
+class pofsubVbo;
+
+// A Lua interpreter, shared by the poflua objects of a group (the default group "" is the
+// global state). Each state has its own lock, so objects of different groups don't wait
+// for each other. Data can be shared between states through the poflua.shared table.
+class pofLuaState
+{
+	int refCount;
+	static std::map<string, pofLuaState*> states;
+	pofLuaState(const string &group);
+	~pofLuaState();
+
+	public:
+	ofxLua lua;
+	ofMutex mutex;
+	string group;
+	int worker; // index of the worker thread running the messages of the "worker" objects of this group
+
+	static pofLuaState *get(const string &group);
+	static void let(pofLuaState *state);
+};
+
+// CPU buffers owned by a poflua object, that scripts fill in place (through LuaJIT FFI views)
+// and draw in one call. They are drawn, published and read back from the drawing thread only
+// (with treeMutex read-locked, which protects pofBase::textures): the workers get a Lua error.
+class pofLuaBuffer
+{
+	public:
+	ofPixels pixels;
+	ofTexture texture;
+	bool pixelsChanged;
+	ofMesh mesh;
+	t_symbol *published; // name of the texture in pofBase::textures, if published
+
+	pofLuaBuffer() : pixelsChanged(false), published(NULL) {}
+};
 
 class pofLua_receiver
 {
@@ -28,20 +65,42 @@ class pofLua: public pofTouch, public pofOnce {
 		pofLua(t_class *Class);
 		virtual ~pofLua();
 		
+		virtual bool hasUpdate(){ return true;}
+		virtual void update(); // (re)loads the script when needed
 		virtual void draw();
 		virtual void postdraw();
 		virtual void Send(t_symbol *s, int n, float f1, float f2=0, float f3=0); // outlet_anything
 		virtual bool isTouchable() {return touchable;}
 		virtual void message(int  arc, t_atom *argv); // Pd -> Pof(lua)
-		string script;
-		string argsScript;
+		void queueToLua(t_symbol *s, int argc, t_atom *argv); // to GUI thread, or to a worker thread
+		string argsScript; // creation arguments, run after the script file
+		string scriptPath; // Pd thread: resolved path of the script file
+		bool watch; // Pd thread: reload the script when its file changes
+
+		// a (re)load, handed from the Pd thread to the GL thread by update():
+		struct LoadRequest {
+			string prefix; // module prefix, run before the script file
+			string path; // script file ("": arguments only)
+			unsigned int version; // compiled version to wait for
+			bool pending, watch;
+			LoadRequest(): version(0), pending(false), watch(false) {}
+		};
+		ofMutex loadMutex;
+		LoadRequest loadRequest; // Pd thread, under loadMutex
+		LoadRequest load; // GL thread: the last request taken by update()
+		bool needLoad; // GL thread
+		unsigned int scriptLoaded; // GL thread: version of the compiled file
 		t_symbol *name;
 		t_symbol *filename;
 		t_canvas *pdcanvas;
 		bool loaded;
 		bool touchable;
 		bool drawable;
+		bool worker; // messages run on a worker thread instead of the GUI thread
+		pofLuaState *state;
 		map<t_symbol*, pofLua_receiver> receivers;
+		map<string, pofLuaBuffer*> buffers;
+		map<t_symbol*, pofsubVbo*> vbos; // vbos used by the script
 
 		static void setup(void);
 };
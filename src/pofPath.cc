@@ -34,12 +34,14 @@ void pofpath_fill(void *x, float r, float g, float b, float a)
 {
 	pofPath* px = (pofPath*)(((PdObject*)x)->parent);
 	px->path.setFillColor(ofColor(r*255.0, g*255.0, b*255.0, a*255.0));
+	px->ownColors = true;
 }
 
 void pofpath_stroke(void *x, float r, float g, float b, float a)
 {
 	pofPath* px = (pofPath*)(((PdObject*)x)->parent);
 	px->path.setStrokeColor(ofColor(r*255.0, g*255.0, b*255.0, a*255.0));
+	px->ownColors = true;
 }
 
 void pofpath_width(void *x, float width)
@@ -127,6 +129,14 @@ void pofPath::draw()
 	else path.draw();
 }
 
+bool pofPath::getMesh(ofMesh &m)
+{
+	// the tessellation is only the fill: the outline, and the path's own colors, need path.draw().
+	if(!path.isFilled() || path.getStrokeWidth() > 0 || ownColors) return false;
+	m = path.getTessellation();
+	return true;
+}
+
 void pofPath::message(int argc, t_atom *argv)
 {
 	float X=0, Y=0, Z=0, radiusX=0, radiusY=0, angleBegin=0, angleEnd=0;	
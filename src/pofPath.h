@@ -12,14 +12,16 @@ class pofPath;
 class pofPath: public pofBase {
 	public:
 		pofPath(t_class *Class):
-			pofBase(Class), doMesh(false)
+			pofBase(Class), doMesh(false), ownColors(false)
 		{ }
 
 		ofPath path;
 		ofPoint scale;
 		bool doMesh;
+		bool ownColors; // fillColor or strokeColor has been set
 
 		virtual void draw();
+		virtual bool getMesh(ofMesh &m);
 		virtual void message(int  arc, t_atom *argv);
 		static void setup(void);
 };
@@ -166,4 +166,12 @@ void pofQuad::draw() {
     if (drawFaces) mesh.drawFaces();
 }
 
+bool pofQuad::getMesh(ofMesh &m)
+{
+	if(!drawMesh || drawVertices || drawWireframe || drawFaces) return false;
+	if(needUpdate) Update();
+	m = mesh;
+	return true;
+}
+
 
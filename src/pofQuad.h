@@ -26,6 +26,7 @@ class pofQuad: public pofBase {
 		}
 
 		virtual void draw();
+		virtual bool getMesh(ofMesh &m);
 		static void setup(void);
 		
 		ofPoint tcorners[4]; // corners in texture in [0.0 ; 1.0] range
@@ -75,3 +75,19 @@ void pofRect::draw()
 	} else ofRectRounded(-width/2, -h/2, 0, width, h, topLeftR, topRightR, bottomRightR, bottomLeftR);
 }
 
+bool pofRect::getMesh(ofMesh &m)
+{
+	float h = height;
+	if(h==0) h = width;
+	ofPath path;
+
+	path.setCircleResolution(resolution ? resolution : ofGetStyle().circleResolution);
+
+	if(topRightR==0 && bottomRightR==0 && bottomLeftR==0) {
+		if(topLeftR==0) path.rectangle(-width/2, -h/2, width, h);
+		else path.rectRounded(-width/2, -h/2, width, h, topLeftR);
+	} else path.rectRounded(-width/2, -h/2, 0, width, h, topLeftR, topRightR, bottomRightR, bottomLeftR);
+	m = path.getTessellation();
+	return true;
+}
+
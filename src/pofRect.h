@@ -16,6 +16,7 @@ class pofRect: public pofBase {
 		{ }
 
 		virtual void draw();
+		virtual bool getMesh(ofMesh &m);
 		static void setup(void);
 		
 		float width, height;
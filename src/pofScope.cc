@@ -4,9 +4,373 @@
  * See https://github.com/Ant1r/ofxPof for documentation and updates.
  */
 #include "pofScope.h"
+#include <cfloat>
+#include <climits>
+#include <condition_variable>
 
 t_class *pofscope_class;
 
+ofShader pofScope::shader;
+int pofScope::shaderState = 0;
+std::list<ofTexture*> pofScope::texturesToDelete;
+
+static const char *scopeVertexShader =
+	"#version 120\n"
+	"varying vec2 pos;\n"
+	"void main()\n"
+	"{\n"
+	"	pos = gl_Vertex.xy;\n"
+	"	gl_Position = gl_ModelViewProjectionMatrix * gl_Vertex;\n"
+	"	gl_FrontColor = gl_Color;\n"
+	"}\n";
+
+// Each texel holds the min (RG) and the max (BA) of a column, on 16 bits, from -range to range.
+// curve 0: one rectangle per column ; 1: Catmull-Rom curves ; 2: lines.
+static const char *scopeFragmentShader =
+	"#version 120\n"
+	"uniform sampler2D columns;\n"
+	"uniform float width, offset, range, height;\n"
+	"uniform int curve;\n"
+	"uniform vec4 fillColor, strokeColor;\n"
+	"uniform float fill, stroke, strokeWidth;\n"
+	"varying vec2 pos;\n"
+	"vec2 column(float i)\n"
+	"{\n"
+	"	vec4 t = texture2D(columns, vec2((mod(clamp(i, 0.0, width - 1.0) + offset, width) + 0.5) / width, 0.5));\n"
+	"	return ((vec2(t.r * 256.0 + t.g, t.b * 256.0 + t.a) * 255.0 / 65535.0) * 2.0 - 1.0) * range * height;\n"
+	"}\n"
+	"void main()\n"
+	"{\n"
+	"	float x = pos.x + width / 2.0;\n"
+	"	float i = floor(x);\n"
+	"	float t = x - i;\n"
+	"	vec2 c1 = column(i);\n"
+	"	if(curve == 0) {\n"
+	"		if(pos.y < min(c1.x, c1.y) || pos.y > max(c1.x, c1.y) + 1.0) discard;\n"
+	"		gl_FragColor = gl_Color;\n"
+	"		return;\n"
+	"	}\n"
+	"	vec2 c2 = column(i + 1.0);\n"
+	"	vec2 v, d;\n"
+	"	if(curve == 1) {\n"
+	"		vec2 c0 = column(i - 1.0), c3 = column(i + 2.0);\n"
+	"		vec2 b = c2 - c0, c = 2.0 * c0 - 5.0 * c1 + 4.0 * c2 - c3, e = 3.0 * (c1 - c2) + c3 - c0;\n"
+	"		v = c1 + 0.5 * t * (b + t * (c + t * e));\n"
+	"		d = 0.5 * (b + t * (2.0 * c + 3.0 * t * e));\n"
+	"	} else {\n"
+	"		v = mix(c1, c2, t);\n"
+	"		d = c2 - c1;\n"
+	"	}\n"
+	"	float fa = fill * fillColor.a * step(min(v.x, v.y), pos.y) * step(pos.y, max(v.x, v.y));\n"
+	"	vec2 dist = abs(pos.y - v) / sqrt(1.0 + d * d);\n"
+	"	float sa = stroke * strokeColor.a * clamp(strokeWidth / 2.0 + 0.5 - min(dist.x, dist.y), 0.0, 1.0);\n"
+	"	float a = sa + fa * (1.0 - sa);\n"
+	"	if(a <= 0.0) discard;\n"
+	"	gl_FragColor = vec4((strokeColor.rgb * sa + fillColor.rgb * fa * (1.0 - sa)) / a, a);\n"
+	"}\n";
+
+static void decodePeak(float data, float *min, float *max)
+{
+	*min = (((int)data)%2048 - 1024) / 1024.0;
+	*max = (((int)data)/2048 - 1024) / 1024.0;
+}
+
+// Builds the pyramids of all the scopes, one chunk at a time.
+class pofScopeBuilder: public ofThread {
+	std::set<pofScopePyramid*> pending;
+	std::mutex mutex;
+	std::condition_variable cond;
+
+	public:
+	void add(pofScopePyramid *pyramid) {
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.insert(pyramid);
+		if(!isThreadRunning()) startThread();
+		cond.notify_one();
+	}
+
+	void remove(pofScopePyramid *pyramid) { // when it returns, the pyramid isn't used anymore.
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.erase(pyramid);
+	}
+
+	void threadedFunction() {
+		std::unique_lock<std::mutex> lock(mutex);
+		pofScopePyramid *last = NULL;
+		while(isThreadRunning()) {
+			if(pending.empty()) {
+				cond.wait_for(lock, std::chrono::milliseconds(100));
+				continue;
+			}
+			// round robin, so that a long recording doesn't delay the others.
+			std::set<pofScopePyramid*>::iterator it = pending.upper_bound(last);
+			if(it == pending.end()) it = pending.begin();
+			last = *it;
+			if(!last->build()) pending.erase(it);
+			lock.unlock();
+			lock.lock();
+		}
+	}
+};
+
+static pofScopeBuilder scopeBuilder;
+
+pofScopePyramid::pofScopePyramid():
+	changed(false), arrayName(NULL), copyFrom(0), copyTo(0), viewFrom(0), viewLength(0),
+	type(PEAKS), size(0), dirtyFrom(0), dirtyTo(0), windowFrom(0)
+{
+	copyClock = clock_new(this, (t_method)copyTick);
+}
+
+pofScopePyramid::~pofScopePyramid()
+{
+	clock_free(copyClock);
+	scopeBuilder.remove(this);
+}
+
+void pofScopePyramid::allocate(int s, Source t)
+{
+	size = s;
+	type = t;
+	levels.clear();
+	int n = (size + base() - 1) / base();
+	while(true) {
+		levels.push_back(Level());
+		levels.back().min.assign(n, 0);
+		levels.back().max.assign(n, 0);
+		if(n <= 1) break;
+		n = (n + 1) / 2;
+	}
+	window.clear();
+	dirtyFrom = dirtyTo = 0;
+	changed = true;
+}
+
+t_word *pofScopePyramid::findArray(int &s)
+{
+	t_garray *array;
+	t_word *vec;
+	if(!arrayName || !(array = (t_garray *)pd_findbyclass(arrayName, garray_class))
+		|| !garray_getfloatwords(array, &s, &vec)) return NULL;
+	return vec;
+}
+
+void pofScopePyramid::setSource(t_symbol *array, int s, Source t)
+{
+	if(array == arrayName && s == size && t == type) return; // use "update" when the array is modified
+	arrayName = array;
+	mutex.lock();
+	allocate(s, t);
+	mutex.unlock();
+	copyFrom = 0;
+	copyTo = s;
+	copyTick(this);
+}
+
+void pofScopePyramid::update(int onset, int length)
+{
+	if(onset < 0) onset = 0;
+	int end = (length <= 0 || onset + length > size) ? size : onset + length;
+	if(onset >= end) return;
+	if(copyFrom >= copyTo) {
+		copyFrom = onset;
+		copyTo = end;
+	} else {
+		copyFrom = MIN(copyFrom, onset);
+		copyTo = MAX(copyTo, end);
+	}
+	copyTick(this);
+}
+
+void pofScopePyramid::copyWindow(t_word *vec, int from, int end)
+{
+	int wend = windowFrom + window.size();
+	for(int i = MAX(from, windowFrom); i < MIN(end, wend); i++) window[i - windowFrom] = vec[i].w_float;
+}
+
+void pofScopePyramid::setView(float from, float length)
+{
+	viewFrom = from;
+	viewLength = length;
+	int s;
+	t_word *vec = findArray(s);
+	mutex.lock();
+	int wfrom = MAX((int)floorf(from) - 1, 0), wend = MIN((int)ceilf(from + length) + 2, size);
+	if(type != AUDIO || !vec || s != size || wend - wfrom > WINDOW_MAX || wend <= wfrom) window.clear();
+	else if(wfrom != windowFrom || wend - wfrom != (int)window.size()) {
+		windowFrom = wfrom;
+		window.resize(wend - wfrom);
+		copyWindow(vec, wfrom, wend);
+	}
+	mutex.unlock();
+}
+
+void pofScopePyramid::copyTick(pofScopePyramid *x)
+{
+	int s;
+	t_word *vec;
+
+	if(x->copyFrom >= x->copyTo) return;
+	// the array may have been resized or deleted since the last tick.
+	if(!(vec = x->findArray(s))) {
+		x->copyFrom = x->copyTo = 0;
+		return;
+	}
+
+	x->mutex.lock();
+	int b = x->base();
+	if(s != x->size) { // read it all again
+		x->allocate(s, x->type);
+		x->copyFrom = 0;
+		x->copyTo = s;
+	}
+	int from = x->copyFrom / b * b;
+	int end = MIN(MIN((x->copyTo + b - 1) / b * b, s), from + COPY_CHUNK); // whole level 0 entries
+	int e0 = from / b, e1 = (end + b - 1) / b;
+	Level &l0 = x->levels[0];
+	for(int e = e0; e < e1; e++) {
+		if(x->type == PEAKS) decodePeak(vec[e].w_float, &l0.min[e], &l0.max[e]);
+		else {
+			int i = e * b, iend = MIN(i + b, s);
+			float mn = vec[i].w_float, mx = mn;
+			for(i++; i < iend; i++) {
+				mn = std::min(mn, vec[i].w_float);
+				mx = std::max(mx, vec[i].w_float);
+			}
+			l0.min[e] = mn;
+			l0.max[e] = mx;
+		}
+	}
+	x->copyWindow(vec, from, end);
+	if(x->dirtyFrom >= x->dirtyTo) {
+		x->dirtyFrom = e0;
+		x->dirtyTo = e1;
+	} else {
+		x->dirtyFrom = MIN(x->dirtyFrom, e0);
+		x->dirtyTo = MAX(x->dirtyTo, e1);
+	}
+	x->changed = true;
+	x->mutex.unlock();
+
+	x->copyFrom = end;
+	if(x->window.empty() && x->type == AUDIO) x->setView(x->viewFrom, x->viewLength); // after a resize
+	if(e1 > e0) scopeBuilder.add(x);
+	if(x->copyFrom < x->copyTo) clock_delay(x->copyClock, 0);
+}
+
+bool pofScopePyramid::build()
+{
+	mutex.lock();
+	if(dirtyFrom >= dirtyTo) {
+		mutex.unlock();
+		return false;
+	}
+	int end = MIN(dirtyTo, dirtyFrom + CHUNK);
+	int e0 = dirtyFrom, e1 = end;
+
+	for(unsigned int k = 1; k < levels.size(); k++) {
+		Level &prev = levels[k - 1], &l = levels[k];
+		int n = prev.min.size();
+		e0 /= 2;
+		e1 = (e1 + 1) / 2;
+		for(int e = e0; e < e1; e++) {
+			int i = e * 2;
+			if(i + 1 < n) {
+				l.min[e] = std::min(prev.min[i], prev.min[i + 1]);
+				l.max[e] = std::max(prev.max[i], prev.max[i + 1]);
+			} else {
+				l.min[e] = prev.min[i];
+				l.max[e] = prev.max[i];
+			}
+		}
+	}
+
+	dirtyFrom = end;
+	changed = true;
+	bool more = dirtyFrom < dirtyTo;
+	mutex.unlock();
+	return more;
+}
+
+void pofScopePyramid::getSource(int index, float &min, float &max)
+{
+	if(index < 0 || index >= size) min = max = 0;
+	else if(type == PEAKS) {
+		min = levels[0].min[index];
+		max = levels[0].max[index];
+	}
+	else if(index >= windowFrom && index < windowFrom + (int)window.size()) min = max = window[index - windowFrom];
+	else { // not copied: the level 0 entry holding the sample
+		min = levels[0].min[index / AUDIO_BLOCK];
+		max = levels[0].max[index / AUDIO_BLOCK];
+	}
+}
+
+void pofScopePyramid::read(float from, float length, int width, float *minBuf, float *maxBuf)
+{
+	mutex.lock();
+	int b = base();
+	float ratio = length / width; // source entries per column
+
+	if(length <= 0 || !size) {
+		std::fill_n(minBuf, width, 0);
+		std::fill_n(maxBuf, width, 0);
+	} else if(ratio < 1) { // less entries than columns: interpolate
+		float frac, min1 = 0, max1 = 0, min2 = 0, max2 = 0;
+		int oldi = INT_MIN;
+		for(int j = 0; j < width ; ++j) {
+			int i = floorf((float)j * ratio + from);
+			if(i != oldi) {
+				oldi = i;
+				getSource(i, min1, max1);
+				getSource(i + 1, min2, max2);
+			}
+			frac = ((float)j * ratio + from) - i;
+			minBuf[j] = (1 - frac) * min1 + frac * min2;
+			maxBuf[j] = (1 - frac) * max1 + frac * max2;
+		}
+	} else if(ratio < b) { // less than a level 0 entry per column: read the samples
+		for(int j = 0; j < width ; ++j) {
+			int i = floorf(from + j * ratio);
+			int iend = MAX(i + 1, (int)floorf(from + (j + 1) * ratio));
+			float mn, mx, min, max;
+			getSource(i, mn, mx);
+			for(i++; i < iend; i++) {
+				getSource(i, min, max);
+				mn = std::min(mn, min);
+				mx = std::max(mx, max);
+			}
+			minBuf[j] = mn;
+			maxBuf[j] = mx;
+		}
+	} else { // use the level whose entries are the closest to a column, a few entries per column.
+		unsigned int k = 0;
+		while(k + 1 < levels.size() && (double)b * (1 << (k + 1)) <= ratio) k++;
+		double es = (double)b * (1 << k);
+		Level &l = levels[k];
+		int n = l.min.size();
+		for(int j = 0; j < width ; ++j) {
+			int e = floor((from + j * ratio) / es);
+			int eend = MAX(e + 1, (int)ceil((from + (j + 1) * ratio) / es));
+			float mn = FLT_MAX, mx = -FLT_MAX;
+			for(; e < eend; e++) {
+				if(e < 0 || e >= n) {
+					mn = std::min(mn, 0.0f);
+					mx = std::max(mx, 0.0f);
+				} else {
+					mn = std::min(mn, l.min[e]);
+					mx = std::max(mx, l.max[e]);
+				}
+			}
+			minBuf[j] = mn;
+			maxBuf[j] = mx;
+		}
+	}
+	mutex.unlock();
+}
+
+/*******************************************/
+
 void *pofscope_new(t_floatarg w,t_floatarg h, t_float len)
 {
 	if(w <= 0) w = 1;
@@ -20,8 +384,8 @@ void *pofscope_new(t_floatarg w,t_floatarg h, t_float len)
 	obj->bufLen = len;
 	if(obj->bufLen < w) obj->bufLen = int(w);
 
-	obj->bufCount = 0;
 	obj->bufIndex = 0;
+	obj->resetColumns();
 
 	return (void*) (obj->pdobj);
 }
@@ -84,70 +448,133 @@ void pofscope_compute(void *x, float comp, float once)
 
 	px->compute = (comp != 0);
 	px->once = (once != 0);
+	if(px->compute) {
+		px->Mutex.lock();
+		px->showPeaks = false;
+		px->Mutex.unlock();
+	}
 	if(px->once) {
-		px->bufCount = 0;
+		px->resetColumns();
 		//post("once");
 	}
 }
 
-void pofscope_peaks(void *x, t_symbol *peakstab, float from, float length)
+static void pofscope_setView(pofScope* px, float from, float length)
 {
-	pofScope* px = (pofScope*)(((PdObject*)x)->parent);
+	px->pyramid->setView(from, length);
+	px->Mutex.lock();
+	px->peaksFrom = from;
+	px->peaksLen = length;
+	px->compute = false;
+	px->readPeaks = true;
+	px->showPeaks = true;
+	px->Mutex.unlock();
+}
 
-	t_garray *peaksArray;
-	int peaksSize;
+static void pofscope_setPeaks(pofScope* px, t_symbol *tab, float from, float length, pofScopePyramid::Source type)
+{
+	t_garray *array;
+	int size;
 	t_word *vec = NULL;
 
-	if (!(peaksArray = (t_garray *)pd_findbyclass(peakstab, garray_class)))
-		pd_error(x, "%s: no such array", peakstab->s_name);
-	else if (!garray_getfloatwords(peaksArray, &peaksSize, &vec))
-		pd_error(x, "%s: bad template for tabdump", peakstab->s_name);
+	if (!(array = (t_garray *)pd_findbyclass(tab, garray_class)))
+		pd_error(px->pdobj, "%s: no such array", tab->s_name);
+	else if (!garray_getfloatwords(array, &size, &vec))
+		pd_error(px->pdobj, "%s: bad template for tabdump", tab->s_name);
 	if(!vec) return;
 
-	if(length == 0) length = peaksSize - from - 1;
+	if(length == 0) length = size - from - (type == pofScopePyramid::PEAKS ? 1 : 0);
 	if(length < 0) length = 0;
 
-	px->Mutex.lock();
-	px->peaksVec = vec;
-	px->peaksSize = peaksSize;
-	px->peaksFrom = from;
-	px->peaksLen = length;
-	px->compute = false;
-	px->readPeaks = true;
-	px->Mutex.unlock();
+	px->pyramid->setSource(tab, size, type);
+	px->viewType = type;
+	px->viewSize = size;
+	pofscope_setView(px, from, length);
+}
+
+void pofscope_peaks(void *x, t_symbol *peakstab, float from, float length)
+{
+	pofscope_setPeaks((pofScope*)(((PdObject*)x)->parent), peakstab, from, length, pofScopePyramid::PEAKS);
+}
+
+void pofscope_wave(void *x, t_symbol *tab, float from, float length)
+{
+	pofscope_setPeaks((pofScope*)(((PdObject*)x)->parent), tab, from, length, pofScopePyramid::AUDIO);
+}
+
+// show another part of the last peaks or wave table, without reading it again.
+void pofscope_view(void *x, float from, float length)
+{
+	pofScope* px = (pofScope*)(((PdObject*)x)->parent);
+	if(length == 0) length = px->viewSize - from - (px->viewType == pofScopePyramid::PEAKS ? 1 : 0);
+	if(length < 0) length = 0;
+	pofscope_setView(px, from, length);
+}
+
+void pofscope_update(void *x, float onset, float length)
+{
+	pofScope* px = (pofScope*)(((PdObject*)x)->parent);
+	px->pyramid->update(onset, length);
+}
+
+void pofScope::resetColumns()
+{
+	dspWidth = int(width);
+	if(dspWidth < 1) dspWidth = 1;
+	dspLen = bufLen;
+	if(dspLen < dspWidth) dspLen = dspWidth; // at least one sample per column
+	column = 0;
+	bufCount = 0;
+	colEnd = (dspLen + dspWidth - 1) / dspWidth;
+	colMin = FLT_MAX;
+	colMax = -FLT_MAX;
+}
+
+void pofScope::endColumn()
+{
+	pofScopeColumn c = {column, dspWidth, colMin, colMax};
+	ring.push(c);
+	column++;
+	if(column >= dspWidth) {
+		if(once) compute = false;
+		column = 0;
+		bufCount = 0;
+	}
+	// end of the column = ceil((column + 1) * dspLen / dspWidth), one division per column.
+	colEnd = ((long long)(column + 1) * dspLen + dspWidth - 1) / dspWidth;
+	colMin = FLT_MAX;
+	colMax = -FLT_MAX;
 }
 
 static t_int *pofscope_perform(t_int *w)
 {
 	pofScope* px = (pofScope*)(((PdObject*)w[1])->parent);
 	t_sample *in = (t_sample *)(w[2]);
-	t_int n = *(t_int *)(w+3);
+	int n = *(t_int *)(w+3);
 
-	if (px->compute) {
-		px->Mutex.lock();
-		int W = px->curWidth;
-		while (n--)
-		{
-			if (!px->compute) break;
-			t_sample f = *in++;
-			int i = ((float)px->bufCount / px->bufLen) * W;
-			int oldi = i;
-
-			px->bufIndex = i + 1;
-			if(f > px->maxBuf[i]) px->maxBuf[i % W] = f;
-			if(f < px->minBuf[i]) px->minBuf[i % W] = f;
-
-			px->bufCount++;
-			if(px->bufCount >= px->bufLen) {
-				if(px->once) px->compute = 0;
-				px->bufCount = px->bufCount % px->bufLen;
-			}
+	if (!px->compute) return (w + 4);
+
+	if(px->dspWidth != int(px->width) || px->dspLen != MAX(px->bufLen, px->dspWidth)) px->resetColumns();
 
-			i = ((float)px->bufCount / px->bufLen) * W;
-			if(oldi != i) px->maxBuf[i % W] = px->minBuf[i % W] = f;
+	while (n > 0 && px->compute)
+	{
+		int m = px->colEnd - px->bufCount;
+		if(m > n) m = n;
+		t_sample mn = px->colMin, mx = px->colMax;
+		for(int i = 0; i < m; i++) {
+			mn = std::min(mn, in[i]);
+			mx = std::max(mx, in[i]);
 		}
-		px->updateGUI = true;
-		px->Mutex.unlock();
+		px->colMin = mn;
+		px->colMax = mx;
+		in += m;
+		n -= m;
+		px->bufCount += m;
+		if(px->bufCount >= px->colEnd) px->endColumn();
+	}
+	if(px->colMin <= px->colMax) { // show the current column too
+		pofScopeColumn c = {px->column, px->dspWidth, px->colMin, px->colMax};
+		px->ring.push(c);
 	}
 
 	return (w + 4);
@@ -168,6 +595,12 @@ void pofScope::setup(void)
 	class_addmethod(pofscope_class, (t_method)pofscope_compute, gensym("compute"), A_FLOAT, A_DEFFLOAT, A_NULL);
 	class_addmethod(pofscope_class, (t_method)pofscope_peaks, gensym("peaks"), A_SYMBOL,
 		A_DEFFLOAT, A_DEFFLOAT, A_NULL);
+	class_addmethod(pofscope_class, (t_method)pofscope_wave, gensym("wave"), A_SYMBOL,
+		A_DEFFLOAT, A_DEFFLOAT, A_NULL);
+	class_addmethod(pofscope_class, (t_method)pofscope_view, gensym("view"),
+		A_DEFFLOAT, A_DEFFLOAT, A_NULL);
+	class_addmethod(pofscope_class, (t_method)pofscope_update, gensym("update"),
+		A_DEFFLOAT, A_DEFFLOAT, A_NULL);
 	class_addmethod(pofscope_class, (t_method)pofscope_curve, gensym("curve"),
 		A_DEFFLOAT, A_NULL);
 	class_addmethod(pofscope_class, (t_method)pofscope_stroke, gensym("stroke"),
@@ -183,85 +616,72 @@ void pofScope::setup(void)
 
 	CLASS_MAINSIGNALIN(pofscope_class, PdObject, x_f);
 	class_addmethod(pofscope_class, (t_method)pofscope_dsp, gensym("dsp"), A_NULL);
+	ofAddListener(pofBase::initFrameEvent, &pofScope::initFrame);
 }
 
-static void decodePeak(float data, float *min, float *max)
+void pofScope::initFrame(ofEventArgs & args)
 {
-	*min = (((int)data)%2048 - 1024) / 1024.0;
-	*max = (((int)data)/2048 - 1024) / 1024.0;
+	while(!texturesToDelete.empty()) {
+		delete texturesToDelete.front();
+		texturesToDelete.pop_front();
+	}
+}
+
+void pofScope::resize(int w)
+{
+	if(w < 1) w = 1;
+	delete [] minBuf;
+	delete [] maxBuf;
+	curWidth = w;
+	minBuf = new float[curWidth];
+	maxBuf = new float[curWidth];
+	std::fill_n(minBuf, curWidth, 0);
+	std::fill_n(maxBuf, curWidth, 0);
+	bufIndex = 0;
+	updateGUI = true;
 }
 
 void pofScope::draw()
 {
 	int j;
-	bool doReadPeaks;
-	t_word *pVec = NULL;
+	bool doReadPeaks, peaks;
 	float pFrom = 0;
 	float pLen = 0;
-	int pSize = 0;
-
-	if(curWidth != int(width)) {
-		Mutex.lock();
-		delete [] minBuf;
-		delete [] maxBuf;
-		if(width < 1) width = 1;
-		curWidth = int(width);
-		minBuf = new float[curWidth];
-		maxBuf = new float[curWidth];
-		std::fill_n(minBuf, curWidth, 0);
-		std::fill_n(maxBuf, curWidth, 0);
-		bufIndex = 0;
-		updateGUI = true;
-		Mutex.unlock();
-	}
+	pofScopeColumn c;
 
 	Mutex.lock();
-	if((doReadPeaks = readPeaks)) {
-		pVec = peaksVec;
-		pSize = peaksSize;
-		pFrom = peaksFrom;
-		pLen = peaksLen;
-		readPeaks = false;
-		updateGUI = true;
-	}
+	doReadPeaks = readPeaks;
+	readPeaks = false;
+	peaks = showPeaks;
+	pFrom = peaksFrom;
+	pLen = peaksLen;
 	Mutex.unlock();
 
-	#define PEAK_ZERO (1024.0 + (2048 * 1024.0))
-	#define getPeak(index) ((index) >= pSize ? PEAK_ZERO : (index) < 0 ? PEAK_ZERO : pVec[index].w_float)
-	if(doReadPeaks) {
-		int i, j;
-		if(curWidth < pLen) {
-			float min, max;
-			int oldj = -1;
-			for(i = 0; i < pLen ; ++i) {
-				j = (i * curWidth) / pLen;
-				if(j != oldj) {
-					decodePeak(getPeak(i + (int)pFrom), &minBuf[j], &maxBuf[j]);
-					oldj = j;
-				}
-				decodePeak(getPeak(i + (int)pFrom), &min, &max);
-				if(min < minBuf[j]) minBuf[j] = min;
-				if(max > maxBuf[j]) maxBuf[j] = max;
-				bufIndex = 0;
-			}
-		} else {
-			float frac, ratio = pLen / (float)curWidth;
-			float min1 = 0, max1 = 0, min2 = 0, max2 = 0;
-			int oldi = -1;
-			for(j = 0; j < curWidth ; ++j) {
-				i = (int)((float)j * ratio + pFrom);
-				if(i != oldi) {
-					oldi = i;
-					decodePeak(getPeak(i), &min1, &max1);
-					decodePeak(getPeak(i + 1), &min2, &max2);
-				}
-				frac = ((float)j * ratio  + pFrom) - i;
-				minBuf[j] = (1 - frac) * min1 + frac * min2;
-				maxBuf[j] = (1 - frac) * max1 + frac * max2;
-			}
+	int w = MAX(int(width), 1);
+	while(ring.pop(c)) {
+		if(doReadPeaks) continue; // computed before the peaks
+		if(c.width != curWidth) {
+			if(c.width != w) continue; // computed before a resize
+			resize(c.width);
 		}
+		minBuf[c.index] = c.min;
+		maxBuf[c.index] = c.max;
+		bufIndex = c.index + 1;
+		updateGUI = true;
+	}
+	if(curWidth != w) {
+		resize(w);
+		doReadPeaks = true;
+	}
+
+	if(peaks && (pyramid->changed.exchange(false) || doReadPeaks)) {
+		pyramid->read(pFrom, pLen, curWidth, minBuf, maxBuf);
+		bufIndex = 0;
+		updateGUI = true;
 	}
 
+	if(drawShader()) return;
+
 	if(updateGUI && curve) {
 		updateGUI = false;
 		minpath.clear();
@@ -326,3 +746,68 @@ void pofScope::draw()
 		}
 	}
 }
+
+bool pofScope::drawShader()
+{
+#ifdef TARGET_OPENGLES
+	return false;
+#else
+	if(shaderState == 0) {
+		shaderState = -1;
+		if(!ofIsGLProgrammableRenderer()
+			&& shader.setupShaderFromSource(GL_VERTEX_SHADER, scopeVertexShader)
+			&& shader.setupShaderFromSource(GL_FRAGMENT_SHADER, scopeFragmentShader)
+			&& shader.linkProgram()) shaderState = 1;
+	}
+	if(shaderState < 0) return false;
+
+	if(!columnsTex || columnsTex->getWidth() != curWidth) {
+		if(!columnsTex) columnsTex = new ofTexture();
+		columnsTex->allocate(curWidth, 1, GL_RGBA, false);
+		columnsTex->setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+		columnsTex->setTextureWrap(GL_CLAMP_TO_EDGE, GL_CLAMP_TO_EDGE);
+		columnsPix.allocate(curWidth, 1, 4);
+		updateGUI = true;
+	}
+
+	if(updateGUI) { // one upload of curWidth texels
+		updateGUI = false;
+		columnsRange = 1;
+		for(int i = 0; i < curWidth ; ++i) {
+			columnsRange = MAX(columnsRange, MAX(fabsf(minBuf[i]), fabsf(maxBuf[i])));
+		}
+		unsigned char *p = columnsPix.getData();
+		for(int i = 0; i < curWidth ; ++i, p += 4) {
+			int qmin = ofClamp((minBuf[i] / columnsRange + 1) * 32767.5f, 0.0f, 65535.0f);
+			int qmax = ofClamp((maxBuf[i] / columnsRange + 1) * 32767.5f, 0.0f, 65535.0f);
+			p[0] = qmin >> 8; p[1] = qmin & 255;
+			p[2] = qmax >> 8; p[3] = qmax & 255;
+		}
+		columnsTex->loadData(columnsPix);
+	}
+
+	ofColor styleColor = ofGetStyle().color;
+	bool wasFilled = ofGetStyle().bFill;
+	float ymax = columnsRange * fabsf(height) + strokeWidth + 2;
+
+	shader.begin();
+	shader.setUniformTexture("columns", *columnsTex, 1);
+	shader.setUniform1f("width", curWidth);
+	shader.setUniform1f("offset", bufIndex % curWidth);
+	shader.setUniform1f("range", columnsRange);
+	shader.setUniform1f("height", height);
+	shader.setUniform1i("curve", curve);
+	shader.setUniform4f("fillColor", styleColor.r / 255.0 * fillColor.r, styleColor.g / 255.0 * fillColor.g,
+		styleColor.b / 255.0 * fillColor.b, styleColor.a / 255.0 * fillColor.a);
+	shader.setUniform4f("strokeColor", styleColor.r / 255.0 * strokeColor.r, styleColor.g / 255.0 * strokeColor.g,
+		styleColor.b / 255.0 * strokeColor.b, styleColor.a / 255.0 * strokeColor.a);
+	shader.setUniform1f("fill", fill);
+	shader.setUniform1f("stroke", stroke);
+	shader.setUniform1f("strokeWidth", strokeWidth);
+	ofFill();
+	ofDrawRectangle(-curWidth/2.0, -ymax, curWidth, 2 * ymax);
+	if(!wasFilled) ofNoFill();
+	shader.end();
+	return true;
+#endif
+}
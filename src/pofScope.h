@@ -6,46 +6,164 @@
 #pragma once
 
 #include "pofBase.h"
+#include "RWmutex.h"
+#include <atomic>
 
 class pofScope;
 
+// min and max of a column of the scope, computed by the DSP.
+struct pofScopeColumn {
+	int index, width;
+	float min, max;
+};
+
+// Wait-free single producer (DSP) / single consumer ring.
+// When the consumer doesn't read it, the new elements are dropped.
+template<class T, unsigned int SIZE> class pofScopeRing { // SIZE: power of 2
+	public:
+		pofScopeRing(): head(0), tail(0) {}
+
+		bool push(const T &e) {
+			unsigned h = head.load(std::memory_order_relaxed);
+			if(h - tail.load(std::memory_order_acquire) >= SIZE) return false;
+			elements[h & (SIZE - 1)] = e;
+			head.store(h + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool pop(T &e) {
+			unsigned t = tail.load(std::memory_order_relaxed);
+			if(t == head.load(std::memory_order_acquire)) return false;
+			e = elements[t & (SIZE - 1)];
+			tail.store(t + 1, std::memory_order_release);
+			return true;
+		}
+
+		int push(const T *e, int n) { // returns the number of elements pushed
+			unsigned h = head.load(std::memory_order_relaxed);
+			int room = SIZE - (h - tail.load(std::memory_order_acquire));
+			if(n > room) n = room;
+			for(int i = 0; i < n; i++) elements[(h + i) & (SIZE - 1)] = e[i];
+			head.store(h + n, std::memory_order_release);
+			return n;
+		}
+
+		int pop(T *e, int n) { // returns the number of elements popped
+			unsigned t = tail.load(std::memory_order_relaxed);
+			int count = head.load(std::memory_order_acquire) - t;
+			if(n > count) n = count;
+			for(int i = 0; i < n; i++) e[i] = elements[(t + i) & (SIZE - 1)];
+			tail.store(t + n, std::memory_order_release);
+			return n;
+		}
+
+	private:
+		T elements[SIZE];
+		std::atomic<unsigned> head, tail;
+};
+
+// Min/max levels (each one half the size of the previous one) of a packed peaks array
+// or of an audio array, so that any part of the array can be read in O(width).
+// The Pd thread folds the array into the level 0, one chunk per clock tick (finding the array
+// again at each tick, as it can be resized or deleted meanwhile); a background thread builds
+// the other levels. Audio views finer than a level 0 entry per column read a copy of their samples.
+class pofScopePyramid {
+	public:
+		enum Source { PEAKS, AUDIO };
+		// audio samples per level 0 entry ; level 0 entries per build step ; array entries per copy tick ;
+		// most samples copied for a fine view
+		enum { AUDIO_BLOCK = 64, CHUNK = 65536, COPY_CHUNK = 262144, WINDOW_MAX = 262144 };
+
+		pofScopePyramid();
+		~pofScopePyramid();
+
+		// Pd thread:
+		void setSource(t_symbol *array, int size, Source type); // only read again if it has changed
+		void update(int onset, int length); // this part of the array has been modified
+		void setView(float from, float length);
+
+		bool build(); // builder thread: process the next chunk; returns false when finished.
+		void read(float from, float length, int width, float *minBuf, float *maxBuf); // GL thread
+
+		std::atomic<bool> changed; // new levels are available
+
+	private:
+		struct Level {
+			vector<float> min, max;
+		};
+		void allocate(int size, Source type); // with mutex locked
+		void getSource(int index, float &min, float &max); // with mutex locked
+		int base() { return type == AUDIO ? AUDIO_BLOCK : 1; }
+		static void copyTick(pofScopePyramid *x);
+		t_word *findArray(int &size); // Pd thread
+		void copyWindow(t_word *vec, int from, int end); // with mutex locked
+
+		// Pd thread:
+		t_symbol *arrayName;
+		t_clock *copyClock;
+		int copyFrom, copyTo; // array indices still to be read
+		float viewFrom, viewLength;
+
+		ofMutex mutex;
+		Source type;
+		int size;
+		int dirtyFrom, dirtyTo; // level 0 entries whose upper levels are still to be built
+		vector<Level> levels;
+		vector<float> window; // AUDIO: the viewed samples (if not too many), from windowFrom
+		int windowFrom;
+};
+
 class pofScope: public pofBase {
 	public:
 		pofScope(t_class *Class, float w=0, float h=0, int len=0):
 			pofBase(Class),width(w), height(h),
-			bufLen(len), bufIndex(0), compute(false), readPeaks(false),
-			curve(0), stroke(1), fill(1), strokeColor(1,1,1,1), fillColor(1,1,1,1), strokeWidth(1)
+			bufLen(len), bufIndex(0), compute(false), readPeaks(false), showPeaks(false),
+			viewType(pofScopePyramid::PEAKS), viewSize(0),
+			curve(0), stroke(1), fill(1), strokeColor(1,1,1,1), fillColor(1,1,1,1), strokeWidth(1),
+			dspWidth(0), dspLen(0), column(0), colEnd(0), colMin(0), colMax(0), columnsTex(NULL), columnsRange(1)
 		{
 			curWidth = int(width);
 			minBuf = new float[curWidth];
 			maxBuf = new float[curWidth];
 			std::fill_n(minBuf, curWidth, 0);
 			std::fill_n(maxBuf, curWidth, 0);
+			pyramid = new pofScopePyramid();
 		}
 
 		~pofScope() { 
 			delete [] minBuf;
 			delete [] maxBuf;
+			treeMutex.lockW();
+			if(columnsTex) texturesToDelete.push_back(columnsTex);
+			delete pyramid;
+			treeMutex.unlockW();
 		}
 		
 		virtual void draw();
 		static void setup(void);
+		void resize(int w); // GL thread
+		bool drawShader(); // false if the shader isn't available
+
+		// DSP thread:
+		void resetColumns();
+		void endColumn();
 		
 		float width, height;
 		int bufLen; // nb samples to draw
 		int bufCount;
 		int bufIndex;
-		float min, max;
-		float *minBuf, *maxBuf;
+		float *minBuf, *maxBuf; // GL thread
 		int curWidth;
 		bool compute;
 		bool once;
 		ofMutex Mutex;
-		bool readPeaks;
-		t_word *peaksVec;
-		int peaksSize;
+		bool readPeaks; // the view has changed
+		bool showPeaks;
 		float peaksFrom;
 		float peaksLen;
+		pofScopePyramid *pyramid;
+		pofScopePyramid::Source viewType; // Pd thread: last peaks or wave table
+		int viewSize;
 		bool updateGUI;
 		int curve;
 		bool stroke;
@@ -54,6 +172,20 @@ class pofScope: public pofBase {
 		ofFloatColor fillColor;
 		float strokeWidth;
 		ofPath minpath, maxpath, fillpath;
+
+		pofScopeRing<pofScopeColumn, 4096> ring;
+		int dspWidth, dspLen; // geometry used by the DSP
+		int column, colEnd; // current column, and the sample count ending it
+		t_sample colMin, colMax;
+
+		// GPU drawing: the columns are uploaded to a texture, drawn by a shader.
+		ofTexture *columnsTex;
+		ofPixels columnsPix;
+		float columnsRange;
+		static ofShader shader;
+		static int shaderState; // 0: not loaded, 1: ready, -1: unavailable
+		static std::list<ofTexture*> texturesToDelete;
+		static void initFrame(ofEventArgs & args); // collect garbage
 };
 
 
@@ -0,0 +1,329 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#include "pofSpectrum.h"
+#include "RWmutex.h"
+
+t_class *pofspectrum_class;
+
+// Runs the FFTs of all the spectrums. The DSP doesn't wake it up (that wouldn't be
+// wait-free), it polls the rings a bit more often than a hop of the smallest FFT.
+class pofSpectrumAnalyzer: public ofThread {
+	std::set<pofSpectrum*> spectrums;
+	ofMutex mutex;
+
+	public:
+	void add(pofSpectrum *spectrum) {
+		mutex.lock();
+		spectrums.insert(spectrum);
+		if(!isThreadRunning()) startThread();
+		mutex.unlock();
+	}
+
+	void remove(pofSpectrum *spectrum) { // when it returns, the spectrum isn't used anymore.
+		mutex.lock();
+		spectrums.erase(spectrum);
+		mutex.unlock();
+	}
+
+	void threadedFunction() {
+		while(isThreadRunning()) {
+			mutex.lock();
+			for(std::set<pofSpectrum*>::iterator it = spectrums.begin(); it != spectrums.end(); it++)
+				(*it)->analyze();
+			mutex.unlock();
+			ofSleepMillis(5);
+		}
+	}
+};
+
+static pofSpectrumAnalyzer spectrumAnalyzer;
+
+static int pofspectrum_size(float size) // power of 2, from 64 to 16384
+{
+	int n = 64;
+	while(n < size && n < 16384) n *= 2;
+	return n;
+}
+
+pofSpectrum::~pofSpectrum()
+{
+	spectrumAnalyzer.remove(this);
+	treeMutex.lockW();
+	if(tex) pofScope::texturesToDelete.push_back(tex);
+	treeMutex.unlockW();
+}
+
+void pofSpectrum::fft()
+{
+	int n = workSize;
+
+	for(int i = 1, j = 0; i < n; i++) { // bit reversal
+		int bit = n >> 1;
+		for(; j & bit; bit >>= 1) j ^= bit;
+		j ^= bit;
+		if(i < j) {
+			std::swap(re[i], re[j]);
+			std::swap(im[i], im[j]);
+		}
+	}
+
+	for(int len = 2; len <= n; len <<= 1) {
+		int half = len / 2;
+		double wr = cos(-2 * M_PI / len), wi = sin(-2 * M_PI / len);
+		for(int i = 0; i < n; i += len) {
+			double cr = 1, ci = 0;
+			for(int k = i; k < i + half; k++) {
+				float vr = re[k + half] * cr - im[k + half] * ci;
+				float vi = re[k + half] * ci + im[k + half] * cr;
+				re[k + half] = re[k] - vr;
+				im[k + half] = im[k] - vi;
+				re[k] += vr;
+				im[k] += vi;
+				double t = cr * wr - ci * wi;
+				ci = cr * wi + ci * wr;
+				cr = t;
+			}
+		}
+	}
+}
+
+void pofSpectrum::computeFrame()
+{
+	for(int i = 0; i < workSize; i++) {
+		re[i] = input[i] * window[i];
+		im[i] = 0;
+	}
+	fft();
+
+	vector<float> frame(workSize / 2);
+	float scale = 4.0 / workSize; // a full scale sine gives 0dB (hann window)
+	float range = maxDB - minDB;
+	if(range == 0) range = 1;
+	for(int k = 0; k < workSize / 2; k++) {
+		float db = 20 * log10f(sqrtf(re[k] * re[k] + im[k] * im[k]) * scale + 1e-10);
+		frame[k] = ofClamp((db - minDB) / range, 0.0f, 1.0f);
+	}
+
+	framesMutex.lock();
+	frames.push_back(vector<float>());
+	frames.back().swap(frame);
+	while((int)frames.size() > MAX(history, 1)) frames.pop_front();
+	framesMutex.unlock();
+}
+
+void pofSpectrum::analyze()
+{
+	t_sample buf[1024];
+	int n, size = fftSize;
+
+	if(size != workSize) {
+		workSize = size;
+		filled = 0;
+		input.assign(workSize, 0);
+		re.resize(workSize);
+		im.resize(workSize);
+		window.resize(workSize);
+		for(int i = 0; i < workSize; i++) window[i] = 0.5 - 0.5 * cos(2 * M_PI * i / workSize);
+	}
+
+	while((n = ring.pop(buf, 1024)) > 0) {
+		for(int i = 0; i < n; i++) {
+			input[filled++] = buf[i];
+			if(filled == workSize) { // half overlapping frames
+				computeFrame();
+				std::copy(input.begin() + workSize / 2, input.end(), input.begin());
+				filled = workSize / 2;
+			}
+		}
+	}
+}
+
+/*******************************************/
+
+void *pofspectrum_new(t_floatarg w, t_floatarg h, t_floatarg size)
+{
+	if(w <= 0) w = 1;
+	if(size <= 0) size = 1024;
+
+	pofSpectrum* obj = new pofSpectrum(pofspectrum_class, w, h, pofspectrum_size(size));
+
+	floatinlet_new(&obj->pdobj->x_obj, &obj->width);
+	floatinlet_new(&obj->pdobj->x_obj, &obj->height);
+
+	spectrumAnalyzer.add(obj);
+
+	return (void*) (obj->pdobj);
+}
+
+void pofspectrum_free(void *x)
+{
+	pofSpectrum* px = (pofSpectrum*)(((PdObject*)x)->parent);
+	delete px;
+}
+
+void pofspectrum_compute(void *x, float comp)
+{
+	pofSpectrum* px = (pofSpectrum*)(((PdObject*)x)->parent);
+	px->compute = (comp != 0);
+}
+
+void pofspectrum_spectrogram(void *x, float on)
+{
+	pofSpectrum* px = (pofSpectrum*)(((PdObject*)x)->parent);
+	px->spectrogram = (on != 0);
+}
+
+void pofspectrum_fftsize(void *x, float size)
+{
+	pofSpectrum* px = (pofSpectrum*)(((PdObject*)x)->parent);
+	px->fftSize = pofspectrum_size(size);
+}
+
+void pofspectrum_range(void *x, float mindb, float maxdb)
+{
+	pofSpectrum* px = (pofSpectrum*)(((PdObject*)x)->parent);
+	px->minDB = mindb;
+	px->maxDB = maxdb;
+}
+
+void pofspectrum_history(void *x, float columns)
+{
+	pofSpectrum* px = (pofSpectrum*)(((PdObject*)x)->parent);
+	px->history = MAX(int(columns), 1);
+}
+
+static t_int *pofspectrum_perform(t_int *w)
+{
+	pofSpectrum* px = (pofSpectrum*)(((PdObject*)w[1])->parent);
+	t_sample *in = (t_sample *)(w[2]);
+	int n = *(t_int *)(w+3);
+
+	if(px->compute) px->ring.push(in, n);
+
+	return (w + 4);
+}
+
+static void pofspectrum_dsp(void *x, t_signal **sp)
+{
+	dsp_add(pofspectrum_perform, 3, x, sp[0]->s_vec, sp[0]->s_n);
+}
+
+void pofSpectrum::setup(void)
+{
+	pofspectrum_class = class_new(gensym("pofspectrum"), (t_newmethod)pofspectrum_new, (t_method)pofspectrum_free,
+		sizeof(PdObject), 0, A_DEFFLOAT, A_DEFFLOAT, A_DEFFLOAT, A_NULL);
+	POF_SETUP(pofspectrum_class);
+	class_addmethod(pofspectrum_class, (t_method)pofspectrum_compute, gensym("compute"), A_FLOAT, A_NULL);
+	class_addmethod(pofspectrum_class, (t_method)pofspectrum_spectrogram, gensym("spectrogram"), A_DEFFLOAT, A_NULL);
+	class_addmethod(pofspectrum_class, (t_method)pofspectrum_fftsize, gensym("fftsize"), A_FLOAT, A_NULL);
+	class_addmethod(pofspectrum_class, (t_method)pofspectrum_range, gensym("range"), A_FLOAT, A_FLOAT, A_NULL);
+	class_addmethod(pofspectrum_class, (t_method)pofspectrum_history, gensym("history"), A_FLOAT, A_NULL);
+
+	CLASS_MAINSIGNALIN(pofspectrum_class, PdObject, x_f);
+	class_addmethod(pofspectrum_class, (t_method)pofspectrum_dsp, gensym("dsp"), A_NULL);
+}
+
+void pofSpectrum::mapBins(const vector<float> &frame, int pixels)
+{
+	int nb = frame.size();
+
+	mapped.assign(pixels, 0);
+	if(nb < 2) return;
+
+	for(int p = 0; p < pixels; p++) { // from bin 1 to the last one
+		float b0 = powf(nb, (float)p / pixels);
+		float b1 = powf(nb, (float)(p + 1) / pixels);
+		int i0 = MIN(int(b0), nb - 1);
+		if(b1 - b0 < 1) { // less than a bin per pixel: interpolate
+			int i1 = MIN(i0 + 1, nb - 1);
+			float frac = b0 - i0;
+			mapped[p] = (1 - frac) * frame[i0] + frac * frame[i1];
+		} else {
+			int i1 = MIN(int(b1), nb);
+			float v = 0;
+			for(int i = i0; i < i1; i++) v = MAX(v, frame[i]);
+			mapped[p] = v;
+		}
+	}
+}
+
+void pofSpectrum::drawSpectrum()
+{
+	int pixels = MAX(int(width), 1);
+
+	if(lastFrame.empty()) return;
+	mapBins(lastFrame, pixels);
+
+	mesh.clear();
+	mesh.setMode(OF_PRIMITIVE_TRIANGLE_STRIP);
+	for(int p = 0; p < pixels; p++) {
+		float x = p + 0.5 - pixels / 2.0;
+		mesh.addVertex(ofPoint(x, height / 2));
+		mesh.addVertex(ofPoint(x, height / 2 - mapped[p] * height));
+	}
+	mesh.draw();
+}
+
+void pofSpectrum::drawSpectrogram(std::deque< vector<float> > &newFrames)
+{
+	int cols = MAX(history, 1);
+
+	if(!tex || texColumns != cols) {
+		ofPixels black;
+		if(!tex) tex = new ofTexture();
+		tex->allocate(cols, ROWS, GL_RGBA, false);
+		tex->setTextureMinMagFilter(GL_NEAREST, GL_NEAREST);
+		black.allocate(cols, ROWS, 4);
+		black.set(0);
+		tex->loadData(black);
+		texColumns = cols;
+		writePos = 0;
+	}
+
+	// the history is a ring texture: the new columns are written in place,
+	// with one upload until the end of the texture (and one from its beginning if it wraps).
+	int count = MIN((int)newFrames.size(), cols);
+	int first = newFrames.size() - count;
+	ofTextureData &texData = tex->getTextureData();
+	while(count > 0) {
+		int n = MIN(count, cols - writePos);
+		columns.resize(n * ROWS * 4);
+		for(int c = 0; c < n; c++) {
+			mapBins(newFrames[first + c], ROWS);
+			for(int r = 0; r < ROWS; r++) { // high frequencies at the top
+				unsigned char *p = &columns[(r * n + c) * 4];
+				p[0] = p[1] = p[2] = mapped[ROWS - 1 - r] * 255;
+				p[3] = 255;
+			}
+		}
+		glBindTexture(texData.textureTarget, texData.textureID);
+		glTexSubImage2D(texData.textureTarget, 0, writePos, 0, n, ROWS, GL_RGBA, GL_UNSIGNED_BYTE, &columns[0]);
+		glBindTexture(texData.textureTarget, 0);
+		writePos = (writePos + n) % cols;
+		first += n;
+		count -= n;
+	}
+
+	// oldest columns on the left.
+	float colWidth = width / cols;
+	int older = cols - writePos;
+	tex->drawSubsection(-width / 2, -height / 2, older * colWidth, height, writePos, 0, older, ROWS);
+	if(writePos) tex->drawSubsection(-width / 2 + older * colWidth, -height / 2, writePos * colWidth, height,
+		0, 0, writePos, ROWS);
+}
+
+void pofSpectrum::draw()
+{
+	std::deque< vector<float> > newFrames;
+
+	framesMutex.lock();
+	newFrames.swap(frames);
+	framesMutex.unlock();
+	if(!newFrames.empty()) lastFrame = newFrames.back();
+
+	if(spectrogram) drawSpectrogram(newFrames);
+	else drawSpectrum();
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#pragma once
+
+#include "pofBase.h"
+#include "pofScope.h"
+
+// Spectrum of an audio signal. The DSP only pushes the samples into a ring; the FFTs are
+// computed by a worker thread, and drawn as a log-frequency spectrum or a scrolling spectrogram.
+class pofSpectrum: public pofBase {
+	public:
+		enum { RING_SIZE = 65536, ROWS = 256 }; // ROWS: frequency resolution of the spectrogram
+
+		pofSpectrum(t_class *Class, float w, float h, int size):
+			pofBase(Class), width(w), height(h), compute(false), spectrogram(false),
+			fftSize(size), minDB(-90), maxDB(0), history(256),
+			workSize(0), filled(0), tex(NULL), texColumns(0), writePos(0)
+		{}
+		virtual ~pofSpectrum();
+
+		virtual void draw();
+		static void setup(void);
+
+		void analyze(); // worker thread
+
+		float width, height;
+		bool compute;
+		bool spectrogram;
+		std::atomic<int> fftSize;
+		float minDB, maxDB;
+		int history; // number of columns of the spectrogram
+
+		pofScopeRing<t_sample, RING_SIZE> ring; // DSP -> worker
+
+		// worker thread:
+		int workSize, filled;
+		vector<float> input, window, re, im;
+		void fft(); // in place, on re and im
+		void computeFrame();
+
+		ofMutex framesMutex;
+		std::deque< vector<float> > frames; // worker -> GL: magnitudes (0 to 1) of the bins
+
+		// GL thread:
+		vector<float> lastFrame;
+		vector<float> mapped;
+		ofMesh mesh;
+		ofTexture *tex;
+		int texColumns, writePos;
+		vector<unsigned char> columns;
+		void mapBins(const vector<float> &frame, int pixels); // log-frequency -> mapped
+		void drawSpectrum();
+		void drawSpectrogram(std::deque< vector<float> > &newFrames);
+};
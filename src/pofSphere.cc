@@ -56,3 +56,11 @@ void pofSphere::draw()
     //ofDrawSphere(radius);
     //ofDisableNormalizedTexCoords();
 }
+
+bool pofSphere::getMesh(ofMesh &m)
+{
+	if(resolution) sphere.setResolution(resolution);
+	sphere.setRadius(radius);
+	m = sphere.getMesh();
+	return true;
+}
@@ -15,6 +15,7 @@ class pofSphere: public pofBase {
 			pofBase(Class),radius(rad), resolution(res) {}
 
 		virtual void draw();
+		virtual bool getMesh(ofMesh &m);
 		static void setup(void);
 		
 		float radius;
@@ -50,7 +50,7 @@ void poftext_text(void *x, t_symbol *s, int argc, t_atom *argv)
 	
 	px->mutex.lock();
 	px->str = tmpStr.str();
-	px->mustUpdate = true;
+	px->layout();
 	px->mutex.unlock();
 }
 
@@ -58,7 +58,9 @@ void poftext_set(void *x, t_symbol *newfont)
 {
 	pofText* px= (pofText*)(((PdObject*)x)->parent);
 	px->font = newfont;
+	px->mutex.lock();
 	px->mustUpdate = true;
+	px->mutex.unlock();
 }
 
 void poftext_anchor(void *x, t_float xanchor, t_float yanchor)
@@ -73,14 +75,18 @@ void poftext_spacing(void *x, t_float space, t_float spacing)
 	pofText* px= (pofText*)(((PdObject*)x)->parent);
 	px->spaceSize = space;
 	px->letterSpacing = spacing;
+	px->mutex.lock();
 	px->mustUpdate = true;
+	px->mutex.unlock();
 }
 
 void poftext_width(void *x, t_float w)
 {
 	pofText* px= (pofText*)(((PdObject*)x)->parent);
+	px->mutex.lock();
 	px->width = w;
-	px->mustUpdate = true;
+	px->layout();
+	px->mutex.unlock();
 }
 
 void poftext_lineHeight(void *x, t_float h)
@@ -115,9 +121,63 @@ void pofText::setup(void)
 	class_addmethod(poftext_class, (t_method)poftext_lineHeight, gensym("lineheight"), A_FLOAT, A_NULL);
 }
 
-static void computeString(const string &inStr, string &outStr, ofTrueTypeFont *font, float w)
+// Decodes the UTF-8 character at s[i] into c; returns its length in bytes.
+static int decodeUTF8(const string &s, unsigned int i, unsigned int &c)
+{
+	unsigned char b = s[i];
+	int len = b < 0x80 ? 1 : (b >> 5) == 6 ? 2 : (b >> 4) == 14 ? 3 : (b >> 3) == 30 ? 4 : 1;
+	if(i + len > s.size()) len = 1;
+	if(len == 1) {
+		c = b < 0x80 ? b : 0xFFFD;
+		return 1;
+	}
+	c = b & (0x7F >> len);
+	for(int k = 1; k < len; k++) {
+		unsigned char n = s[i + k];
+		if((n >> 6) != 2) {
+			c = 0xFFFD;
+			return 1;
+		}
+		c = (c << 6) | (n & 0x3F);
+	}
+	return len;
+}
+
+// The bounding box width of a line, grown one character at a time.
+struct pofTextLineWidth {
+	const pofFontMetrics *m;
+	float pen, minX, maxX;
+	unsigned int prev;
+	bool empty;
+
+	pofTextLineWidth(const pofFontMetrics &metrics) : m(&metrics) { clear(); }
+	void clear() { pen = minX = maxX = 0; prev = 0; empty = true; }
+	void add(unsigned int c) {
+		if(c > 255) { // not in the font
+			prev = 0;
+			return;
+		}
+		if(prev) pen += m->getKerning(prev, c);
+		if(empty || pen + m->left[c] < minX) minX = pen + m->left[c];
+		if(empty || pen + m->right[c] > maxX) maxX = pen + m->right[c];
+		empty = false;
+		pen += m->advance[c];
+		prev = c;
+	}
+	void add(const string &s) {
+		unsigned int c;
+		for(unsigned int i = 0; i < s.size(); ) {
+			i += decodeUTF8(s, i, c);
+			add(c);
+		}
+	}
+	float get() { return maxX - minX; }
+};
+
+static void computeString(const string &inStr, string &outStr, const pofFontMetrics &metrics, float w)
 {
 	string tmpLine;
+	pofTextLineWidth lineWidth(metrics);
 	outStr.clear();
 	unsigned int index = 0;
 	int lastSpace = -1; // in tmpLine
@@ -125,57 +185,75 @@ static void computeString(const string &inStr, string &outStr, ofTrueTypeFont *f
 	
 	#define PUSH_TMP(newline) do { \
 		if(newline) tmpLine.push_back('\n'); \
-		outStr += tmpLine; tmpLine.clear(); wasNL = true; lastSpace = -1;\
+		outStr += tmpLine; tmpLine.clear(); lineWidth.clear(); wasNL = true; lastSpace = -1;\
 	} while(false)
-	#define printdebug false
 	
 	while(index < inStr.size()) {
-		if(inStr[index] == ' ') {
+		unsigned int c;
+		int len = decodeUTF8(inStr, index, c);
+		if(c == ' ') {
 			if(!wasNL) {
+				pofTextLineWidth before = lineWidth;
 				lastSpace = tmpLine.size();
-				if(printdebug) cout << " spaceAt:" <<lastSpace<<" ";
-				tmpLine.push_back(inStr[index]);
-				if( (font->getStringBoundingBox(tmpLine, 0, 0)).width > w) {
+				tmpLine.push_back(' ');
+				lineWidth.add(c);
+				if(lineWidth.get() > w) {
 					tmpLine.erase(tmpLine.end()-1); // remove last char
-					if(printdebug) cout <<endl<<"space wrapping ; lastSpace="<<lastSpace<<" tmpLine: "<<tmpLine<<endl;
+					lineWidth = before;
 					PUSH_TMP(true);
 				}
 			}
 		}
-		else if(inStr[index] == '\n') {
-			if(!wasNL) {
-				if(printdebug) cout <<endl<<"nl wrapping :"<<tmpLine<<endl;
-				PUSH_TMP(true);
-			} else if(printdebug) cout << " eat nl...";
+		else if(c == '\n') {
+			if(!wasNL) PUSH_TMP(true);
 		}
 		else { // normal char :
-			tmpLine.push_back(inStr[index]);
-			if(printdebug) cout << inStr[index];
-			if( (font->getStringBoundingBox(tmpLine, 0, 0)).width > w && lastSpace != -1 ) {
-				string tmp = tmpLine.substr(lastSpace + 1, tmpLine.size() - lastSpace - 1);
-				if(printdebug) cout << endl<<"wrapping ; lastSpace="<<lastSpace<<" removing: "<<tmp<<endl;
-				try {
-					tmpLine.erase(lastSpace, tmpLine.size() - lastSpace);
-				} catch(int e) { cout<<"***erase exception !***"<<endl;}
+			tmpLine.append(inStr, index, len);
+			lineWidth.add(c);
+			if(lineWidth.get() > w && lastSpace != -1) {
+				string tmp = tmpLine.substr(lastSpace + 1);
+				tmpLine.erase(lastSpace);
 				PUSH_TMP(!wasNL);
-				tmpLine = tmp;					
+				tmpLine = tmp;
+				lineWidth.add(tmp);
 			}
 			wasNL = false;
 		}
 		
-		index++;
+		index += len;
 	}
 	
 	PUSH_TMP(false);
+	#undef PUSH_TMP
+}
+
+void pofText::layout()
+{
+	if(width == 0) computedStr = str;
+	else if(metrics) computeString(str, computedStr, *metrics, width);
+	else return; // the GL thread will do it when it gets the metrics
+	mustUpdate = true;
 }
 
 void pofText::draw()
 {
-	ofTrueTypeFont *offont = pofFont::getFont(font);
+	pofFont *pfont = pofFont::getPofFont(font);
 	float lH;
 	bool update = false;
 	
-	if(offont == NULL) return;
+	if(pfont == NULL) return;
+	ofTrueTypeFont *offont = &pfont->offont;
+
+	if(width != 0 && (!metrics || metricsFont != pfont || metricsGeneration != pfont->generation
+		|| metrics->spaceSize != spaceSize || metrics->letterSpacing != letterSpacing)) {
+		pofFontMetricsPtr newMetrics = pfont->getMetrics(spaceSize, letterSpacing);
+		metricsFont = pfont;
+		metricsGeneration = pfont->generation;
+		mutex.lock();
+		metrics = newMetrics;
+		layout();
+		mutex.unlock();
+	}
 	
 	lH = offont->getLineHeight(); // backup normal lineHeigth
 	
@@ -184,19 +262,16 @@ void pofText::draw()
 	if(lineHeight!=0) offont->setLineHeight(lineHeight);
 	
 	if(mustUpdate) {
-		mustUpdate = false;
 		mutex.lock();
-		copyStr = str;
+		mustUpdate = false;
+		copyStr = computedStr;
 		mutex.unlock();
-
 		update = true;
-		if(width != 0) computeString(copyStr, computedStr, offont, width);
-		else computedStr = copyStr;
 	}
 	
-	bound = offont->getStringBoundingBox(computedStr, 0, 0);
+	bound = offont->getStringBoundingBox(copyStr, 0, 0);
 	
-	offont->drawString(computedStr,bound.width*(-xanchor-1)/2 - bound.x,bound.height*(yanchor-1)/2 - bound.y);
+	offont->drawString(copyStr,bound.width*(-xanchor-1)/2 - bound.x,bound.height*(yanchor-1)/2 - bound.y);
 	
 	offont->setLineHeight(lH); // restore font lineHeight
 
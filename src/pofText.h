@@ -6,13 +6,15 @@
 #pragma once
 
 #include "pofBase.h"
+#include "pofFont.h"
 
 class pofText;
 
 class pofText: public pofBase {
 	public:
 		pofText(t_class *Class, t_symbol *_font, float xanch=0, float yanch=0, float space=1, float spacing=1):
-		 pofBase(Class),font(_font),xanchor(xanch), yanchor(yanch), width(0), lineHeight(0), spaceSize(space), letterSpacing(spacing) {
+		 pofBase(Class),font(_font),xanchor(xanch), yanchor(yanch), width(0), lineHeight(0), spaceSize(space), letterSpacing(spacing),
+		 metricsFont(NULL), metricsGeneration(0) {
 			m_out2 = outlet_new(&(pdobj->x_obj), 0);
 		}
 
@@ -35,6 +37,13 @@ class pofText: public pofBase {
 		bool mustUpdate;
 		
 		ofMutex mutex;
+
+		// the text is wrapped (into computedStr) by the thread changing it, with the metrics of the font
+		// given by the GL thread; it's only wrapped by the GL thread when the metrics change.
+		pofFontMetricsPtr metrics;
+		pofFont *metricsFont; // GL thread
+		int metricsGeneration;
+		void layout(); // with mutex locked
 };
 
 
@@ -0,0 +1,348 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#include "pofTextView.h"
+#include "pofFonts.h"
+#include <condition_variable>
+#ifndef TARGET_WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+static t_class *poftextview_class;
+static t_symbol *s_out, *s_lines;
+
+class pofTextIndexer: public ofThread {
+	std::set<pofTextDocument*> pending;
+	std::mutex mutex;
+	std::condition_variable cond;
+
+	public:
+	void add(pofTextDocument *doc) {
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.insert(doc);
+		if(!isThreadRunning()) startThread();
+		cond.notify_one();
+	}
+
+	void remove(pofTextDocument *doc) { // when it returns, the document isn't used anymore.
+		std::lock_guard<std::mutex> lock(mutex);
+		pending.erase(doc);
+	}
+
+	void threadedFunction() {
+		std::unique_lock<std::mutex> lock(mutex);
+		pofTextDocument *last = NULL;
+		while(isThreadRunning()) {
+			if(pending.empty()) {
+				cond.wait_for(lock, std::chrono::milliseconds(100));
+				continue;
+			}
+			// round robin, so that a huge file doesn't delay the others.
+			std::set<pofTextDocument*>::iterator it = pending.upper_bound(last);
+			if(it == pending.end()) it = pending.begin();
+			last = *it;
+			if(!last->index()) pending.erase(it);
+			lock.unlock();
+			lock.lock();
+		}
+	}
+};
+
+static pofTextIndexer textIndexer;
+
+pofTextDocument::pofTextDocument(const char *path):
+	data(NULL), size(0), indexed(0), newlines(0), numLines(0), complete(false)
+{
+#ifndef TARGET_WIN32
+	int fd = open(path, O_RDONLY);
+	if(fd < 0) return;
+	struct stat st;
+	if(fstat(fd, &st) == 0) {
+		size = st.st_size;
+		if(size == 0) data = "";
+		else {
+			void *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+			if(map != MAP_FAILED) data = (const char*)map;
+		}
+	}
+	close(fd); // the mapping stays valid
+#else
+	if(!ofFile(path).exists()) return;
+	buffer = ofBufferFromFile(path, true);
+	size = buffer.size();
+	data = size ? buffer.getData() : "";
+#endif
+	if(!data) return;
+	checkpoints.push_back(0);
+	textIndexer.add(this);
+}
+
+pofTextDocument::~pofTextDocument()
+{
+	textIndexer.remove(this);
+#ifndef TARGET_WIN32
+	if(data && size) munmap((void*)data, size);
+#endif
+}
+
+bool pofTextDocument::index()
+{
+	size_t end = MIN(indexed + CHUNK, size);
+	const char *p = data + indexed, *stop = data + end;
+	vector<size_t> found;
+
+	while((p = (const char*)memchr(p, '\n', stop - p)) != NULL) {
+		p++;
+		if(++newlines % STRIDE == 0) found.push_back(p - data);
+	}
+	indexed = end;
+
+	mutex.lock();
+	checkpoints.insert(checkpoints.end(), found.begin(), found.end());
+	complete = (indexed == size);
+	numLines = newlines;
+	if(complete && size && data[size - 1] != '\n') numLines++; // unterminated last line
+	mutex.unlock();
+	return !complete;
+}
+
+int pofTextDocument::getNumLines(bool *isComplete)
+{
+	mutex.lock();
+	int n = numLines;
+	if(isComplete) *isComplete = complete;
+	mutex.unlock();
+	return n;
+}
+
+string pofTextDocument::getLine(int line)
+{
+	size_t pos = 0;
+	bool found;
+
+	mutex.lock();
+	if((found = (line >= 0 && line < numLines))) pos = checkpoints[line / STRIDE];
+	mutex.unlock();
+	if(!found) return string();
+
+	for(int i = line % STRIDE; i > 0; i--)
+		pos = (const char*)memchr(data + pos, '\n', size - pos) - data + 1;
+
+	const char *start = data + pos, *end = (const char*)memchr(start, '\n', size - pos);
+	size_t len = end ? end - start : size - pos;
+	if(len && start[len - 1] == '\r') len--;
+	if(len > MAX_LINE) {
+		len = MAX_LINE;
+		while(len && (start[len] & 0xC0) == 0x80) len--; // don't cut an utf-8 sequence
+	}
+
+	string str;
+	str.reserve(len);
+	for(size_t i = 0; i < len; i++) {
+		if(start[i] == '\t') str.append(4 - str.size() % 4, ' ');
+		else str += start[i];
+	}
+	return str;
+}
+
+/*******************************************/
+
+void *poftextview_new(t_symbol *font, t_float size)
+{
+	if(size < 1) size = 1;
+	pofTextView* obj = new pofTextView(poftextview_class, font, size);
+	obj->pdcanvas = canvas_getcurrent();
+	return (void*) (obj->pdobj);
+}
+
+void poftextview_free(void *x)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+	delete px;
+}
+
+void poftextview_readfile(void *x, t_symbol *f)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+	t_symbol* file = makefilename(f, px->pdcanvas);
+
+	pofTextDocumentPtr doc;
+	if(file) doc = pofTextDocumentPtr(new pofTextDocument(file->s_name));
+	if(!doc || !doc->isOpen()) {
+		pd_error(x, "poftextview: can't open %s", f->s_name);
+		return;
+	}
+	px->mutex.lock();
+	px->document = doc;
+	px->docChanged = true;
+	px->mutex.unlock();
+}
+
+void poftextview_set(void *x, t_symbol *newfont)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+	px->font = newfont;
+}
+
+void poftextview_size(void *x, t_float s)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+	if(s < 1) s = 1;
+	px->size = s;
+}
+
+void poftextview_width(void *x, t_float w)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+	px->width = w;
+}
+
+void poftextview_spacing(void *x, t_float spacing)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+	px->letterSpacing = spacing;
+}
+
+void poftextview_lineHeight(void *x, t_float h)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+	px->lineHeight = h;
+}
+
+void poftextview_anchor(void *x, t_float xanchor, t_float yanchor)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+	px->xanchor = xanchor;
+	px->yanchor = yanchor;
+}
+
+void poftextview_cliplines(void *x, t_float max, t_float offset)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+	if(max < 1) max = 1;
+	if(offset < 0) offset = 0;
+	px->maxLines = max;
+	px->lineOffset = offset;
+}
+
+void poftextview_out(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofTextView* px= (pofTextView*)(((PdObject*)x)->parent);
+
+	if((argc>1) && argv->a_type == A_SYMBOL)
+		outlet_anything(px->m_out2, atom_getsymbol(argv), argc-1, argv+1);
+}
+
+void pofTextView::setup(void)
+{
+	s_out = gensym("out");
+	s_lines = gensym("lines");
+	poftextview_class = class_new(gensym("poftextview"), (t_newmethod)poftextview_new, (t_method)poftextview_free,
+		sizeof(PdObject), 0, A_SYMBOL, A_FLOAT, A_NULL);
+	POF_SETUP(poftextview_class);
+	class_addmethod(poftextview_class, (t_method)poftextview_readfile, gensym("readfile"), A_SYMBOL, A_NULL);
+	class_addmethod(poftextview_class, (t_method)poftextview_set, gensym("set"), A_SYMBOL, A_NULL);
+	class_addmethod(poftextview_class, (t_method)poftextview_size, gensym("size"), A_FLOAT, A_NULL);
+	class_addmethod(poftextview_class, (t_method)poftextview_width, gensym("width"), A_FLOAT, A_NULL);
+	class_addmethod(poftextview_class, (t_method)poftextview_spacing, gensym("spacing"), A_FLOAT, A_NULL);
+	class_addmethod(poftextview_class, (t_method)poftextview_lineHeight, gensym("lineheight"), A_FLOAT, A_NULL);
+	class_addmethod(poftextview_class, (t_method)poftextview_anchor, gensym("anchor"), A_FLOAT, A_DEFFLOAT, A_NULL);
+	class_addmethod(poftextview_class, (t_method)poftextview_cliplines, gensym("cliplines"), A_DEFFLOAT, A_DEFFLOAT, A_NULL);
+	class_addmethod(poftextview_class, (t_method)poftextview_out, s_out, A_GIMME, A_NULL);
+}
+
+void pofTextView::layoutLine(int line, ofxFontStash *offont, float finalsize)
+{
+	Line &l = cache[line];
+	vector<string> lines(1, view->getLine(line));
+	vector<ofx_sth_glyph_quad> quads;
+	vector<ofRectangle> lineRects;
+
+	l.width = 0;
+	if(lines[0].empty()) return;
+	offont->layoutMultiLines(lines, finalsize, 0, 1, false, 0, quads, lineRects);
+	if(!lineRects.empty()) l.width = lineRects[0].width;
+	if(width > 0) { // crop the line
+		unsigned int n = 0;
+		while(n < quads.size() && quads[n].x1 <= width) n++;
+		quads.resize(n);
+		l.width = MIN(l.width, width);
+	}
+	pofTexts::makeBatches(quads, l.batches);
+}
+
+void pofTextView::draw()
+{
+	pofFonts *poffont = pofFonts::getFont(font);
+	if(!poffont) return;
+	ofxFontStash *offont = poffont->offont;
+	if(offont == NULL || !offont->isLoaded()) return;
+
+	mutex.lock();
+	if(docChanged) {
+		docChanged = false;
+		view = document;
+		cache.clear();
+		lastLines = -1;
+	}
+	mutex.unlock();
+	if(!view) return;
+
+	bool complete;
+	int numLines = view->getNumLines(&complete);
+	if(numLines != lastLines || complete != lastComplete) {
+		lastLines = numLines;
+		lastComplete = complete;
+		t_atom ap[4];
+
+		SETSYMBOL(&ap[0], s_out);
+		SETSYMBOL(&ap[1], s_lines);
+		SETFLOAT(&ap[2], numLines);
+		SETFLOAT(&ap[3], complete);
+		queueToSelfPd(4, ap);
+	}
+
+	float finalsize = size * poffont->scale;
+	offont->setCharacterSpacing(letterSpacing);
+	offont->setLineHeight(lineHeight);
+	if(layoutFont != poffont || layoutGeneration != poffont->generation || layoutSize != finalsize
+		|| layoutSpacing != letterSpacing || layoutWidth != width)
+	{
+		layoutFont = poffont;
+		layoutGeneration = poffont->generation;
+		layoutSize = finalsize;
+		layoutSpacing = letterSpacing;
+		layoutWidth = width;
+		cache.clear();
+		top = -offont->getBBox("Mg", finalsize, 0, 0).y;
+	}
+
+	// the lines shown, and the window laid out around them:
+	int first = MIN(lineOffset, numLines), last = MIN(first + maxLines, numLines);
+	int from = MAX(first - MARGIN, 0), to = MIN(last + MARGIN, numLines);
+
+	cache.erase(cache.begin(), cache.lower_bound(from));
+	cache.erase(cache.lower_bound(to), cache.end());
+	for(int i = first; i < last; i++) if(!cache.count(i)) layoutLine(i, offont, finalsize);
+	// a few lines of the margin per frame, so that a jump doesn't lay out the whole window at once:
+	int budget = 4;
+	for(int i = 1; i <= MARGIN && budget > 0; i++) {
+		if(last - 1 + i < to && !cache.count(last - 1 + i)) { layoutLine(last - 1 + i, offont, finalsize); budget--; }
+		if(first - i >= from && !cache.count(first - i)) { layoutLine(first - i, offont, finalsize); budget--; }
+	}
+
+	float lineStep = lineHeight * OFX_FONT_STASH_LINE_HEIGHT_MULT * finalsize;
+	float boxWidth = width;
+	if(boxWidth <= 0) for(int i = first; i < last; i++) boxWidth = MAX(boxWidth, cache[i].width);
+	float x = boxWidth * (-xanchor - 1) / 2, y = maxLines * lineStep * (yanchor - 1) / 2 + top;
+
+	ofMatrix4x4 matrix = ofGetCurrentMatrix(OF_MATRIX_MODELVIEW);
+	ofFloatColor color = ofGetStyle().color;
+	for(int i = first; i < last; i++)
+		pofTexts::addToBatch(poffont, cache[i].batches, x, y + (i - first) * lineStep, matrix, color);
+}
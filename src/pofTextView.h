@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#pragma once
+
+#include "pofBase.h"
+#include "pofTexts.h"
+
+// A read-only text file, mapped in memory. Its lines are indexed by a background thread,
+// which only keeps the offset of one line out of STRIDE: a line is found by scanning
+// at most STRIDE lines from the previous checkpoint.
+class pofTextDocument {
+	public:
+		enum { STRIDE = 64, CHUNK = 1 << 20, MAX_LINE = 4096 }; // MAX_LINE: longer lines are cropped (bytes)
+
+		pofTextDocument(const char *path);
+		~pofTextDocument();
+
+		bool isOpen() { return data != NULL; }
+		bool index(); // indexer thread: index the next chunk; returns false when finished.
+		int getNumLines(bool *complete = NULL); // lines indexed so far
+		string getLine(int line); // any thread; "" if the line isn't indexed yet
+
+	private:
+		const char *data;
+		size_t size;
+#ifdef TARGET_WIN32
+		ofBuffer buffer; // no mapping: read the whole file
+#endif
+		size_t indexed; // indexer thread: bytes indexed
+		int newlines;
+
+		ofMutex mutex;
+		vector<size_t> checkpoints; // offset of the lines 0, STRIDE, 2*STRIDE...
+		int numLines;
+		bool complete;
+};
+
+typedef std::shared_ptr<pofTextDocument> pofTextDocumentPtr;
+
+// Draws a window of cliplines lines of a text file of any size: only the shown lines,
+// and a margin around them to scroll smoothly, are read and laid out.
+class pofTextView: public pofBase {
+	public:
+		enum { MARGIN = 16 }; // lines laid out in advance above and below the window
+
+		pofTextView(t_class *Class, t_symbol *_font, float _size):
+			pofBase(Class), font(_font), size(_size), width(0), lineHeight(1), letterSpacing(0),
+			xanchor(-1), yanchor(-1), maxLines(20), lineOffset(0), docChanged(false),
+			layoutFont(NULL), layoutGeneration(-1), layoutSize(0), layoutSpacing(0), layoutWidth(0),
+			top(0), lastLines(-1), lastComplete(false)
+		{
+			m_out2 = outlet_new(&(pdobj->x_obj), 0);
+		}
+		~pofTextView() { detach(); }
+
+		virtual void draw();
+		virtual bool keepsBatches() {return true;}
+		static void setup(void);
+
+		t_symbol *font;
+		float size, width, lineHeight, letterSpacing; // width: lines are cropped there (0: not cropped)
+		float xanchor, yanchor; // -1=left/top 0=center 1=right/bottom
+		int maxLines, lineOffset;
+		t_canvas *pdcanvas;
+		t_outlet *m_out2;
+
+		ofMutex mutex;
+		pofTextDocumentPtr document;
+		bool docChanged;
+
+		// GL thread:
+		pofTextDocumentPtr view;
+		struct Line {
+			vector<pofTexts::Batch> batches;
+			float width;
+		};
+		std::map<int, Line> cache; // laid out lines of the window, by line number
+		pofFonts *layoutFont; // the cache is laid out with this font, size, spacing and width
+		int layoutGeneration;
+		float layoutSize, layoutSpacing, layoutWidth;
+		float top; // from the top of a line to its baseline
+		int lastLines;
+		bool lastComplete;
+		void layoutLine(int line, ofxFontStash *offont, float finalsize);
+};
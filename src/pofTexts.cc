@@ -9,6 +9,10 @@
 static t_class *poftexts_class;
 static t_symbol *s_out, *s_size;
 
+GLuint pofTexts::batchTexture = 0;
+pofFonts *pofTexts::batchFont = NULL;
+vector<float> pofTexts::batchVerts;
+
 void *poftexts_new(t_symbol *font, t_float size, t_float xanchor, t_float yanchor, /*t_float space,*/ t_float spacing)
 {
     //if(spacing == 0) spacing = 1;
@@ -165,6 +169,87 @@ void pofTexts::setup(void)
 	class_addmethod(poftexts_class, (t_method)poftexts_lineHeight, gensym("lineheight"), A_FLOAT, A_NULL);
 	class_addmethod(poftexts_class, (t_method)poftexts_readfile, gensym("readfile"), A_SYMBOL, A_NULL);
 	class_addmethod(poftexts_class, (t_method)poftexts_cliplines, gensym("cliplines"), A_DEFFLOAT, A_DEFFLOAT, A_NULL);
+	ofAddListener(pofBase::flushBatchesEvent, &pofTexts::flushBatch);
+}
+
+void pofTexts::flushBatch(ofEventArgs & args)
+{
+	if(batchVerts.empty()) return;
+	bool sdf = batchFont->offont && batchFont->offont->isSdf();
+	ofPushMatrix();
+	ofLoadIdentityMatrix(); // the vertices are already transformed
+	if(sdf && !batchFont->beginSdf()) {
+		// alpha test: the edge is at half the alpha of the text, so draw the runs of each alpha apart.
+		int n = batchVerts.size() / 9, first = 0;
+		while(first < n) {
+			float alpha = batchVerts[first * 9 + 8];
+			int end = first + 1;
+			while(end < n && batchVerts[end * 9 + 8] == alpha) end++;
+			if(alpha > 0) {
+				glAlphaFunc(GL_GEQUAL, 0.5 * alpha);
+				ofx_sth_draw_colored_verts(batchTexture, &batchVerts[first * 9], end - first);
+			}
+			first = end;
+		}
+	}
+	else ofx_sth_draw_colored_verts(batchTexture, &batchVerts[0], batchVerts.size() / 9);
+	if(sdf) batchFont->endSdf();
+	ofPopMatrix();
+	ofSetColor(ofGetStyle().color); // the color array has left the current color undefined
+	batchVerts.clear();
+}
+
+void pofTexts::makeBatches(const vector<ofx_sth_glyph_quad> &quads, vector<Batch> &batches)
+{
+	batches.clear();
+	for(unsigned int i = 0; i < quads.size(); i++) {
+		const ofx_sth_glyph_quad &q = quads[i];
+		unsigned int b = 0;
+		while(b < batches.size() && batches[b].texture != q.texture) b++;
+		if(b == batches.size()) {
+			batches.push_back(Batch());
+			batches[b].texture = q.texture;
+		}
+		float v[24] = {
+			q.x0, q.y0, q.s0, q.t0,
+			q.x1, q.y0, q.s1, q.t0,
+			q.x1, q.y1, q.s1, q.t1,
+			q.x0, q.y0, q.s0, q.t0,
+			q.x1, q.y1, q.s1, q.t1,
+			q.x0, q.y1, q.s0, q.t1
+		};
+		batches[b].verts.insert(batches[b].verts.end(), v, v + 24);
+	}
+}
+
+void pofTexts::addToBatch(pofFonts *poffont, const vector<Batch> &batches, float x, float y,
+	const ofMatrix4x4 &matrix, const ofFloatColor &color)
+{
+	for(unsigned int i = 0; i < batches.size(); i++) {
+		if(batchTexture != batches[i].texture) {
+			flushBatches();
+			batchTexture = batches[i].texture;
+		}
+		batchFont = poffont;
+		const vector<float> &verts = batches[i].verts;
+		int first = batchVerts.size();
+		batchVerts.resize(first + verts.size() / 4 * 9);
+		float *v = &batchVerts[first];
+		for(unsigned int j = 0; j < verts.size(); j += 4, v += 9) {
+			ofVec3f p = ofVec3f(x + verts[j], y + verts[j + 1], 0) * matrix;
+			v[0] = p.x; v[1] = p.y; v[2] = p.z;
+			v[3] = verts[j + 2]; v[4] = verts[j + 3];
+			v[5] = color.r; v[6] = color.g; v[7] = color.b; v[8] = color.a;
+		}
+		batchesPending = true;
+	}
+}
+
+void pofTexts::layout(ofxFontStash *offont, float finalsize)
+{
+	vector<ofx_sth_glyph_quad> quads;
+	offont->layoutMultiLines(lines, finalsize, width, maxLines, center, lineOffset, quads, lineRects);
+	makeBatches(quads, batches);
 }
 
 void pofTexts::draw()
@@ -187,7 +272,11 @@ void pofTexts::draw()
 		lastFinalsize = finalsize;
 		mustUpdate = true;
 	}
-	
+	if(layoutGeneration != poffont->generation) {
+		layoutGeneration = poffont->generation;
+		mustUpdate = true;
+	}
+
 	if(mustUpdate) {
 		string copyStr;
 
@@ -198,7 +287,7 @@ void pofTexts::draw()
 		update = true;
 		
 		lines = offont->computeMultiLines(
-			str,				/*string*/
+			copyStr,			/*string*/
 			finalsize,			/*size*/
 			width,				/*column width*/
 			numLines,			/*get back the number of lines*/
@@ -215,23 +304,24 @@ void pofTexts::draw()
 			finalsize,	/*size*/
 			0, 0,		/*where*/
 			width, 		/*column width*/
-			numLines,	/*get back the number of lines*/
+			drawnLines,	/*get back the number of lines*/
 			true,		/* if true, we wont draw (just get bbox back) */
 			maxLines,	/* max number of lines to draw, crop after that */
 			center, lineOffset
 		);
+		layout(offont, finalsize);
 	}
 
-	offont->drawMultiLines(
-		lines,		/*lines*/
-		finalsize,	/*size*/
-		bound.width*(-xanchor-1)/2 - bound.x,bound.height*(yanchor-1)/2 - bound.y,	/*where*/
-		width, 		/*column width*/
-		numLines,	/*get back the number of lines*/
-		false,		/* if true, we wont draw (just get bbox back) */
-		maxLines,	/* max number of lines to draw, crop after that */
-		center, lineOffset, underHeight, underWidth, underY
-	 );
+	float x = bound.width*(-xanchor-1)/2 - bound.x, y = bound.height*(yanchor-1)/2 - bound.y;
+
+	if(underHeight && !lineRects.empty()) {
+		flushBatches(); // the underlines are drawn under the text
+		for(unsigned int i = 0; i < lineRects.size(); i++)
+			ofDrawRectangle(x + lineRects[i].x + underWidth * -0.5, y + lineRects[i].y + underY, 0,
+				lineRects[i].width + underWidth, underHeight);
+	}
+
+	addToBatch(poffont, batches, x, y, ofGetCurrentMatrix(OF_MATRIX_MODELVIEW), ofGetStyle().color);
 
 	if((oldBound != bound)||update) {
 		oldBound = bound;
@@ -241,10 +331,8 @@ void pofTexts::draw()
 		SETSYMBOL(&ap[1], s_size);
 		SETFLOAT(&ap[2], bound.width);
 		SETFLOAT(&ap[3], bound.height);
-		SETFLOAT(&ap[4], numLines);
+		SETFLOAT(&ap[4], drawnLines);
 		SETFLOAT(&ap[5], totalLines);
 		queueToSelfPd(6, ap);
 	}
 }
-
-
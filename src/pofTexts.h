@@ -6,8 +6,10 @@
 #pragma once
 
 #include "pofBase.h"
+#include "ofxFontStash.h"
 
 class pofTexts;
+class pofFonts;
 
 class pofTexts: public pofBase {
 	public:
@@ -15,13 +17,14 @@ class pofTexts: public pofBase {
 		 pofBase(Class),font(_font),size(_size), xanchor(xanch), yanchor(yanch), 
 		 width(1e6), lineHeight(1), letterSpacing(spacing), center(false), 
 		 underHeight(0), underWidth(0), underY(0),
-		 maxLines(0), lineOffset(0), totalLines(0) {
+		 maxLines(0), lineOffset(0), totalLines(0), drawnLines(0), layoutGeneration(-1) {
 			m_out2 = outlet_new(&(pdobj->x_obj), 0);
 		}
 		
 		~pofTexts() { detach(); }
 		
 		virtual void draw();
+		virtual bool keepsBatches() {return true;}
 		static void setup(void);
 		
 		t_symbol *font;
@@ -33,12 +36,35 @@ class pofTexts: public pofBase {
 		float letterSpacing;	// 1= normal
 		bool center;
 		float underHeight, underWidth, underY;
-		int maxLines, lineOffset, totalLines;
+		int maxLines, lineOffset, totalLines, drawnLines;
 		
 		ofRectangle bound, oldBound;
 		
 		string str, computedStr;
 		vector<string> lines;
+
+		// layout cache: the glyph quads only change with the text, the font, the size, the width,
+		// the spacing, the clipping or the font atlas (generation); they are drawn with one
+		// vertex array per atlas texture.
+		struct Batch {
+			GLuint texture;
+			vector<float> verts; // x y s t
+		};
+		vector<Batch> batches;
+		vector<ofRectangle> lineRects; // lines to underline
+		int layoutGeneration;
+		void layout(ofxFontStash *offont, float finalsize);
+		static void makeBatches(const vector<ofx_sth_glyph_quad> &quads, vector<Batch> &batches);
+
+		// the texts drawn consecutively with the same atlas texture are gathered into one batch,
+		// transformed on the CPU and colored per vertex; it's drawn when an object needs it
+		// (see pofBase::keepsBatches()) or when the atlas changes.
+		static GLuint batchTexture;
+		static pofFonts *batchFont;
+		static vector<float> batchVerts; // x y z s t r g b a
+		static void flushBatch(ofEventArgs & args);
+		static void addToBatch(pofFonts *poffont, const vector<Batch> &batches, float x, float y,
+			const ofMatrix4x4 &matrix, const ofFloatColor &color); // batches laid out at (x, y)
 				
 		t_outlet *m_out2;
 		
@@ -20,6 +20,7 @@ class pofTouchable: public pofBase {
 		virtual void tree_touchCancel();
 
 		virtual bool computeTouch(int &x, int &y) {return true;}
+		virtual bool keepsBatches() {return true;}
 
 		void setTouchable(bool t);
 
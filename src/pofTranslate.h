@@ -15,6 +15,7 @@ class pofTranslate: public pofBase {
 
 		virtual void draw();
 		virtual void postdraw(); // called after objects bellow have been drawn
+		virtual bool keepsBatches() {return true;}
 		virtual bool computeTouch(int &x, int &y);
 		
 		static void setup(void);
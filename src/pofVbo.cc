@@ -0,0 +1,304 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#include "pofVbo.h"
+
+t_class *pofvbo_class;
+
+std::map<t_symbol*,pofsubVbo*> pofsubVbo::svbos;
+std::list<ofVbo*> pofsubVbo::vbosToDelete;
+ofMutex pofsubVbo::svbosMutex;
+
+static const int vboDims[] = {3, 4, 2, 3, 1}; // number of floats per vertex of each attribute
+
+pofsubVbo::pofsubVbo(t_symbol *n):refCount(1), name(n), numVertices(0), checkIndices(false), indicesValid(true) {
+	vbo = new ofVbo();
+	svbos[n] = this;
+}
+
+pofsubVbo::~pofsubVbo() {
+	svbos.erase(name);
+	vbosToDelete.push_back(vbo);
+}
+
+pofsubVbo* pofsubVbo::get(t_symbol *name){
+	pofsubVbo *svbo;
+	std::map<t_symbol*,pofsubVbo*>::iterator it;
+	svbosMutex.lock();
+	it = svbos.find(name);
+	if(it!=svbos.end()) { //vbo found
+		it->second->refCount++;
+		svbo = it->second;
+	}
+	else svbo = new pofsubVbo(name); // vbo not found ; create a new one.
+	svbosMutex.unlock();
+	return svbo;
+}
+
+void pofsubVbo::let(pofsubVbo *svbo) {
+	svbosMutex.lock();
+	if(!--svbo->refCount) delete svbo;
+	svbosMutex.unlock();
+}
+
+void pofsubVbo::setSize(int n, int numIndices) {
+	mutex.lock();
+	if(n >= 0) {
+		numVertices = n;
+		vertices.resize(numVertices * 3, 0);
+		if(colors.used()) colors.resize(numVertices * 4, 1);
+		if(texcoords.used()) texcoords.resize(numVertices * 2, 0);
+		if(normals.used()) normals.resize(numVertices * 3, 0);
+	}
+	if(numIndices >= 0) indices.resize(numIndices, 0);
+	checkIndices = true;
+	mutex.unlock();
+}
+
+const char *pofsubVbo::set(Attribute attr, int onset, const float *values, int count) {
+	int dim = vboDims[attr];
+	int written = 0;
+	mutex.lock();
+	switch(attr) {
+		case VERTICES: written = vertices.set(onset * dim, values, count); break;
+		case COLORS:
+			if(!colors.used()) colors.resize(numVertices * dim, 1);
+			written = colors.set(onset * dim, values, count);
+			break;
+		case TEXCOORDS:
+			if(!texcoords.used()) texcoords.resize(numVertices * dim, 0);
+			written = texcoords.set(onset * dim, values, count);
+			break;
+		case NORMALS:
+			if(!normals.used()) normals.resize(numVertices * dim, 0);
+			written = normals.set(onset * dim, values, count);
+			break;
+		case INDICES:
+			for(int i = 0; i < count; i++) if(values[i] < 0 || values[i] >= numVertices) {
+				mutex.unlock();
+				return "index out of the vertices, indices ignored";
+			}
+			written = indices.set(onset, values, count);
+			checkIndices = true;
+			break;
+	}
+	mutex.unlock();
+	if(written < count) return "values beyond the size of the vbo ignored (set the size first)";
+	return NULL;
+}
+
+#define VBO_UPLOAD(array, setData, getBuffer) \
+	if(array.reallocate) { \
+		if(array.used()) vbo->setData(&array.data[0], numVertices, GL_DYNAMIC_DRAW); \
+	} \
+	else if(array.dirtyEnd > array.dirtyStart) { \
+		vbo->getBuffer().updateData(array.dirtyStart * sizeof(float), \
+			(array.dirtyEnd - array.dirtyStart) * sizeof(float), &array.data[array.dirtyStart]); \
+	} \
+	array.clean();
+
+void pofsubVbo::upload() { // to be called from the GL thread, with mutex locked
+	if(vertices.reallocate) {
+		if(vertices.used()) vbo->setVertexData(&vertices.data[0], 3, numVertices, GL_DYNAMIC_DRAW);
+	}
+	else if(vertices.dirtyEnd > vertices.dirtyStart) {
+		vbo->getVertexBuffer().updateData(vertices.dirtyStart * sizeof(float),
+			(vertices.dirtyEnd - vertices.dirtyStart) * sizeof(float), &vertices.data[vertices.dirtyStart]);
+	}
+	vertices.clean();
+
+	VBO_UPLOAD(colors, setColorData, getColorBuffer);
+	VBO_UPLOAD(texcoords, setTexCoordData, getTexCoordBuffer);
+	VBO_UPLOAD(normals, setNormalData, getNormalBuffer);
+
+	if(indices.reallocate) {
+		if(indices.used()) vbo->setIndexData(&indices.data[0], indices.data.size(), GL_DYNAMIC_DRAW);
+	}
+	else if(indices.dirtyEnd > indices.dirtyStart) {
+		vbo->getIndexBuffer().updateData(indices.dirtyStart * sizeof(ofIndexType),
+			(indices.dirtyEnd - indices.dirtyStart) * sizeof(ofIndexType), &indices.data[indices.dirtyStart]);
+	}
+	indices.clean();
+}
+
+void pofsubVbo::draw(ofPrimitiveMode mode, int first, int count) {
+	mutex.lock();
+	upload();
+	if(checkIndices) { // the vertices may have been shrunk below the indices
+		checkIndices = false;
+		indicesValid = true;
+		for(unsigned int i = 0; i < indices.data.size() && indicesValid; i++)
+			if((int)indices.data[i] >= numVertices) indicesValid = false;
+	}
+	if(indices.used()) {
+		int numIndices = indices.data.size();
+		if(!indicesValid) numIndices = 0; // don't let the GPU read out of the vertices
+#if OF_VERSION_MAJOR == 0 && OF_VERSION_MINOR < 10
+		// drawElements() has no index offset before OF 0.10: first is ignored.
+		if(count <= 0 || count > numIndices) count = numIndices;
+		if(count > 0) vbo->drawElements(ofGetGLPrimitiveMode(mode), count);
+#else
+		if(first < 0) first = 0;
+		if(count <= 0 || first + count > numIndices) count = numIndices - first;
+		if(count > 0) vbo->drawElements(ofGetGLPrimitiveMode(mode), count, first); // first counts indices
+#endif
+	}
+	else if(numVertices) {
+		if(first < 0) first = 0;
+		if(count <= 0 || first + count > numVertices) count = numVertices - first;
+		if(count > 0) vbo->draw(ofGetGLPrimitiveMode(mode), first, count);
+	}
+	mutex.unlock();
+}
+
+bool pofsubVbo::getAttribute(const char *name, Attribute &attr) {
+	if(!strcmp(name, "vertices")) attr = VERTICES;
+	else if(!strcmp(name, "colors")) attr = COLORS;
+	else if(!strcmp(name, "texcoords")) attr = TEXCOORDS;
+	else if(!strcmp(name, "normals")) attr = NORMALS;
+	else if(!strcmp(name, "indices")) attr = INDICES;
+	else return false;
+	return true;
+}
+
+bool pofsubVbo::getMode(const char *name, ofPrimitiveMode &mode) {
+	if(!strcmp(name, "points")) mode = OF_PRIMITIVE_POINTS;
+	else if(!strcmp(name, "lines")) mode = OF_PRIMITIVE_LINES;
+	else if(!strcmp(name, "linestrip")) mode = OF_PRIMITIVE_LINE_STRIP;
+	else if(!strcmp(name, "lineloop")) mode = OF_PRIMITIVE_LINE_LOOP;
+	else if(!strcmp(name, "triangles")) mode = OF_PRIMITIVE_TRIANGLES;
+	else if(!strcmp(name, "trianglestrip")) mode = OF_PRIMITIVE_TRIANGLE_STRIP;
+	else if(!strcmp(name, "trianglefan")) mode = OF_PRIMITIVE_TRIANGLE_FAN;
+	else return false;
+	return true;
+}
+
+void pofsubVbo::initFrame(ofEventArgs & args)
+{
+	svbosMutex.lock();
+	while(!vbosToDelete.empty()) {
+		delete vbosToDelete.front();
+		vbosToDelete.pop_front();
+	}
+	svbosMutex.unlock();
+}
+
+/*******************************************/
+
+void *pofvbo_new(t_symbol *sym,int argc, t_atom *argv)
+{
+	t_symbol *name = NULL;
+	pofVbo* obj = new pofVbo(pofvbo_class);
+
+	if(argc && argv->a_type == A_SYMBOL) {
+		name = atom_getsymbol(argv); argc--; argv++;
+		if(argc && argv->a_type == A_SYMBOL) pofsubVbo::getMode(atom_getsymbol(argv)->s_name, obj->mode);
+	}
+
+	if(name == NULL) name = obj->s_self;
+
+	obj->svbo = pofsubVbo::get(name);
+
+	return (void*) (obj->pdobj);
+}
+
+void pofvbo_free(void *x)
+{
+	pofVbo *px = (pofVbo*)(((PdObject*)x)->parent);
+	delete px;
+}
+
+void pofvbo_set(void *x, t_symbol *name)
+{
+	pofVbo *px = (pofVbo*)(((PdObject*)x)->parent);
+
+	px->treeMutex.lockW();
+	pofsubVbo::let(px->svbo);
+	px->svbo = pofsubVbo::get(name);
+	px->treeMutex.unlockW();
+}
+
+void pofvbo_size(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofVbo *px = (pofVbo*)(((PdObject*)x)->parent);
+	if(!argc) return;
+	px->svbo->setSize(atom_getfloat(argv), argc > 1 ? atom_getfloat(argv + 1) : -1);
+}
+
+void pofvbo_attribute(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofVbo *px = (pofVbo*)(((PdObject*)x)->parent);
+	pofsubVbo::Attribute attr;
+
+	if(!pofsubVbo::getAttribute(s->s_name, attr) || !argc) return;
+	int onset = atom_getfloat(argv);
+	argc--; argv++;
+	vector<float> values(argc);
+	for(int i = 0; i < argc; i++) values[i] = atom_getfloat(&argv[i]);
+	const char *error = argc ? px->svbo->set(attr, onset, &values[0], argc) : NULL;
+	if(error) pd_error(x, "pofvbo %s: %s", s->s_name, error);
+}
+
+void pofvbo_fromarray(void *x, t_symbol *attrname, t_symbol *arrayname, t_float onset)
+{
+	pofVbo *px = (pofVbo*)(((PdObject*)x)->parent);
+	pofsubVbo::Attribute attr;
+	t_garray *array;
+	int size;
+	t_word *vec;
+
+	if(!pofsubVbo::getAttribute(attrname->s_name, attr)) {
+		pd_error(x, "pofvbo: unknown attribute %s", attrname->s_name);
+		return;
+	}
+	if (!(array = (t_garray *)pd_findbyclass(arrayname, garray_class))) {
+		pd_error(x, "%s: no such array", arrayname->s_name);
+		return;
+	}
+	if (!garray_getfloatwords(array, &size, &vec)) {
+		pd_error(x, "%s: bad template for fromarray", arrayname->s_name);
+		return;
+	}
+	vector<float> values(size);
+	for(int i = 0; i < size; i++) values[i] = vec[i].w_float;
+	const char *error = size ? px->svbo->set(attr, onset, &values[0], size) : NULL;
+	if(error) pd_error(x, "pofvbo %s: %s", attrname->s_name, error);
+}
+
+void pofvbo_mode(void *x, t_symbol *mode)
+{
+	pofVbo *px = (pofVbo*)(((PdObject*)x)->parent);
+	if(!pofsubVbo::getMode(mode->s_name, px->mode)) pd_error(x, "pofvbo: unknown mode %s", mode->s_name);
+}
+
+void pofvbo_range(void *x, t_float first, t_float count)
+{
+	pofVbo *px = (pofVbo*)(((PdObject*)x)->parent);
+	px->first = first;
+	px->count = count;
+}
+
+void pofVbo::setup(void)
+{
+	pofvbo_class = class_new(gensym("pofvbo"), (t_newmethod)pofvbo_new, (t_method)pofvbo_free,
+		sizeof(PdObject), 0, A_GIMME, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_set, gensym("set"), A_SYMBOL, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_size, gensym("size"), A_GIMME, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_attribute, gensym("vertices"), A_GIMME, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_attribute, gensym("colors"), A_GIMME, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_attribute, gensym("texcoords"), A_GIMME, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_attribute, gensym("normals"), A_GIMME, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_attribute, gensym("indices"), A_GIMME, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_fromarray, gensym("fromarray"), A_SYMBOL, A_SYMBOL, A_DEFFLOAT, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_mode, gensym("mode"), A_SYMBOL, A_NULL);
+	class_addmethod(pofvbo_class, (t_method)pofvbo_range, gensym("range"), A_FLOAT, A_DEFFLOAT, A_NULL);
+	POF_SETUP(pofvbo_class);
+	ofAddListener(pofBase::initFrameEvent, &pofsubVbo::initFrame);
+}
+
+void pofVbo::draw()
+{
+	svbo->draw(mode, first, count);
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#pragma once
+
+#include "pofBase.h"
+#include "RWmutex.h"
+
+// A CPU copy of a vbo attribute, with the range modified since the last upload.
+template<class T> struct pofVboArray {
+	vector<T> data;
+	int dirtyStart, dirtyEnd; // in elements of data
+	bool reallocate; // the size has changed: upload the whole array
+
+	pofVboArray() : dirtyStart(0), dirtyEnd(0), reallocate(false) {}
+	bool used() { return !data.empty(); }
+	void resize(int size, T value) {
+		if(size < 0) size = 0;
+		if((int)data.size() == size) return;
+		data.resize(size, value);
+		reallocate = true;
+	}
+	int set(int onset, const float *values, int count) { // returns the number of values written
+		if(onset < 0) { values -= onset; count += onset; onset = 0; }
+		if(onset + count > (int)data.size()) count = data.size() - onset;
+		if(count <= 0) return 0;
+		for(int i = 0; i < count; i++) data[onset + i] = values[i];
+		if(dirtyEnd == dirtyStart) { dirtyStart = onset; dirtyEnd = onset + count; }
+		else {
+			if(onset < dirtyStart) dirtyStart = onset;
+			if(onset + count > dirtyEnd) dirtyEnd = onset + count;
+		}
+		return count;
+	}
+	void clean() { dirtyStart = dirtyEnd = 0; reallocate = false; }
+};
+
+// A named vertex buffer retained on the GPU, shared by the objects using the same name
+// (pofvbo objects and poflua scripts). It is edited by ranges, from any thread;
+// the modified ranges are uploaded before drawing.
+class pofsubVbo	{
+	int refCount;
+	t_symbol *name;
+	public:
+	enum Attribute { VERTICES = 0, COLORS, TEXCOORDS, NORMALS, INDICES };
+
+	ofVbo *vbo;
+	ofMutex mutex;
+	int numVertices;
+	pofVboArray<float> vertices, colors, texcoords, normals;
+	pofVboArray<ofIndexType> indices;
+	bool checkIndices, indicesValid; // the indices are checked again after a change of them or of the size
+
+	pofsubVbo(t_symbol *n);
+	~pofsubVbo();
+
+	static std::map<t_symbol*,pofsubVbo*> svbos;
+	static std::list<ofVbo*> vbosToDelete;
+	static ofMutex svbosMutex;
+
+	static pofsubVbo* get(t_symbol *name);
+	static void let(pofsubVbo *svbo);
+
+	void setSize(int numVertices, int numIndices = -1); // numIndices < 0 : don't change
+	// onset in vertices (or indices); returns an error message, or NULL if all the values were written.
+	const char *set(Attribute attr, int onset, const float *values, int count);
+	void draw(ofPrimitiveMode mode, int first = 0, int count = 0); // first/count in indices if any; count = 0 : draw all
+	void upload();
+
+	static bool getAttribute(const char *name, Attribute &attr);
+	static bool getMode(const char *name, ofPrimitiveMode &mode);
+	static void initFrame(ofEventArgs & args); // collect garbage
+};
+
+class pofVbo: public pofBase {
+	public:
+		pofVbo(t_class *Class):
+			pofBase(Class), svbo(NULL), mode(OF_PRIMITIVE_TRIANGLES), first(0), count(0) {
+		}
+		virtual ~pofVbo() {
+			treeMutex.lockW();
+			if(svbo) pofsubVbo::let(svbo);
+			treeMutex.unlockW();
+		}
+
+		virtual void draw();
+
+		static void setup(void);
+
+		pofsubVbo *svbo;
+		ofPrimitiveMode mode;
+		int first, count;
+};
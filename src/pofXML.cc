@@ -10,6 +10,26 @@ std::map<t_symbol*,pofsubXML*> pofsubXML::xmls;
 static t_class *pofxml_class;
 static t_symbol *s_set, *s_add, *s_setattr, *s_addchild, *s_remove, *s_removeattr, *s_get, *s_gets;
 
+static void pofxml_innertext(pugi::xml_node node, string &s)
+{
+	for(pugi::xml_node n = node.first_child(); n; n = n.next_sibling()) {
+		if(n.type() == pugi::node_pcdata || n.type() == pugi::node_cdata) s += n.value();
+		else if(n.type() == pugi::node_element) pofxml_innertext(n, s);
+	}
+}
+
+// the value of an attribute, or the text of an element
+static string pofxml_getvalue(pugi::xpath_node n)
+{
+	string s;
+	if(n.attribute()) s = n.attribute().value();
+	else {
+		pugi::xml_node first = n.node().first_child();
+		if(first.type() == pugi::node_pcdata || first.type() == pugi::node_cdata) pofxml_innertext(n.node(), s);
+	}
+	return s;
+}
+
 static void *pofxml_new(t_symbol *n)
 {
     pofXML* obj = new pofXML(pofxml_class, n);
@@ -48,7 +68,7 @@ static void pofxml_save(void *x, t_symbol *file)
 	
 	SETSYMBOL(&at, filename);
 	
-	if(filename&&px->sxml->xml.save(filename->s_name)) outlet_anything(px->m_out1, gensym("saved"), 1, &at);
+	if(filename&&px->sxml->save(filename)) outlet_anything(px->m_out1, gensym("saved"), 1, &at);
 	else outlet_anything(px->m_out1, gensym("error_saving"), 1, &at);
 }
 
@@ -65,7 +85,7 @@ static void pofxml_get(void *x, t_symbol *path)
 	pofXML* px= (pofXML*)(((PdObject*)x)->parent);
 	t_binbuf *bb = binbuf_new();
 	
-	string s = px->sxml->xml.getValue(path->s_name);
+	string s = pofxml_getvalue(px->sxml->find(path));
 	if(s.length()) {
 		binbuf_text(bb, (char*)s.c_str(), s.length());
 
@@ -80,7 +100,7 @@ static void pofxml_gets(void *x, t_symbol *path)
 	pofXML* px= (pofXML*)(((PdObject*)x)->parent);
 	t_atom at;
 
-	string s = px->sxml->xml.getValue(path->s_name);
+	string s = pofxml_getvalue(px->sxml->find(path));
 	if(s.length()) {
 		SETSYMBOL(&at, gensym(s.c_str()));
 		outlet_anything(px->m_out1, s_gets, 1, &at);
@@ -92,8 +112,9 @@ static void pofxml_getnum(void *x, t_symbol *path)
 	pofXML* px= (pofXML*)(((PdObject*)x)->parent);
 	float num = 0;
 	
-	if(px->sxml->xml.exists(path->s_name) && px->sxml->xml.setTo(path->s_name)) num = px->sxml->xml.getNumChildren();
-	px->sxml->xml.reset();
+	pugi::xml_node node = px->sxml->findElement(path);
+	for(pugi::xml_node n = node.first_child(); n; n = n.next_sibling())
+		if(n.type() == pugi::node_element) num++;
 
 	outlet_float(px->m_out1, num);
 }
@@ -101,15 +122,16 @@ static void pofxml_getnum(void *x, t_symbol *path)
 static void pofxml_remove(void *x, t_symbol *path)
 {
 	pofXML* px= (pofXML*)(((PdObject*)x)->parent);
-	px->sxml->xml.remove(path->s_name);
+	pugi::xpath_node n = px->sxml->find(path);
+	if(n.attribute()) n.parent().remove_attribute(n.attribute());
+	else if(n.node()) n.node().parent().remove_child(n.node());
 }
 
 static void pofxml_removeattr(void *x, t_symbol *path)
 {
 	pofXML* px= (pofXML*)(((PdObject*)x)->parent);
-	if(px->sxml->xml.exists(path->s_name) && px->sxml->xml.setTo(path->s_name))
-		px->sxml->xml.removeAttributes();//(path->s_name);
-	px->sxml->xml.reset();
+	pugi::xml_node node = px->sxml->findElement(path);
+	while(node.first_attribute()) node.remove_attribute(node.first_attribute());
 }
 
 static void pofxml_set(void *x, t_symbol *s,int argc, t_atom *argv)
@@ -162,21 +184,36 @@ static void pofxml_set(void *x, t_symbol *s,int argc, t_atom *argv)
 		if(argc) str += " ";
 	}
 	
-	if(px->sxml->xml.exists(path->s_name) && px->sxml->xml.setTo(path->s_name)) {
-		if(s == s_set) px->sxml->xml.setValue(name->s_name, str);
-		else if(s == s_add) px->sxml->xml.addValue(name->s_name, str, false);
+	pugi::xml_node node = px->sxml->findElement(path);
+	if(node) {
+		if(s == s_set) {
+			pugi::xpath_node target = pofsubXML::findPath(node, name->s_name);
+			if(target.attribute()) target.attribute().set_value(str.c_str());
+			else if(target.node()) {
+				pugi::xml_node first = target.node().first_child();
+				if(!first) target.node().append_child(pugi::node_pcdata).set_value(str.c_str());
+				else if(first.type() == pugi::node_pcdata || first.type() == pugi::node_cdata)
+					first.set_value(str.c_str());
+			}
+		}
+		else if(s == s_add) {
+			pugi::xml_node child = node.append_child(name->s_name);
+			if(str.length()) child.append_child(pugi::node_pcdata).set_value(str.c_str());
+		}
 		else if(s == s_setattr) {
-			if(px->sxml->xml.setTo(name->s_name))
-				px->sxml->xml.setAttribute(attr->s_name, str);
-
+			pugi::xml_node target = pofsubXML::findPath(node, name->s_name).node();
+			if(target && attr != NULL) {
+				pugi::xml_attribute a = target.attribute(attr->s_name);
+				if(!a) a = target.append_attribute(attr->s_name);
+				a.set_value(str.c_str());
+			}
 		}
 		else if(s == s_addchild) {
-			if(px->sxml->xml.addChild(name->s_name) && attr != NULL) {
-				px->sxml->xml.setAttribute(attr->s_name, str);
-			}
+			pugi::xml_node child = node.append_child(name->s_name);
+			if(attr != NULL) child.append_attribute(attr->s_name).set_value(str.c_str());
 		}
 	}
-	px->sxml->xml.reset();	
+
 	binbuf_free(bb);
 	freebytes(buf, buflen);
 }
@@ -184,16 +221,18 @@ static void pofxml_set(void *x, t_symbol *s,int argc, t_atom *argv)
 static void pofxml_clear(void *x, t_symbol *root)
 {
 	pofXML* px= (pofXML*)(((PdObject*)x)->parent);
-	px->sxml->xml.clear();
+	px->sxml->doc.reset();
 	if (!root || !*root->s_name) root = gensym("root");
-	px->sxml->xml.addChild(root->s_name);
+	px->sxml->doc.append_child(root->s_name);
 }
 
 static void pofxml_print(void *x)
 {
 	pofXML* px= (pofXML*)(((PdObject*)x)->parent);
 	
-	string s = px->sxml->xml.toString();
+	std::stringstream strstr;
+	px->sxml->doc.save(strstr, "\t", pugi::format_default | pugi::format_no_declaration);
+	string s = strstr.str();
 	if(s.length()) post("xml %s: \n%s\n", px->name->s_name, s.c_str());
 }
 
@@ -6,7 +6,8 @@
 #pragma once
 
 #include "pofBase.h"
-#include <ofxXmlPoco.h>
+#include "pugixml.hpp"
+#include "pofXMLPath.h"
 
 class pofsubXML {
 
@@ -18,11 +19,11 @@ class pofsubXML {
 	ofMutex mutex;
 
 	public:
-	ofxXmlPoco xml;
+	pugi::xml_document doc;
 	bool loaded;
 	
 	pofsubXML(t_symbol *n):refCount(1), name(n), loaded(false){
-		xml.addChild("root");
+		doc.append_child("root");
 		xmls[n] = this;
 	}
 	
@@ -32,11 +33,8 @@ class pofsubXML {
 	
 	bool load(t_symbol *file) {
 		mutex.lock();
-		if(xml.load(file->s_name)) {
+		if(doc.load_file(ofToDataPath(file->s_name).c_str())) {
 			loaded = true;
-			try {
-				xml.reset();
-			} catch(...){};
 			mutex.unlock();
 			return true;
 		} else {
@@ -45,6 +43,32 @@ class pofsubXML {
 		}
 	}
 
+	bool save(t_symbol *file) {
+		return doc.save_file(ofToDataPath(file->s_name).c_str());
+	}
+
+	// paths are relative to the root element (or to the document if it hasn't any).
+	pugi::xml_node base() {
+		pugi::xml_node root = doc.document_element();
+		return root ? root : doc;
+	}
+
+	// resolve a path with the syntax of ofxXmlPoco (Poco::XML::Node::getNodeByPath()):
+	// "a/b", "a[2]" (0-based), "a[@attr]" (the attribute), "a[@attr=value]", "//a", "/" (the base).
+	// The result is either an element or an attribute.
+	pugi::xpath_node find(t_symbol *path) {
+		return findPath(base(), path->s_name);
+	}
+
+	// same as find(), but only returns elements
+	pugi::xml_node findElement(t_symbol *path) {
+		return find(path).node();
+	}
+
+	static pugi::xpath_node findPath(pugi::xml_node from, const char *path) {
+		return pofXMLFindPath(from, path);
+	}
+
 	static pofsubXML* getXML(t_symbol *name){
 		std::map<t_symbol*,pofsubXML*>::iterator it;
 		it = xmls.find(name);
@@ -6,10 +6,162 @@
 #include "pofXMLP.h"
 
 std::map<t_symbol*,pofsubXMLP*> pofsubXMLP::xmls;
+ofMutex pofsubXMLP::xmlsMutex;
 
 static t_class *pofxmlp_class;
 static t_symbol *s_set, *s_add, *s_setattr, *s_remove, *s_removeall, *s_removeattr, *s_get, *s_gets, 
-	*s_addbefore, *s_addafter, *s_copy, *s_rename, *s_setto, *s_getpath, *s_none;
+	*s_addbefore, *s_addafter, *s_copy, *s_rename, *s_setto, *s_getpath, *s_none, *s_getrows, *s_getarrays, *s_dot,
+	*s_out, *s_loaded, *s_errload, *s_saved, *s_errsave;
+
+//------------------------------------------//
+// File reading : the text is read into a buffer owned by the document, so that pugixml can
+// parse it in place, and the document doesn't depend on the file anymore.
+
+static bool readFile(const string &path, void *&data, size_t &size)
+{
+	FILE *f = fopen(path.c_str(), "rb");
+	if(!f) return false;
+	fseek(f, 0, SEEK_END);
+	long len = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	data = NULL;
+	if(len > 0 && (data = pugi::get_memory_allocation_function()(len)) != NULL) {
+		if(fread(data, 1, len, f) == (size_t)len) size = len;
+		else {
+			pugi::get_memory_deallocation_function()(data);
+			data = NULL;
+		}
+	}
+	fclose(f);
+	return data != NULL;
+}
+
+//------------------------------------------//
+// Snapshots
+
+pofXMLPSnapshot pofsubXMLP::getSnapshot(const string &name)
+{
+	pofXMLPSnapshot s;
+	std::map<t_symbol*,pofsubXMLP*>::iterator it;
+	xmlsMutex.lock();
+	for(it = xmls.begin(); it != xmls.end(); it++) {
+		if(name == it->first->s_name) {
+			s = it->second->snapshot();
+			break;
+		}
+	}
+	xmlsMutex.unlock();
+	return s;
+}
+
+// position of a node in its document, as the list of the child indices from the root
+static void pofxmlp_nodeindices(pugi::xml_node node, vector<int> &indices)
+{
+	for(; node && node.parent(); node = node.parent()) {
+		int i = 0;
+		for(pugi::xml_node n = node.previous_sibling(); n; n = n.previous_sibling()) i++;
+		indices.push_back(i);
+	}
+}
+
+void pofsubXMLP::beginEdit(bool keep)
+{
+	docMutex.lock(); // don't let other threads take a snapshot while the document is being changed
+	if(doc.use_count() == 1) {
+		if(!keep) {
+			doc->xml.reset();
+			node = doc->xml.root();
+		}
+		return;
+	}
+	// a snapshot is held somewhere: it must not change, so work on a copy.
+	std::shared_ptr<pofXMLPDoc> copy(new pofXMLPDoc());
+	if(keep) {
+		vector<int> indices;
+		pofxmlp_nodeindices(node, indices);
+		copy->xml.reset(doc->xml);
+		node = copy->xml.root();
+		for(int i = indices.size() - 1; i >= 0 && node; i--) {
+			node = node.first_child();
+			for(int j = 0; j < indices[i] && node; j++) node = node.next_sibling();
+		}
+	} else node = copy->xml.root();
+	doc = copy;
+}
+
+//------------------------------------------//
+// Load and save are done by threads; the results are reported to the Pd thread through "out",
+// where the loaded document is installed.
+
+class XMLPLoader: public ofThread {
+	public :
+	t_symbol *file, *fullfile;
+	pofXMLP* pxml;
+	pofXMLPDoc *doc; // parsed document, waiting to be installed by the Pd thread
+
+	XMLPLoader(t_symbol *f, t_symbol *ff, pofXMLP* px) : file(f), fullfile(ff), pxml(px), doc(NULL) {}
+	~XMLPLoader() {
+		if(doc) delete doc;
+	}
+
+	pofXMLPDoc *takeDoc() {
+		pofXMLPDoc *d = doc;
+		doc = NULL;
+		return d;
+	}
+
+	bool load() {
+		void *data;
+		size_t size;
+		if(!readFile(ofToDataPath(fullfile->s_name), data, size)) return false;
+		pofXMLPDoc *d = new pofXMLPDoc();
+		pugi::xml_parse_result result = d->xml.load_buffer_inplace_own(data, size); // data is freed by d
+		if(!result) {
+			ofLogError("pofxmlp") << fullfile->s_name << ": " << result.description();
+			delete d;
+			return false;
+		}
+		doc = d;
+		return true;
+	}
+
+	void threadedFunction() {
+		t_atom at[3];
+
+		SETSYMBOL(&at[0], s_out);
+		SETSYMBOL(&at[1], load() ? s_loaded : s_errload);
+		SETSYMBOL(&at[2], file);
+		pxml->queueToSelfPd(3, at);
+	}
+};
+
+class XMLPSaver: public ofThread {
+	public :
+	pofXMLPSnapshot snapshot; // the edits done during the save will work on a copy
+	t_symbol *file;
+	string path;
+	pofXMLP* pxml;
+
+	XMLPSaver(t_symbol *f, const string &p, pofXMLP* px) : file(f), path(p), pxml(px) {}
+
+	bool save() {
+		string tmp = path + ".tmp";
+		// replace the file only once the new one is complete:
+		return snapshot->xml.save_file(tmp.c_str()) && ofFile::moveFromTo(tmp, path, false, true);
+	}
+
+	void threadedFunction() {
+		t_atom at[3];
+
+		bool ok = save();
+		snapshot.reset(); // let the next edits work in place again
+
+		SETSYMBOL(&at[0], s_out);
+		SETSYMBOL(&at[1], ok ? s_saved : s_errsave);
+		SETSYMBOL(&at[2], file);
+		pxml->queueToSelfPd(3, at);
+	}
+};
 
 static void *pofxmlp_new(t_symbol *n)
 {
@@ -22,7 +174,29 @@ static void *pofxmlp_new(t_symbol *n)
 
 static void pofxmlp_free(void *x)
 {
-	delete (pofXMLP*)(((PdObject*)x)->parent);
+	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
+	if(px->loader) {
+		px->loader->waitForThread(true);
+		delete px->loader;
+	}
+	if(px->saver) {
+		px->saver->waitForThread(true);
+		delete px->saver;
+	}
+	delete px;
+}
+
+static void pofxmlp_out(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
+
+	if((argc>1) && argv->a_type == A_SYMBOL) {
+		t_symbol *msg = atom_getsymbol(argv);
+		// install the document parsed by the loader, from the Pd thread:
+		if(msg == s_loaded && px->loader && px->loader->doc)
+			px->sxml->install(px->loader->takeDoc());
+		outlet_anything(px->m_out1, msg, argc-1, argv+1);
+	}
 }
 
 static void pofxmlp_load(void *x, t_symbol *file)
@@ -33,8 +207,18 @@ static void pofxmlp_load(void *x, t_symbol *file)
 	
 	SETSYMBOL(&at, file);
 	
-	if(filename&&px->sxml->load(filename)) outlet_anything(px->m_out1, gensym("loaded"), 1, &at);
-	else outlet_anything(px->m_out1, gensym("error_loading"), 1, &at);
+	if(!filename) {
+		outlet_anything(px->m_out1, s_errload, 1, &at);
+		return;
+	}
+	if(px->loader) {
+		if(px->loader->isThreadRunning()) {
+			outlet_anything(px->m_out1, gensym("error_running"), 1, &at);
+			return;
+		}
+		delete px->loader;
+	}
+	(px->loader = new XMLPLoader(file, filename, px))->startThread();
 }
 
 static void pofxmlp_save(void *x, t_symbol *file)
@@ -49,8 +233,16 @@ static void pofxmlp_save(void *x, t_symbol *file)
 	
 	SETSYMBOL(&at, filename);
 	
-	if(filename&&px->sxml->save(filename)) outlet_anything(px->m_out1, gensym("saved"), 1, &at);
-	else outlet_anything(px->m_out1, gensym("error_saving"), 1, &at);
+	if(px->saver) {
+		if(px->saver->isThreadRunning()) {
+			outlet_anything(px->m_out1, gensym("error_running"), 1, &at);
+			return;
+		}
+		delete px->saver;
+	}
+	px->saver = new XMLPSaver(filename, ofToDataPath(filename->s_name), px);
+	px->saver->snapshot = px->sxml->snapshot();
+	px->saver->startThread();
 }
 
 static void pofxmlp_setxml(void *x, t_symbol *name)
@@ -66,8 +258,8 @@ static void pofxmlp_setto(void *x, t_symbol *path)
 	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
 	try{
 		if(*path->s_name == '/')
-			px->sxml->node = px->sxml->doc.select_node(path->s_name).node();
-		else px->sxml->node = px->sxml->node.select_node(path->s_name).node();
+			px->sxml->node = px->sxml->doc->xml.select_node(px->sxml->query(path)).node();
+		else px->sxml->node = px->sxml->selectNode(path);
 	}catch(pugi::xpath_exception & e){
 		ofLogError() << e.what();
 	}
@@ -91,7 +283,7 @@ static void pofxmlp_get(void *x, t_symbol *path, t_symbol *attr)
 	t_binbuf *bb = binbuf_new();
 	string s;
 	try{
-		pugi::xml_node node = px->sxml->node.select_node(path->s_name).node();
+		pugi::xml_node node = px->sxml->selectNode(path);
 		if(*attr->s_name) s = node.attribute(attr->s_name).as_string();
 		else s = node.text().as_string();
 	}catch(pugi::xpath_exception & e){
@@ -112,7 +304,7 @@ static void pofxmlp_gets(void *x, t_symbol *path, t_symbol *attr)
 	t_binbuf *bb = binbuf_new();
 	pugi::xpath_node_set node_set;
 	try{
-		for(auto n: px->sxml->node.select_nodes(path->s_name)) {
+		for(auto n: px->sxml->selectNodes(path)) {
 			if(*attr->s_name) s = n.node().attribute(attr->s_name).as_string();
 			else s = n.node().text().as_string();
 			SETSYMBOL(&at, gensym(s.c_str()));
@@ -130,47 +322,140 @@ static void pofxmlp_getnum(void *x, t_symbol *path)
 	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
 	float num = 0;
 	try{
-		num = px->sxml->node.select_nodes(path->s_name).size();
+		num = px->sxml->selectNodes(path).size();
 	}catch(pugi::xpath_exception & e){
 		ofLogError() << e.what();
 	}
 	outlet_float(px->m_out1, num);
 }
 
+// numbers are output as floats, everything else as symbols
+static void pofxmlp_toatom(const char *str, t_atom *at)
+{
+	char *end;
+	double d = strtod(str, &end);
+	if(*str && !*end) SETFLOAT(at, d);
+	else SETSYMBOL(at, gensym(str));
+}
+
+static void pofxmlp_getrows(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	// getrows path attr1 [attr2 ...] : output "getrows value1 value2..." for each node of the set.
+	// The attribute name "." stands for the text of the node.
+	if(argc < 2 || argv->a_type != A_SYMBOL) return;
+
+	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
+	t_symbol *path = atom_getsymbol(argv);
+	argc--; argv++;
+
+	pugi::xpath_node_set node_set;
+	try{
+		node_set = px->sxml->selectNodes(path);
+	}catch(pugi::xpath_exception & e){
+		ofLogError() << e.what();
+		return;
+	}
+
+	t_atom *row = (t_atom *)getbytes(argc * sizeof(t_atom));
+	for(auto n: node_set) {
+		for(int i = 0; i < argc; i++) {
+			t_symbol *attr = atom_getsymbol(&argv[i]);
+			if(attr != s_dot) pofxmlp_toatom(n.node().attribute(attr->s_name).as_string(), &row[i]);
+			else pofxmlp_toatom(n.node().text().as_string(), &row[i]);
+		}
+		outlet_anything(px->m_out1, s_getrows, argc, row);
+	}
+	freebytes(row, argc * sizeof(t_atom));
+}
+
+static void pofxmlp_getarrays(void *x, t_symbol *s, int argc, t_atom *argv)
+{
+	// getarrays path attr1 array1 [attr2 array2 ...] : write the numeric values of attr1 into array1...
+	// then output "getarrays number_of_nodes".
+	if(argc < 3 || argv->a_type != A_SYMBOL) return;
+
+	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
+	t_symbol *path = atom_getsymbol(argv);
+	argc--; argv++;
+
+	pugi::xpath_node_set node_set;
+	try{
+		node_set = px->sxml->selectNodes(path);
+	}catch(pugi::xpath_exception & e){
+		ofLogError() << e.what();
+		return;
+	}
+
+	for(; argc >= 2; argc -= 2, argv += 2) {
+		t_symbol *attr = atom_getsymbol(&argv[0]);
+		t_symbol *arrayname = atom_getsymbol(&argv[1]);
+		t_garray *array;
+		int size;
+		t_word *vec;
+
+		if (!(array = (t_garray *)pd_findbyclass(arrayname, garray_class))) {
+			pd_error(x, "%s: no such array", arrayname->s_name);
+			continue;
+		}
+		if(garray_npoints(array) != (int)node_set.size()) garray_resize_long(array, node_set.size());
+		if (!garray_getfloatwords(array, &size, &vec)) {
+			pd_error(x, "%s: bad template for getarrays", arrayname->s_name);
+			continue;
+		}
+
+		int i = 0;
+		for(auto n = node_set.begin(); n != node_set.end() && i < size; n++, i++) {
+			if(attr != s_dot) vec[i].w_float = n->node().attribute(attr->s_name).as_float();
+			else vec[i].w_float = n->node().text().as_float();
+		}
+		garray_redraw(array);
+	}
+
+	t_atom at;
+	SETFLOAT(&at, node_set.size());
+	outlet_anything(px->m_out1, s_getarrays, 1, &at);
+}
+
 static void pofxmlp_remove(void *x, t_symbol *path, t_symbol *child)
 {
 	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
+	px->sxml->beginEdit();
 	try{
 		pugi::xml_node node;
-		node = px->sxml->node.select_node(path->s_name).node();
+		node = px->sxml->selectNode(path);
 		node.remove_child(child->s_name);
 	}catch(pugi::xpath_exception & e){
 		ofLogError() << e.what();
 	}
+	px->sxml->endEdit();
 }
 
 static void pofxmlp_removeall(void *x, t_symbol *path, t_symbol *child)
 {
 	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
+	px->sxml->beginEdit();
 	try{
-		for(auto n: px->sxml->node.select_nodes(path->s_name)) {
+		for(auto n: px->sxml->selectNodes(path)) {
 			n.node().parent().remove_child(n.node());
 		}
 	}catch(pugi::xpath_exception & e){
 		ofLogError() << e.what();
 	}
+	px->sxml->endEdit();
 }
 
 static void pofxmlp_removeattr(void *x, t_symbol *path, t_symbol *attr)
 {
 	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
+	px->sxml->beginEdit();
 	try{
 		pugi::xml_node node;
-		node = px->sxml->node.select_node(path->s_name).node();
+		node = px->sxml->selectNode(path);
 		node.remove_attribute(attr->s_name);
 	}catch(pugi::xpath_exception & e){
 		ofLogError() << e.what();
 	}
+	px->sxml->endEdit();
 }
 
 static void pofxmlp_set(void *x, t_symbol *s,int argc, t_atom *argv)
@@ -215,8 +500,9 @@ static void pofxmlp_set(void *x, t_symbol *s,int argc, t_atom *argv)
 	}
 
 	pugi::xml_node node;
+	px->sxml->beginEdit();
 	try{
-		node = px->sxml->node.select_node(path->s_name).node();
+		node = px->sxml->selectNode(path);
 		if(s == s_set) node.text().set(str.c_str());
 		else if(s == s_add) {
 			pugi::xml_node newchild = node.append_child(name->s_name);
@@ -239,8 +525,8 @@ static void pofxmlp_set(void *x, t_symbol *s,int argc, t_atom *argv)
 		}
 	}catch(pugi::xpath_exception & e){
 		ofLogError() << e.what();
-		return;
 	}
+	px->sxml->endEdit();
 
 	binbuf_free(bb);
 	freebytes(buf, buflen);
@@ -249,16 +535,21 @@ static void pofxmlp_set(void *x, t_symbol *s,int argc, t_atom *argv)
 static void pofxmlp_clear(void *x, t_symbol *root)
 {
 	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
-	px->sxml->doc.reset();
 	if (!*root->s_name) root = gensym("root");
-	px->sxml->doc.append_child(root->s_name);
+	px->sxml->beginEdit(false);
+	px->sxml->doc->xml.append_child(root->s_name);
+	px->sxml->endEdit();
 }
 
 static void pofxmlp_copy(void *x, t_symbol *srcxml)
 {
 	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
 	pofsubXMLP *sxml = pofsubXMLP::getXML(srcxml);
-	px->sxml->doc.reset(sxml->doc);
+	if(sxml != px->sxml) {
+		px->sxml->beginEdit(false);
+		px->sxml->doc->xml.reset(sxml->doc->xml);
+		px->sxml->endEdit();
+	}
 	pofsubXMLP::letXML(sxml);
 }
 
@@ -267,8 +558,8 @@ static void pofxmlp_print(void *x, t_symbol *path)
 	pofXMLP* px= (pofXMLP*)(((PdObject*)x)->parent);
 	std::stringstream strstr;
 	try{
-		if(*path->s_name) px->sxml->node.select_node(path->s_name).node().print(strstr);
-		else px->sxml->doc.print(strstr);
+		if(*path->s_name) px->sxml->selectNode(path).print(strstr);
+		else px->sxml->doc->xml.print(strstr);
 	}catch(pugi::xpath_exception & e){
 		ofLogError() << e.what();
 	}
@@ -298,10 +589,19 @@ void pofXMLP::setup(void)
 	s_setto = gensym("setto");
 	s_getpath = gensym("getpath");
 	s_none = gensym("");
+	s_getrows = gensym("getrows");
+	s_getarrays = gensym("getarrays");
+	s_dot = gensym(".");
+	s_out = gensym("out");
+	s_loaded = gensym("loaded");
+	s_errload = gensym("error_loading");
+	s_saved = gensym("saved");
+	s_errsave = gensym("error_saving");
 	
 	pofxmlp_class = class_new(gensym("pofxmlp"), (t_newmethod)pofxmlp_new, (t_method)pofxmlp_free,
 		sizeof(PdObject), 0, A_SYMBOL, A_NULL);
 
+	class_addmethod(pofxmlp_class, (t_method)pofxmlp_out, s_out, A_GIMME, A_NULL);
 	class_addmethod(pofxmlp_class, (t_method)pofxmlp_load, gensym("load"), A_SYMBOL, A_NULL);
 	class_addmethod(pofxmlp_class, (t_method)pofxmlp_setxml, gensym("setxml"), A_SYMBOL, A_NULL);
 	class_addmethod(pofxmlp_class, (t_method)pofxmlp_save, gensym("save"), A_SYMBOL, A_NULL);
@@ -309,6 +609,8 @@ void pofXMLP::setup(void)
 	class_addmethod(pofxmlp_class, (t_method)pofxmlp_getpath, s_getpath, A_NULL);
 	class_addmethod(pofxmlp_class, (t_method)pofxmlp_get, s_get, A_SYMBOL, A_DEFSYMBOL, A_NULL);
 	class_addmethod(pofxmlp_class, (t_method)pofxmlp_gets, s_gets, A_SYMBOL, A_DEFSYMBOL, A_NULL);
+	class_addmethod(pofxmlp_class, (t_method)pofxmlp_getrows, s_getrows, A_GIMME, A_NULL);
+	class_addmethod(pofxmlp_class, (t_method)pofxmlp_getarrays, s_getarrays, A_GIMME, A_NULL);
 	class_addmethod(pofxmlp_class, (t_method)pofxmlp_set, s_set, A_GIMME, A_NULL);
 	class_addmethod(pofxmlp_class, (t_method)pofxmlp_set, s_rename, A_GIMME, A_NULL);
 	class_addmethod(pofxmlp_class, (t_method)pofxmlp_set, s_add, A_GIMME, A_NULL);
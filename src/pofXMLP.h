@@ -8,41 +8,101 @@
 #include "pofBase.h"
 #include "pugixml.hpp"
 
+#define XPATH_CACHE_SIZE 1024
+
+// A version of a document.
+class pofXMLPDoc {
+	public:
+	pugi::xml_document xml;
+};
+
+// A published version of a document: it isn't modified anymore while it is shared, so it can be
+// read from any thread without locking; it is deleted when its last holder releases it.
+typedef std::shared_ptr<const pofXMLPDoc> pofXMLPSnapshot;
+
 class pofsubXMLP {
 
 	int refCount;
 	t_symbol *name;
 	
 	static std::map<t_symbol*,pofsubXMLP*> xmls;
+	static ofMutex xmlsMutex; // protects xmls against getSnapshot() from other threads
+	ofMutex docMutex; // protects the doc pointer (not the document itself)
+	// compiled XPath expressions (symbols are unique, so the expression string is the key)
+	std::map<t_symbol*,pugi::xpath_query*> queries;
 
 	public:
-	pugi::xml_document doc;
+	// current version of the document, modified by the Pd thread only, between beginEdit() and endEdit().
+	std::shared_ptr<pofXMLPDoc> doc;
 	pugi::xml_node node;
 	
 	bool loaded;
 	
-	pofsubXMLP(t_symbol *n):refCount(1), name(n), loaded(false){
+	pofsubXMLP(t_symbol *n):refCount(1), name(n), doc(new pofXMLPDoc()), loaded(false){
 		//xml.addChild("root");
-		node = doc.root();
+		node = doc->xml.root();
+		xmlsMutex.lock();
 		xmls[n] = this;
+		xmlsMutex.unlock();
 	}
 	
 	~pofsubXMLP() {
+		clearQueries();
+		xmlsMutex.lock();
 		xmls.erase(name);
+		xmlsMutex.unlock();
 	}
-	
-	bool load(t_symbol *file) {
-		if(doc.load_file(ofToDataPath(file->s_name).c_str())) {
-			loaded = true;
-			node = doc.root();
-			return true;
-		} else return false;
+
+	// get the current version of the document; can be called from any thread.
+	pofXMLPSnapshot snapshot() {
+		docMutex.lock();
+		pofXMLPSnapshot s = doc;
+		docMutex.unlock();
+		return s;
+	}
+	// snapshot of the document of this name (empty if there's no such pofxmlp); any thread.
+	static pofXMLPSnapshot getSnapshot(const string &name);
+
+	// Every modification of the document must be enclosed by beginEdit() and endEdit().
+	// If a snapshot of the current version is held somewhere, the edit works on a copy
+	// (or on a new empty document if keep is false).
+	void beginEdit(bool keep = true);
+	void endEdit() { docMutex.unlock(); }
+
+	// get the compiled query for this expression; throws pugi::xpath_exception if invalid.
+	const pugi::xpath_query &query(t_symbol *path) {
+		std::map<t_symbol*,pugi::xpath_query*>::iterator it = queries.find(path);
+		if(it != queries.end()) return *it->second;
+		if(queries.size() >= XPATH_CACHE_SIZE) clearQueries();
+		pugi::xpath_query *q = new pugi::xpath_query(path->s_name);
+		queries[path] = q;
+		return *q;
+	}
+
+	void clearQueries() {
+		std::map<t_symbol*,pugi::xpath_query*>::iterator it;
+		for(it = queries.begin(); it != queries.end(); it++) delete it->second;
+		queries.clear();
+	}
+
+	pugi::xml_node selectNode(t_symbol *path) {
+		return node.select_node(query(path)).node();
+	}
+
+	pugi::xpath_node_set selectNodes(t_symbol *path) {
+		return node.select_nodes(query(path));
 	}
 	
-	bool save(t_symbol *file) {
-		return doc.save_file(ofToDataPath(file->s_name).c_str());
+	// install a document loaded by a thread; the previous version is deleted when its last
+	// snapshot is released.
+	void install(pofXMLPDoc *newdoc) {
+		docMutex.lock();
+		doc.reset(newdoc);
+		docMutex.unlock();
+		node = doc->xml.root();
+		loaded = true;
 	}
-		
+
 	static pofsubXMLP* getXML(t_symbol *name){
 		std::map<t_symbol*,pofsubXMLP*>::iterator it;
 		it = xmls.find(name);
@@ -63,9 +123,12 @@ class pofsubXMLP {
 };
 
 
+class XMLPLoader;
+class XMLPSaver;
+
 class pofXMLP: public pofBase {
 	public:
-		pofXMLP(t_class *Class, t_symbol *n):pofBase(Class), name(n) {
+		pofXMLP(t_class *Class, t_symbol *n):pofBase(Class), name(n), loader(NULL), saver(NULL) {
 			sxml = pofsubXMLP::getXML(n);
 		}
 		
@@ -78,6 +141,8 @@ class pofXMLP: public pofBase {
 		t_symbol *name;
 		pofsubXMLP *sxml;
 		t_canvas *pdcanvas;
+		XMLPLoader *loader;
+		XMLPSaver *saver;
 };
 
 
@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#include "pofXMLPath.h"
+#include <string>
+#include <cstdlib>
+
+using std::string;
+
+// Path resolution, following Poco::XML::AbstractNode::findNode() (used by the former ofxXmlPoco backend).
+
+static pugi::xpath_node pofxml_findnode(const char *it, pugi::xml_node node)
+{
+	if(!node) return pugi::xpath_node();
+
+	if(*it == '[') {
+		it++;
+		if(*it == '@') {
+			it++;
+			const char *start = it;
+			while(*it && *it != ']' && *it != '=') it++;
+			string attr(start, it - start);
+			if(*it == '=') { // [@attr=value] : first element of this name having attr=value
+				string value;
+				it++;
+				if(*it == '\'') {
+					start = ++it;
+					while(*it && *it != '\'') it++;
+					value.assign(start, it - start);
+					if(*it) it++;
+				} else {
+					start = it;
+					while(*it && *it != ']') it++;
+					value.assign(start, it - start);
+				}
+				if(*it) it++;
+				pugi::xml_node n = node;
+				while(n && value != n.attribute(attr.c_str()).value()) n = n.next_sibling(node.name());
+				return pofxml_findnode(it, n);
+			} else { // [@attr] : the attribute itself
+				pugi::xml_attribute a = node.attribute(attr.c_str());
+				if(a) return pugi::xpath_node(a, node);
+				else return pugi::xpath_node();
+			}
+		} else { // [index] : index-th element of this name, starting from 0
+			int index = atoi(it);
+			while(*it && *it != ']') it++;
+			if(*it) it++;
+			pugi::xml_node n = node;
+			while(n && index-- > 0) n = n.next_sibling(node.name());
+			return pofxml_findnode(it, n);
+		}
+	}
+
+	while(*it == '/') it++;
+	if(!*it) return pugi::xpath_node(node);
+
+	const char *start = it;
+	while(*it && *it != '/' && *it != '[') it++;
+	string key(start, it - start);
+	// first element of this name for which the rest of the path can be resolved:
+	for(pugi::xml_node e = node.child(key.c_str()); e; e = e.next_sibling(key.c_str())) {
+		pugi::xpath_node found = pofxml_findnode(it, e);
+		if(found) return found;
+	}
+	return pugi::xpath_node();
+}
+
+pugi::xpath_node pofXMLFindPath(pugi::xml_node from, const char *path)
+{
+	if(path[0] == '/' && path[1] == '/') { // search the descendants in document order
+		path += 2;
+		const char *start = path;
+		while(*path && *path != '/' && *path != '[') path++;
+		string name(start, path - start);
+		if(*path == '/') path++;
+		bool any = (name.empty() || name == "*");
+
+		pugi::xml_node n = from.first_child();
+		while(n) {
+			if(n.type() == pugi::node_element && (any || name == n.name())) {
+				pugi::xpath_node found = pofxml_findnode(path, n);
+				if(found) return found;
+			}
+			if(n.first_child()) n = n.first_child();
+			else {
+				while(n != from && !n.next_sibling()) n = n.parent();
+				if(n == from) break;
+				n = n.next_sibling();
+			}
+		}
+		return pugi::xpath_node();
+	}
+	return pofxml_findnode(path, from);
+}
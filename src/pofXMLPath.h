@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2014 Antoine Rousseau <antoine@metalu.net>
+ * BSD Simplified License, see the file "LICENSE.txt" in this distribution.
+ * See https://github.com/Ant1r/ofxPof for documentation and updates.
+ */
+#pragma once
+
+#include "pugixml.hpp"
+
+// Resolve a path with the syntax of ofxXmlPoco (Poco::XML::Node::getNodeByPath()), from an element:
+// "a/b", "a[2]" (0-based), "a[@attr]" (the attribute), "a[@attr=value]", "//a", "/" (the element itself).
+// The result is either an element or an attribute.
+// Doesn't depend on Pd or OF, so that it can be benchmarked alone (see benchmark/xml).
+pugi::xpath_node pofXMLFindPath(pugi::xml_node from, const char *path);
@@ -19,11 +19,15 @@
 #include "pofText.h"
 #include "pofFonts.h"
 #include "pofTexts.h"
+#include "pofTextView.h"
 #include "pofImage.h"
 #include "pofFbo.h"
+#include "pofVbo.h"
+#include "pofInstances.h"
 #include "pofTouchable.h"
 #include "pofVisible.h"
 #include "pofScope.h"
+#include "pofSpectrum.h"
 #include "pofCirc.h"
 #include "pofUtil.h"
 #include "pofXML.h"
@@ -65,9 +69,13 @@ void setupAll() {
 	pofText::setup();
 	pofFonts::setup();
 	pofTexts::setup();
+	pofTextView::setup();
 	pofImage::setup();
 	pofFbo::setup();
+	pofVbo::setup();
+	pofInstances::setup();
 	pofScope::setup();
+	pofSpectrum::setup();
 	pofCirc::setup();
 	pofUtil::setup();
 	pofXML::setup();